@@ -60,6 +60,8 @@
 #include "serialize.h"
 #include "shader_cache.h"
 #include "util/mesa-sha1.h"
+#include "util/set.h"
+#include "util/u_process.h"
 #include "string_to_uint_map.h"
 #include "main/mtypes.h"
 
@@ -76,6 +78,23 @@ compile_shaders(struct gl_context *ctx, struct gl_shader_program *prog) {
    }
 }
 
+/* The number of program keys remembered per process and API, about as many
+ * programs as the largest GL applications link.
+ */
+#define SHADER_CACHE_MAX_PROGRAM_SET 4096
+
+static void
+record_program_key(struct gl_context *ctx, const cache_key key)
+{
+   if (util_dynarray_num_elements(&ctx->ProgramCacheKeys, cache_key) >=
+       4 * SHADER_CACHE_MAX_PROGRAM_SET)
+      return;
+
+   void *entry = util_dynarray_grow(&ctx->ProgramCacheKeys, cache_key, 1);
+   if (entry)
+      memcpy(entry, key, sizeof(cache_key));
+}
+
 static void
 create_binding_str(const char *key, unsigned value, void *closure)
 {
@@ -130,6 +149,7 @@ shader_cache_write_program_metadata(struct gl_context *ctx,
 
    disk_cache_put(cache, prog->data->sha1, metadata.data, metadata.size,
                   &cache_item_metadata);
+   record_program_key(ctx, prog->data->sha1);
 
    char sha1_buf[41];
    if (ctx->_Shader->Flags & GLSL_CACHE_INFO) {
@@ -260,7 +280,145 @@ shader_cache_read_program_metadata(struct gl_context *ctx,
    /* This is used to flag a shader retrieved from cache */
    prog->data->LinkStatus = LINKING_SKIPPED;
 
+   record_program_key(ctx, prog->data->sha1);
+
    free (buffer);
 
    return true;
 }
+
+static void
+compute_program_set_key(struct gl_context *ctx, cache_key key)
+{
+   const char *name = util_get_process_name();
+   char *buf = ralloc_asprintf(NULL, "program set: %s api: %d",
+                               name ? name : "", ctx->API);
+
+   disk_cache_compute_key(ctx->Cache, buf, strlen(buf), key);
+   ralloc_free(buf);
+}
+
+static void
+prefetch_program_cb(void *data, const cache_key key, void *blob, size_t size)
+{
+   /* Reading the item is all it takes to have it in the page cache */
+   free(blob);
+}
+
+/**
+ * Start reading the programs this application used last time in the
+ * background, so that linking them finds their cache items in memory.
+ */
+void
+shader_cache_prefetch_programs(struct gl_context *ctx)
+{
+   struct disk_cache *cache = ctx->Cache;
+   if (!cache)
+      return;
+
+   cache_key set_key;
+   compute_program_set_key(ctx, set_key);
+
+   size_t size;
+   uint8_t *buffer = (uint8_t *) disk_cache_get(cache, set_key, &size);
+   if (buffer == NULL)
+      return;
+
+   unsigned num_keys = size / sizeof(cache_key);
+   if (size % sizeof(cache_key) || num_keys > SHADER_CACHE_MAX_PROGRAM_SET) {
+      disk_cache_remove(cache, set_key);
+      free(buffer);
+      return;
+   }
+
+   if (ctx->_Shader->Flags & GLSL_CACHE_INFO)
+      fprintf(stderr, "prefetching %u programs from cache\n", num_keys);
+
+   void *keys = util_dynarray_grow(&ctx->ProgramCacheKeys, cache_key,
+                                   num_keys);
+   if (keys) {
+      memcpy(keys, buffer, size);
+      ctx->NumPrefetchedProgramCacheKeys = num_keys;
+   }
+
+   disk_cache_get_batch(cache, (const cache_key *) buffer, num_keys,
+                        prefetch_program_cb, NULL);
+   free(buffer);
+}
+
+static uint32_t
+program_key_hash(const void *key)
+{
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+program_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(cache_key)) == 0;
+}
+
+/**
+ * Store the keys of the programs used by the context, most recently used
+ * first, for shader_cache_prefetch_programs() to pick up next time.
+ */
+void
+shader_cache_write_program_set(struct gl_context *ctx)
+{
+   struct disk_cache *cache = ctx->Cache;
+   if (!cache)
+      return;
+
+   const cache_key *keys =
+      util_dynarray_element(&ctx->ProgramCacheKeys, cache_key, 0);
+   unsigned num_keys =
+      util_dynarray_num_elements(&ctx->ProgramCacheKeys, cache_key);
+   unsigned num_prefetched = ctx->NumPrefetchedProgramCacheKeys;
+
+   if (num_keys == num_prefetched)
+      return;
+
+   struct set *seen = _mesa_set_create(NULL, program_key_hash,
+                                       program_key_equal);
+   cache_key *set = (cache_key *)
+      malloc(MIN2(num_keys, SHADER_CACHE_MAX_PROGRAM_SET) * sizeof(cache_key));
+   unsigned num_set = 0;
+   bool changed = false;
+   cache_key set_key;
+
+   if (!seen || !set)
+      goto done;
+
+   /* Don't rewrite the set when no new program has been used. */
+   for (unsigned i = 0; i < num_prefetched; i++)
+      _mesa_set_add(seen, keys[i]);
+   for (unsigned i = num_prefetched; i < num_keys && !changed; i++)
+      changed = !_mesa_set_search(seen, keys[i]);
+   if (!changed)
+      goto done;
+
+   _mesa_set_clear(seen, NULL);
+
+   for (unsigned i = num_keys; i-- > 0 &&
+        num_set < SHADER_CACHE_MAX_PROGRAM_SET;) {
+      bool found;
+      _mesa_set_search_or_add(seen, keys[i], &found);
+      if (!found)
+         memcpy(set[num_set++], keys[i], sizeof(cache_key));
+   }
+
+   compute_program_set_key(ctx, set_key);
+
+   /* Items are never overwritten in place */
+   disk_cache_remove(cache, set_key);
+   disk_cache_put(cache, set_key, set, num_set * sizeof(cache_key), NULL);
+
+   if (ctx->_Shader->Flags & GLSL_CACHE_INFO)
+      fprintf(stderr, "putting set of %u programs in cache\n", num_set);
+
+done:
+   free(set);
+   _mesa_set_destroy(seen, NULL);
+}
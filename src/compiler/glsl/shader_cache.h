@@ -37,4 +37,18 @@ bool
 shader_cache_read_program_metadata(struct gl_context *ctx,
                                    struct gl_shader_program *prog);
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void
+shader_cache_prefetch_programs(struct gl_context *ctx);
+
+void
+shader_cache_write_program_set(struct gl_context *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* SHADER_CACHE_H */
@@ -1114,6 +1114,27 @@ draw_set_sampler_views(struct draw_context *draw,
    draw->num_sampler_views[shader_stage] = num;
 }
 
+/**
+ * Tell the draw module which of the sampler views of a shader stage refer
+ * to textures stored in LP_TEXTURE_TILE_SIZE tiles rather than linearly.
+ * This is only meaningful for drivers which pass their own texture memory
+ * through draw_set_mapped_texture().
+ */
+void
+draw_set_tiled_sampler_views(struct draw_context *draw,
+                             enum pipe_shader_type shader_stage,
+                             uint32_t tiled_mask)
+{
+   debug_assert(shader_stage < PIPE_SHADER_TYPES);
+
+   if (draw->tiled_sampler_views[shader_stage] == tiled_mask)
+      return;
+
+   draw_do_flush( draw, DRAW_FLUSH_STATE_CHANGE );
+
+   draw->tiled_sampler_views[shader_stage] = tiled_mask;
+}
+
 void
 draw_set_samplers(struct draw_context *draw,
                   enum pipe_shader_type shader_stage,
@@ -183,6 +183,12 @@ draw_set_sampler_views(struct draw_context *draw,
                        enum pipe_shader_type shader_stage,
                        struct pipe_sampler_view **views,
                        unsigned num);
+
+void
+draw_set_tiled_sampler_views(struct draw_context *draw,
+                             enum pipe_shader_type shader_stage,
+                             uint32_t tiled_mask);
+
 void
 draw_set_samplers(struct draw_context *draw,
                   enum pipe_shader_type shader_stage,
@@ -2428,6 +2428,8 @@ draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
    for (i = 0 ; i < key->nr_sampler_views; i++) {
       lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
                                       llvm->draw->sampler_views[PIPE_SHADER_VERTEX][i]);
+      draw_sampler[i].texture_state.tiled =
+         (llvm->draw->tiled_sampler_views[PIPE_SHADER_VERTEX] >> i) & 1;
    }
 
    draw_image = draw_llvm_variant_key_images(key);
@@ -3020,6 +3022,8 @@ draw_gs_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
    for (i = 0 ; i < key->nr_sampler_views; i++) {
       lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
                                       llvm->draw->sampler_views[PIPE_SHADER_GEOMETRY][i]);
+      draw_sampler[i].texture_state.tiled =
+         (llvm->draw->tiled_sampler_views[PIPE_SHADER_GEOMETRY] >> i) & 1;
    }
 
    draw_image = draw_gs_llvm_variant_key_images(key);
@@ -3676,6 +3680,8 @@ draw_tcs_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
    for (i = 0 ; i < key->nr_sampler_views; i++) {
       lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
                                       llvm->draw->sampler_views[PIPE_SHADER_TESS_CTRL][i]);
+      draw_sampler[i].texture_state.tiled =
+         (llvm->draw->tiled_sampler_views[PIPE_SHADER_TESS_CTRL] >> i) & 1;
    }
 
    draw_image = draw_tcs_llvm_variant_key_images(key);
@@ -4201,6 +4207,8 @@ draw_tes_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
    for (i = 0 ; i < key->nr_sampler_views; i++) {
       lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
                                       llvm->draw->sampler_views[PIPE_SHADER_TESS_EVAL][i]);
+      draw_sampler[i].texture_state.tiled =
+         (llvm->draw->tiled_sampler_views[PIPE_SHADER_TESS_EVAL] >> i) & 1;
    }
 
    draw_image = draw_tes_llvm_variant_key_images(key);
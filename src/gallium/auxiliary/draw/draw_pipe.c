@@ -35,6 +35,10 @@
 #include "util/u_debug.h"
 #include "util/u_math.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <xmmintrin.h>
+#endif
+
 
 
 boolean draw_pipeline_init( struct draw_context *draw )
@@ -171,6 +175,124 @@ static void do_triangle( struct draw_context *draw,
 }
 
 
+/** Number of triangles classified at once by pipe_run_tris_batched() */
+#define PIPE_TRI_BATCH 16
+
+
+/**
+ * Run a list of triangles through the pipeline, dropping those which the
+ * clip stage would trivially reject or the cull stage would cull in
+ * batches beforehand, so that they don't go through every stage one by
+ * one.  Triangles which need actual clipping, and everything left when
+ * neither stage is active, still go the regular way and in order.
+ *
+ * \param elts  vertex indices, or NULL for linear vertices
+ */
+static void
+pipe_run_tris_batched(struct draw_context *draw,
+                      char *verts,
+                      unsigned stride,
+                      const ushort *elts,
+                      unsigned count,
+                      unsigned max_index)
+{
+   const struct pipe_rasterizer_state *rast = draw->rasterizer;
+   const unsigned pos = draw_current_shader_position_output(draw);
+   const boolean clip = draw->clip_xy || draw->clip_z || draw->clip_user;
+   /* faces culled by a negative, positive and zero det, see draw_pipe_cull.c */
+   const unsigned cull_neg = (rast->cull_face &
+                              (rast->front_ccw ? PIPE_FACE_FRONT :
+                                                 PIPE_FACE_BACK)) ? ~0u : 0;
+   const unsigned cull_pos = (rast->cull_face &
+                              (rast->front_ccw ? PIPE_FACE_BACK :
+                                                 PIPE_FACE_FRONT)) ? ~0u : 0;
+   const unsigned cull_zero = (rast->cull_face & PIPE_FACE_BACK) ? ~0u : 0;
+   unsigned first;
+
+   for (first = 0; first + 2 < count; first += 3 * PIPE_TRI_BATCH) {
+      PIPE_ALIGN_VAR(16) float ex[PIPE_TRI_BATCH];
+      PIPE_ALIGN_VAR(16) float ey[PIPE_TRI_BATCH];
+      PIPE_ALIGN_VAR(16) float fx[PIPE_TRI_BATCH];
+      PIPE_ALIGN_VAR(16) float fy[PIPE_TRI_BATCH];
+      char *v[PIPE_TRI_BATCH][3];
+      const unsigned n = MIN2((count - first) / 3, PIPE_TRI_BATCH);
+      unsigned reject = 0, unclipped = 0, neg = 0, zero = 0;
+      unsigned culled, keep;
+      unsigned i, j;
+
+      /* gather the clip masks and edge vectors, as in cull_tri() */
+      for (i = 0; i < n; i++) {
+         const struct vertex_header *vh[3];
+         unsigned and_mask, or_mask;
+
+         for (j = 0; j < 3; j++) {
+            unsigned idx = first + 3 * i + j;
+            if (elts)
+               idx = MIN2(elts[idx], max_index);
+            v[i][j] = verts + stride * idx;
+            vh[j] = (const struct vertex_header *)v[i][j];
+         }
+
+         and_mask = vh[0]->clipmask & vh[1]->clipmask & vh[2]->clipmask;
+         or_mask = vh[0]->clipmask | vh[1]->clipmask | vh[2]->clipmask;
+         if (clip && and_mask)
+            reject |= 1 << i;
+         if (!or_mask)
+            unclipped |= 1 << i;
+
+         ex[i] = vh[0]->data[pos][0] - vh[2]->data[pos][0];
+         ey[i] = vh[0]->data[pos][1] - vh[2]->data[pos][1];
+         fx[i] = vh[1]->data[pos][0] - vh[2]->data[pos][0];
+         fy[i] = vh[1]->data[pos][1] - vh[2]->data[pos][1];
+      }
+      for (; i < align(n, 4); i++)
+         ex[i] = ey[i] = fx[i] = fy[i] = 0.0f;
+
+      /* det = cross(e,f).z, only its sign and zero-ness matter */
+#if defined(PIPE_ARCH_SSE)
+      for (i = 0; i < n; i += 4) {
+         const __m128 det =
+            _mm_sub_ps(_mm_mul_ps(_mm_load_ps(ex + i), _mm_load_ps(fy + i)),
+                       _mm_mul_ps(_mm_load_ps(ey + i), _mm_load_ps(fx + i)));
+         neg |= _mm_movemask_ps(_mm_cmplt_ps(det, _mm_setzero_ps())) << i;
+         zero |= _mm_movemask_ps(_mm_cmpeq_ps(det, _mm_setzero_ps())) << i;
+      }
+#else
+      for (i = 0; i < n; i++) {
+         const float det = ex[i] * fy[i] - ey[i] * fx[i];
+         neg |= (det < 0) << i;
+         zero |= (det == 0) << i;
+      }
+#endif
+
+      /* window coords are only meaningful for unclipped triangles */
+      culled = ((neg & cull_neg) |
+                (zero & cull_zero) |
+                (~(neg | zero) & cull_pos)) & unclipped;
+      keep = BITFIELD_MASK(n) & ~reject & ~culled;
+
+      while (keep) {
+         i = u_bit_scan(&keep);
+         do_triangle(draw,
+                     DRAW_PIPE_RESET_STIPPLE | DRAW_PIPE_EDGE_FLAG_ALL,
+                     v[i][0], v[i][1], v[i][2]);
+      }
+   }
+}
+
+
+/**
+ * Whether pipe_run_tris_batched() can drop triangles of this primitive.
+ */
+static inline boolean
+pipe_use_tris_batched(const struct draw_context *draw, unsigned prim)
+{
+   return prim == PIPE_PRIM_TRIANGLES &&
+          (draw->clip_xy || draw->clip_z || draw->clip_user ||
+           draw->rasterizer->cull_face != PIPE_FACE_NONE);
+}
+
+
 /*
  * Set up macros for draw_pt_decompose.h template code.
  * This code uses vertex indexes / elements.
@@ -262,6 +384,16 @@ void draw_pipeline_run( struct draw_context *draw,
       }
 #endif
 
+      if (pipe_use_tris_batched(draw, prim_info->prim)) {
+         pipe_run_tris_batched(draw,
+                               (char *)vert_info->verts,
+                               vert_info->stride,
+                               prim_info->elts + start,
+                               count,
+                               vert_info->count - 1);
+         continue;
+      }
+
       pipe_run_elts(draw,
                     prim_info->prim,
                     prim_info->flags,
@@ -334,6 +466,12 @@ void draw_pipeline_run_linear( struct draw_context *draw,
 
       assert(count <= vert_info->count);
 
+      if (pipe_use_tris_batched(draw, prim_info->prim)) {
+         pipe_run_tris_batched(draw, verts, vert_info->stride,
+                               NULL, count, count - 1);
+         continue;
+      }
+
       pipe_run_linear(draw,
                       prim_info->prim,
                       prim_info->flags,
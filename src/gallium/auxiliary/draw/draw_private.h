@@ -191,6 +191,8 @@ struct draw_context
       unsigned eltSize; /* saved eltSize for flushing */
       ubyte vertices_per_patch;
       boolean rebind_parameters;
+      /** bumped for each draw_vbo(), vertex buffer contents may change */
+      unsigned vs_cache_serial;
 
       struct {
          struct draw_pt_middle_end *fetch_shade_emit;
@@ -407,6 +409,8 @@ struct draw_context
     */
    struct pipe_sampler_view *sampler_views[PIPE_SHADER_TYPES][PIPE_MAX_SHADER_SAMPLER_VIEWS];
    unsigned num_sampler_views[PIPE_SHADER_TYPES];
+   /** Bitmask of sampler views whose texture is stored tiled */
+   uint32_t tiled_sampler_views[PIPE_SHADER_TYPES];
    const struct pipe_sampler_state *samplers[PIPE_SHADER_TYPES][PIPE_MAX_SAMPLERS];
    unsigned num_samplers[PIPE_SHADER_TYPES];
 
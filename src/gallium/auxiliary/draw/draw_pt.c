@@ -53,12 +53,14 @@ DEBUG_GET_ONCE_BOOL_OPTION(draw_no_fse, "DRAW_NO_FSE", FALSE)
  *     - pipeline -- the prim pipeline: clipping, wide lines, etc 
  *     - backend  -- the vbuf_render provided by the driver.
  */
-static boolean
-draw_pt_arrays(struct draw_context *draw,
-               unsigned prim,
-               bool index_bias_varies,
-               const struct pipe_draw_start_count_bias *draw_info,
-               unsigned num_draws)
+
+/**
+ * Pick the middle end for the current state and (re)prepare the frontend
+ * if the primitive type, pipeline options or index size changed.
+ * Returns the frontend to run the draws through.
+ */
+static struct draw_pt_front_end *
+draw_pt_validate(struct draw_context *draw, unsigned prim)
 {
    struct draw_pt_front_end *frontend = NULL;
    struct draw_pt_middle_end *middle = NULL;
@@ -135,7 +137,21 @@ draw_pt_arrays(struct draw_context *draw,
       draw->pt.rebind_parameters = FALSE;
    }
 
+   return frontend;
+}
+
 
+/**
+ * Run the draws through an already validated frontend.
+ */
+static void
+draw_pt_arrays_run(struct draw_context *draw,
+                   struct draw_pt_front_end *frontend,
+                   unsigned prim,
+                   bool index_bias_varies,
+                   const struct pipe_draw_start_count_bias *draw_info,
+                   unsigned num_draws)
+{
    for (unsigned i = 0; i < num_draws; i++) {
       unsigned count = draw_info[i].count;
       /* Sanitize primitive length:
@@ -157,7 +173,20 @@ draw_pt_arrays(struct draw_context *draw,
       if (draw->pt.user.increment_draw_id)
          draw->pt.user.drawid++;
    }
+}
+
+
+static boolean
+draw_pt_arrays(struct draw_context *draw,
+               unsigned prim,
+               bool index_bias_varies,
+               const struct pipe_draw_start_count_bias *draw_info,
+               unsigned num_draws)
+{
+   struct draw_pt_front_end *frontend = draw_pt_validate(draw, prim);
 
+   draw_pt_arrays_run(draw, frontend, prim, index_bias_varies,
+                      draw_info, num_draws);
    return TRUE;
 }
 
@@ -452,6 +481,8 @@ resolve_draw_info(const struct pipe_draw_info *raw_info,
 
 /*
  * Loop over all instances and execute draws for them.
+ * Each instance still runs the vertex shader on its own, one instance id
+ * per call, even when a small mesh leaves most SIMD lanes idle.
  */
 static void
 draw_instances(struct draw_context *draw,
@@ -459,6 +490,7 @@ draw_instances(struct draw_context *draw,
                const struct pipe_draw_start_count_bias *draws,
                unsigned num_draws)
 {
+   struct draw_pt_front_end *frontend = NULL;
    unsigned instance;
 
    draw->start_instance = info->start_instance;
@@ -479,7 +511,17 @@ draw_instances(struct draw_context *draw,
          draw_pt_arrays_restart(draw, info, draws, num_draws);
       }
       else {
-         draw_pt_arrays(draw, info->mode, info->index_bias_varies, draws, num_draws);
+         /* State can't change between instances, so only revalidate if
+          * something in the pipeline flushed the frontend or asked for the
+          * parameters to be rebound.
+          */
+         if (!frontend ||
+             draw->pt.frontend != frontend ||
+             draw->pt.rebind_parameters)
+            frontend = draw_pt_validate(draw, info->mode);
+
+         draw_pt_arrays_run(draw, frontend, info->mode,
+                            info->index_bias_varies, draws, num_draws);
       }
    }
 }
@@ -528,6 +570,7 @@ draw_vbo(struct draw_context *draw,
    draw->pt.user.max_index = use_info->index_bounds_valid ? use_info->max_index : ~0;
    draw->pt.user.eltSize = use_info->index_size ? draw->pt.user.eltSizeIB : 0;
    draw->pt.user.drawid = drawid_offset;
+   draw->pt.vs_cache_serial++;
    draw->pt.user.increment_draw_id = use_info->increment_draw_id;
    draw->pt.user.viewid = 0;
    draw->pt.vertices_per_patch = use_info->vertices_per_patch;
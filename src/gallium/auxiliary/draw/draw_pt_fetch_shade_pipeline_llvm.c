@@ -25,9 +25,11 @@
  *
  **************************************************************************/
 
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_tess.h"
@@ -39,8 +41,36 @@
 #include "draw/draw_llvm.h"
 #include "gallivm/lp_bld_init.h"
 #include "gallivm/lp_bld_debug.h"
+#include "nir.h"
 
 
+/*
+ * Large fetch chunks may be split further and shaded concurrently on
+ * a pool of worker threads (see DRAW_VS_THREADS). Chunks smaller than
+ * this aren't worth the hand-off.
+ */
+#define LLVM_VS_JOB_MIN_VERTICES 128
+#define LLVM_VS_MAX_JOBS 32
+
+/*
+ * Number of shaded vertices kept around for reuse by later fetch chunks
+ * of indexed draws (see llvm_vs_run_cached). Must be a power of two.
+ */
+#define LLVM_VS_CACHE_SIZE 2048
+
+struct llvm_middle_end;
+
+struct llvm_vs_job {
+   struct llvm_middle_end *fpme;
+   struct util_queue_fence fence;
+   struct vertex_header *io;
+   unsigned count;
+   unsigned start_or_maxelt;
+   unsigned vid_base;
+   const unsigned *elts;
+   boolean clipped;
+};
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -58,6 +88,38 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /* worker threads for parallel vertex shading, if enabled */
+   struct util_queue vs_queue;
+   /* linear fetches can't be split if the vs reads the first vertex */
+   boolean vs_reads_first_vertex;
+   boolean vs_reads_vertex_id;
+   boolean vs_reads_draw_id;
+
+   /*
+    * Post-transform vertex cache, direct mapped by fetch element. The
+    * vertices stay valid until the state they were shaded with changes,
+    * or the next draw_vbo() call (vertex buffer contents may have changed
+    * in between).
+    */
+   struct {
+      boolean enabled;
+      boolean valid;
+      unsigned vertex_size;
+      struct vertex_header *verts;
+      unsigned *elts;           /**< element of each slot, ~0 if empty */
+      boolean *clipped;         /**< whether the vs run it came from clipped */
+
+      /* what the cached vertices depend on */
+      unsigned serial;
+      unsigned instance_id;
+      unsigned start_instance;
+      unsigned start_index;
+      unsigned elt_bias;
+      unsigned elt_max;
+      unsigned drawid;
+      unsigned viewid;
+   } cache;
 };
 
 
@@ -69,6 +131,13 @@ llvm_middle_end(struct draw_pt_middle_end *middle)
 }
 
 
+static void
+llvm_vs_cache_invalidate(struct llvm_middle_end *fpme)
+{
+   fpme->cache.valid = FALSE;
+}
+
+
 static void
 llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
 {
@@ -410,6 +479,22 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
       fpme->current_variant = variant;
    }
 
+   if (vs->state.type == PIPE_SHADER_IR_NIR && vs->state.ir.nir) {
+      const nir_shader *nir = vs->state.ir.nir;
+      fpme->vs_reads_first_vertex =
+         BITSET_TEST(nir->info.system_values_read, SYSTEM_VALUE_FIRST_VERTEX);
+   }
+   else {
+      fpme->vs_reads_first_vertex = FALSE;
+   }
+   fpme->vs_reads_vertex_id = vs->info.uses_vertexid ||
+                              vs->info.uses_vertexid_nobase ||
+                              vs->info.uses_basevertex;
+   fpme->vs_reads_draw_id = vs->info.uses_drawid;
+
+   /* the variant, vertex layout or any of the above may have changed */
+   llvm_vs_cache_invalidate(fpme);
+
    if (gs) {
       llvm_middle_end_prepare_gs(fpme);
    }
@@ -447,6 +532,8 @@ llvm_middle_end_bind_parameters(struct draw_pt_middle_end *middle)
    struct draw_llvm *llvm = fpme->llvm;
    unsigned i;
 
+   llvm_vs_cache_invalidate(fpme);
+
    for (i = 0; i < ARRAY_SIZE(llvm->jit_context.vs_constants); ++i) {
       /*
        * There could be a potential issue with rounding this up, as the
@@ -560,6 +647,267 @@ emit(struct pt_emit *emit,
 }
 
 
+static boolean
+llvm_vs_run(struct llvm_middle_end *fpme,
+            struct vertex_header *io,
+            unsigned count,
+            unsigned start_or_maxelt,
+            unsigned vid_base,
+            const unsigned *elts)
+{
+   struct draw_context *draw = fpme->draw;
+
+   return fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                          io,
+                                          draw->pt.user.vbuffer,
+                                          count,
+                                          start_or_maxelt,
+                                          fpme->vertex_size,
+                                          draw->pt.vertex_buffer,
+                                          draw->instance_id,
+                                          vid_base,
+                                          draw->start_instance,
+                                          elts, draw->pt.user.drawid,
+                                          draw->pt.user.viewid);
+}
+
+
+static void
+llvm_vs_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct llvm_vs_job *job = (struct llvm_vs_job *)data;
+   unsigned fpstate = util_fpstate_get();
+
+   /* match the fp state draw_vbo() set up on the application thread */
+   util_fpstate_set_denorms_to_zero(fpstate);
+
+   job->clipped = llvm_vs_run(job->fpme, job->io, job->count,
+                              job->start_or_maxelt, job->vid_base,
+                              job->elts);
+
+   util_fpstate_set(fpstate);
+}
+
+
+/**
+ * Run fetch and vs over a fetch chunk, splitting it up across the vs
+ * worker threads when it is large enough. Vertices are written to the
+ * same positions as in the serial path, so the rest of the pipeline
+ * (and thus binning order) is unaffected.
+ */
+static boolean
+llvm_vs_run_parallel(struct llvm_middle_end *fpme,
+                     struct vertex_header *verts,
+                     unsigned count,
+                     unsigned start_or_maxelt,
+                     unsigned vid_base,
+                     const unsigned *elts)
+{
+   struct llvm_vs_job jobs[LLVM_VS_MAX_JOBS];
+   const unsigned vector_length = lp_native_vector_width / 32;
+   unsigned num_jobs, chunk, offset, i;
+   boolean clipped;
+
+   num_jobs = MIN3(fpme->vs_queue.num_threads + 1,
+                   count / LLVM_VS_JOB_MIN_VERTICES,
+                   LLVM_VS_MAX_JOBS);
+   if (num_jobs < 2) {
+      return llvm_vs_run(fpme, verts, count, start_or_maxelt,
+                         vid_base, elts);
+   }
+
+   /*
+    * The jit function always writes whole vectors of vertices, so every
+    * chunk but the last must be a multiple of the vector length or it
+    * would overwrite the start of the next chunk.
+    */
+   chunk = align(DIV_ROUND_UP(count, num_jobs), vector_length);
+
+   for (i = 0, offset = 0; offset < count; i++, offset += chunk) {
+      struct llvm_vs_job *job = &jobs[i];
+
+      job->fpme = fpme;
+      job->io = (struct vertex_header *)
+         ((char *)verts + offset * fpme->vertex_size);
+      job->count = MIN2(chunk, count - offset);
+      job->vid_base = vid_base;
+      if (elts) {
+         job->start_or_maxelt = start_or_maxelt;
+         job->elts = elts + offset;
+      }
+      else {
+         job->start_or_maxelt = start_or_maxelt + offset;
+         job->elts = NULL;
+      }
+   }
+   num_jobs = i;
+
+   /* queue all but the last chunk, which is shaded on this thread */
+   for (i = 0; i < num_jobs - 1; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&fpme->vs_queue, &jobs[i], &jobs[i].fence,
+                         llvm_vs_job_execute, NULL, 0);
+   }
+
+   clipped = llvm_vs_run(fpme, jobs[i].io, jobs[i].count,
+                         jobs[i].start_or_maxelt, vid_base, jobs[i].elts);
+
+   for (i = 0; i < num_jobs - 1; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+      clipped |= jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
+
+/**
+ * Make sure the vertex cache matches the current draw, returns FALSE if
+ * it can't be used.
+ */
+static boolean
+llvm_vs_cache_validate(struct llvm_middle_end *fpme)
+{
+   struct draw_context *draw = fpme->draw;
+   const unsigned drawid = fpme->vs_reads_draw_id ? draw->pt.user.drawid : 0;
+   const unsigned elt_bias = fpme->vs_reads_vertex_id ? draw->pt.user.eltBias : 0;
+   const unsigned start_index = fpme->vs_reads_first_vertex ? draw->start_index : 0;
+
+   if (!fpme->cache.enabled)
+      return FALSE;
+
+   if (fpme->cache.vertex_size != fpme->vertex_size) {
+      FREE(fpme->cache.verts);
+      fpme->cache.verts = MALLOC(fpme->vertex_size * LLVM_VS_CACHE_SIZE);
+      if (!fpme->cache.verts) {
+         fpme->cache.vertex_size = 0;
+         return FALSE;
+      }
+      fpme->cache.vertex_size = fpme->vertex_size;
+      fpme->cache.valid = FALSE;
+   }
+
+   if (fpme->cache.valid &&
+       fpme->cache.serial == draw->pt.vs_cache_serial &&
+       fpme->cache.instance_id == draw->instance_id &&
+       fpme->cache.start_instance == draw->start_instance &&
+       fpme->cache.start_index == start_index &&
+       fpme->cache.elt_bias == elt_bias &&
+       fpme->cache.elt_max == draw->pt.user.eltMax &&
+       fpme->cache.drawid == drawid &&
+       fpme->cache.viewid == draw->pt.user.viewid)
+      return TRUE;
+
+   memset(fpme->cache.elts, 0xff, LLVM_VS_CACHE_SIZE * sizeof(unsigned));
+   fpme->cache.serial = draw->pt.vs_cache_serial;
+   fpme->cache.instance_id = draw->instance_id;
+   fpme->cache.start_instance = draw->start_instance;
+   fpme->cache.start_index = start_index;
+   fpme->cache.elt_bias = elt_bias;
+   fpme->cache.elt_max = draw->pt.user.eltMax;
+   fpme->cache.drawid = drawid;
+   fpme->cache.viewid = draw->pt.user.viewid;
+   fpme->cache.valid = TRUE;
+   return TRUE;
+}
+
+
+/**
+ * Run the vs over an indexed fetch chunk, taking vertices which earlier
+ * chunks already shaded from the cache. Only the remaining ones go through
+ * the vs, which is what the vs_invocations statistic counts.
+ */
+static boolean
+llvm_vs_run_cached(struct llvm_middle_end *fpme,
+                   struct vertex_header *verts,
+                   unsigned count,
+                   unsigned start_or_maxelt,
+                   unsigned vid_base,
+                   const unsigned *elts,
+                   unsigned *num_shaded)
+{
+   const unsigned vertex_size = fpme->vertex_size;
+   struct vertex_header *shaded = verts;
+   unsigned *miss_elts, *miss_pos;
+   unsigned num_misses = 0;
+   boolean clipped = FALSE, run_clipped;
+   unsigned i;
+
+   miss_elts = MALLOC(2 * count * sizeof(unsigned));
+   if (!miss_elts)
+      goto uncached;
+   miss_pos = miss_elts + count;
+
+   for (i = 0; i < count; i++) {
+      const unsigned slot = elts[i] & (LLVM_VS_CACHE_SIZE - 1);
+
+      if (fpme->cache.elts[slot] == elts[i] && elts[i] != ~0u) {
+         memcpy((char *)verts + i * vertex_size,
+                (char *)fpme->cache.verts + slot * vertex_size,
+                vertex_size);
+         clipped |= fpme->cache.clipped[slot];
+      }
+      else {
+         miss_elts[num_misses] = elts[i];
+         miss_pos[num_misses] = i;
+         num_misses++;
+      }
+   }
+
+   *num_shaded = num_misses;
+   if (!num_misses) {
+      FREE(miss_elts);
+      return clipped;
+   }
+
+   if (num_misses < count) {
+      /* shade the misses on their own and scatter them below */
+      shaded = MALLOC(vertex_size *
+                      align(num_misses, lp_native_vector_width / 32) +
+                      DRAW_EXTRA_VERTICES_PADDING);
+      if (!shaded) {
+         FREE(miss_elts);
+         goto uncached;
+      }
+   }
+
+   if (util_queue_is_initialized(&fpme->vs_queue)) {
+      run_clipped = llvm_vs_run_parallel(fpme, shaded, num_misses,
+                                         start_or_maxelt, vid_base,
+                                         miss_elts);
+   }
+   else {
+      run_clipped = llvm_vs_run(fpme, shaded, num_misses, start_or_maxelt,
+                                vid_base, miss_elts);
+   }
+
+   for (i = 0; i < num_misses; i++) {
+      const char *vert = (const char *)shaded + i * vertex_size;
+      const unsigned slot = miss_elts[i] & (LLVM_VS_CACHE_SIZE - 1);
+
+      if (shaded != verts) {
+         memcpy((char *)verts + miss_pos[i] * vertex_size, vert,
+                vertex_size);
+      }
+      memcpy((char *)fpme->cache.verts + slot * vertex_size, vert,
+             vertex_size);
+      fpme->cache.elts[slot] = miss_elts[i];
+      fpme->cache.clipped[slot] = run_clipped;
+   }
+
+   if (shaded != verts)
+      FREE(shaded);
+   FREE(miss_elts);
+   return clipped | run_clipped;
+
+uncached:
+   llvm_vs_cache_invalidate(fpme);
+   *num_shaded = count;
+   return llvm_vs_run(fpme, verts, count, start_or_maxelt, vid_base, elts);
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -586,6 +934,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    boolean clipped = 0;
    unsigned start_or_maxelt, vid_base;
    const unsigned *elts;
+   unsigned num_shaded;
    ushort *tes_elts_out = NULL;
 
    memset(&gs_vert_info, 0, sizeof(struct draw_vertex_info) * TGSI_MAX_VERTEX_STREAMS);
@@ -609,9 +958,9 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       else
          draw->statistics.ia_primitives +=
             u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
    }
 
+   num_shaded = fetch_info->count;
    if (fetch_info->linear) {
       start_or_maxelt = fetch_info->start;
       vid_base = draw->start_index;
@@ -622,18 +971,25 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       vid_base = draw->pt.user.eltBias;
       elts = fetch_info->elts;
    }
-   clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                             llvm_vert_info.verts,
-                                             draw->pt.user.vbuffer,
-                                             fetch_info->count,
-                                             start_or_maxelt,
-                                             fpme->vertex_size,
-                                             draw->pt.vertex_buffer,
-                                             draw->instance_id,
-                                             vid_base,
-                                             draw->start_instance,
-                                             elts, draw->pt.user.drawid,
-                                             draw->pt.user.viewid);
+   if (elts && llvm_vs_cache_validate(fpme)) {
+      clipped = llvm_vs_run_cached(fpme, llvm_vert_info.verts,
+                                   fetch_info->count, start_or_maxelt,
+                                   vid_base, elts, &num_shaded);
+   }
+   else if (util_queue_is_initialized(&fpme->vs_queue) &&
+            (elts || !fpme->vs_reads_first_vertex)) {
+      clipped = llvm_vs_run_parallel(fpme, llvm_vert_info.verts,
+                                     fetch_info->count, start_or_maxelt,
+                                     vid_base, elts);
+   }
+   else {
+      clipped = llvm_vs_run(fpme, llvm_vert_info.verts,
+                            fetch_info->count, start_or_maxelt,
+                            vid_base, elts);
+   }
+
+   if (draw->collect_statistics)
+      draw->statistics.vs_invocations += num_shaded;
 
    /* Finished with fetch and vs:
     */
@@ -886,7 +1242,7 @@ llvm_middle_end_linear_run_elts(struct draw_pt_middle_end *middle,
 static void
 llvm_middle_end_finish(struct draw_pt_middle_end *middle)
 {
-   /* nothing to do */
+   llvm_vs_cache_invalidate(llvm_middle_end(middle));
 }
 
 
@@ -895,6 +1251,9 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
 
+   if (util_queue_is_initialized(&fpme->vs_queue))
+      util_queue_destroy(&fpme->vs_queue);
+
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
 
@@ -907,6 +1266,10 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   FREE(fpme->cache.verts);
+   FREE(fpme->cache.elts);
+   FREE(fpme->cache.clipped);
+
    FREE(middle);
 }
 
@@ -915,6 +1278,7 @@ struct draw_pt_middle_end *
 draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 {
    struct llvm_middle_end *fpme = 0;
+   unsigned num_vs_threads;
 
    if (!draw->llvm)
       return NULL;
@@ -955,6 +1319,20 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   num_vs_threads = debug_get_num_option("DRAW_VS_THREADS", 0);
+   num_vs_threads = MIN2(num_vs_threads, LLVM_VS_MAX_JOBS - 1);
+   if (num_vs_threads) {
+      /* failure here just means shading stays on the calling thread */
+      util_queue_init(&fpme->vs_queue, "draw_vs", LLVM_VS_MAX_JOBS,
+                      num_vs_threads, 0, NULL);
+   }
+
+   if (debug_get_bool_option("DRAW_VS_CACHE", TRUE)) {
+      fpme->cache.elts = MALLOC(LLVM_VS_CACHE_SIZE * sizeof(unsigned));
+      fpme->cache.clipped = MALLOC(LLVM_VS_CACHE_SIZE * sizeof(boolean));
+      fpme->cache.enabled = fpme->cache.elts && fpme->cache.clipped;
+   }
+
    return &fpme->base;
 
  fail:
@@ -599,3 +599,110 @@ lp_build_gather_values(struct gallivm_state * gallivm,
    }
    return vec;
 }
+
+
+/**
+ * Build the vector of element pointers and the i1 lane mask shared by
+ * lp_build_masked_gather() and lp_build_masked_scatter().
+ */
+static void
+lp_build_masked_mem_args(struct gallivm_state *gallivm,
+                         struct lp_type type,
+                         LLVMValueRef base_ptr,
+                         LLVMValueRef indices,
+                         LLVMValueRef mask,
+                         LLVMValueRef *ptrs,
+                         LLVMValueRef *mask_bits,
+                         char *intrinsic_suffix,
+                         size_t suffix_size)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef elem_type = lp_build_elem_type(gallivm, type);
+   const char *kind = type.floating ? "f" : "i";
+
+   base_ptr = LLVMBuildBitCast(builder, base_ptr,
+                               LLVMPointerType(elem_type, 0), "");
+   *ptrs = LLVMBuildGEP(builder, base_ptr, &indices, 1, "masked_ptrs");
+   *mask_bits = LLVMBuildICmp(builder, LLVMIntNE, mask,
+                              LLVMConstNull(LLVMTypeOf(mask)), "");
+
+#if LLVM_VERSION_MAJOR >= 7
+   /* the pointer vector is an overloaded type too */
+   snprintf(intrinsic_suffix, suffix_size, "v%u%s%u.v%up0%s%u",
+            type.length, kind, type.width, type.length, kind, type.width);
+#else
+   snprintf(intrinsic_suffix, suffix_size, "v%u%s%u",
+            type.length, kind, type.width);
+#endif
+}
+
+
+/**
+ * Load base_ptr[indices[i]] for each lane i whose mask is non-zero, using
+ * llvm.masked.gather. Lanes which are masked off don't access memory and
+ * read as zero. On AVX-512 this maps to a gather using a mask register.
+ *
+ * @param type  type of the returned vector
+ * @param base_ptr  pointer to the start of the array (any pointer type)
+ * @param indices  per lane element indices, an i32 vector of type.length
+ * @param mask  per lane integer mask, same length as indices
+ */
+LLVMValueRef
+lp_build_masked_gather(struct gallivm_state *gallivm,
+                       struct lp_type type,
+                       LLVMValueRef base_ptr,
+                       LLVMValueRef indices,
+                       LLVMValueRef mask)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMValueRef ptrs, mask_bits;
+   char suffix[32];
+   char intrinsic[64];
+
+   lp_build_masked_mem_args(gallivm, type, base_ptr, indices, mask,
+                            &ptrs, &mask_bits, suffix, sizeof suffix);
+   snprintf(intrinsic, sizeof intrinsic, "llvm.masked.gather.%s", suffix);
+
+   LLVMValueRef args[] = {
+      ptrs,
+      lp_build_const_int32(gallivm, type.width / 8),
+      mask_bits,
+      LLVMConstNull(vec_type)
+   };
+
+   return lp_build_intrinsic(builder, intrinsic, vec_type, args, 4, 0);
+}
+
+
+/**
+ * Store each lane of value to base_ptr[indices[i]] if its mask is non-zero,
+ * using llvm.masked.scatter. See lp_build_masked_gather().
+ */
+void
+lp_build_masked_scatter(struct gallivm_state *gallivm,
+                        struct lp_type type,
+                        LLVMValueRef base_ptr,
+                        LLVMValueRef indices,
+                        LLVMValueRef value,
+                        LLVMValueRef mask)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef ptrs, mask_bits;
+   char suffix[32];
+   char intrinsic[64];
+
+   lp_build_masked_mem_args(gallivm, type, base_ptr, indices, mask,
+                            &ptrs, &mask_bits, suffix, sizeof suffix);
+   snprintf(intrinsic, sizeof intrinsic, "llvm.masked.scatter.%s", suffix);
+
+   LLVMValueRef args[] = {
+      LLVMBuildBitCast(builder, value, lp_build_vec_type(gallivm, type), ""),
+      ptrs,
+      lp_build_const_int32(gallivm, type.width / 8),
+      mask_bits
+   };
+
+   lp_build_intrinsic(builder, intrinsic,
+                      LLVMVoidTypeInContext(gallivm->context), args, 4, 0);
+}
@@ -66,4 +66,19 @@ lp_build_gather_values(struct gallivm_state * gallivm,
                        LLVMValueRef * values,
                        unsigned value_count);
 
+LLVMValueRef
+lp_build_masked_gather(struct gallivm_state *gallivm,
+                       struct lp_type type,
+                       LLVMValueRef base_ptr,
+                       LLVMValueRef indices,
+                       LLVMValueRef mask);
+
+void
+lp_build_masked_scatter(struct gallivm_state *gallivm,
+                        struct lp_type type,
+                        LLVMValueRef base_ptr,
+                        LLVMValueRef indices,
+                        LLVMValueRef value,
+                        LLVMValueRef mask);
+
 #endif /* LP_BLD_GATHER_H_ */
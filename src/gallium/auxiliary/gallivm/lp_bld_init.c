@@ -85,6 +85,7 @@ DEBUG_GET_ONCE_FLAGS_OPTION(gallivm_debug, "GALLIVM_DEBUG", lp_bld_debug_flags,
 static boolean gallivm_initialized = FALSE;
 
 unsigned lp_native_vector_width;
+unsigned lp_compute_vector_width;
 
 
 /*
@@ -458,6 +459,17 @@ lp_build_init(void)
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   /* 16-wide compute shading is opt-in, as running 512-bit code can lower
+    * the clock frequency of the whole core on some CPUs.
+    */
+   lp_compute_vector_width = debug_get_num_option("LP_COMPUTE_VECTOR_WIDTH",
+                                                  lp_native_vector_width);
+   if (lp_compute_vector_width != lp_native_vector_width &&
+       (lp_compute_vector_width != 512 ||
+        !util_get_cpu_caps()->has_avx512f)) {
+      lp_compute_vector_width = lp_native_vector_width;
+   }
+
 #if LLVM_VERSION_MAJOR < 4
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
@@ -2351,8 +2351,10 @@ void lp_build_opt_nir(struct nir_shader *nir)
       nir_lower_tex_options options = { .lower_tex_without_implicit_lod = true };
       NIR_PASS_V(nir, nir_lower_tex, &options);
 
+      /* compute shaders may run wider than the other stages */
       const nir_lower_subgroups_options subgroups_options = {
-	.subgroup_size = lp_native_vector_width / 32,
+	.subgroup_size = (nir->info.stage == MESA_SHADER_COMPUTE ?
+	                  lp_compute_vector_width : lp_native_vector_width) / 32,
 	.ballot_bit_size = 32,
         .ballot_components = 1,
 	.lower_to_scalar = true,
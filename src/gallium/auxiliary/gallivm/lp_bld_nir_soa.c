@@ -34,6 +34,7 @@
 #include "lp_bld_bitarit.h"
 #include "lp_bld_coro.h"
 #include "lp_bld_printf.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_math.h"
 
 static int bit_size_to_shift_size(int bit_size)
@@ -1028,6 +1029,18 @@ static void emit_load_ubo(struct lp_build_nir_context *bld_base,
 }
 
 
+/*
+ * With 16-wide vectors on AVX-512 the per-lane loop below is replaced by
+ * gathers/scatters predicated on a mask register.
+ */
+static bool
+use_masked_mem_ops(struct lp_build_nir_context *bld_base, unsigned bit_size)
+{
+   return util_get_cpu_caps()->has_avx512f &&
+          bld_base->base.type.length == 16 &&
+          (bit_size == 32 || bit_size == 64);
+}
+
 static void emit_load_mem(struct lp_build_nir_context *bld_base,
                           unsigned nc,
                           unsigned bit_size,
@@ -1065,6 +1078,12 @@ static void emit_load_mem(struct lp_build_nir_context *bld_base,
          exec_mask = LLVMBuildAnd(builder, exec_mask, ssbo_oob_cmp, "");
       }
 
+      if (use_masked_mem_ops(bld_base, bit_size)) {
+         outval[c] = lp_build_masked_gather(gallivm, load_bld->type, ssbo_ptr,
+                                            loop_index, exec_mask);
+         continue;
+      }
+
       LLVMValueRef result = lp_build_alloca(gallivm, load_bld->vec_type, "");
       struct lp_build_loop_state loop_state;
       lp_build_loop_begin(&loop_state, gallivm, lp_build_const_int32(gallivm, 0));
@@ -1148,6 +1167,12 @@ static void emit_store_mem(struct lp_build_nir_context *bld_base,
          exec_mask = LLVMBuildAnd(builder, exec_mask, ssbo_oob_cmp, "");
       }
 
+      if (use_masked_mem_ops(bld_base, bit_size)) {
+         lp_build_masked_scatter(gallivm, store_bld->type, ssbo_ptr,
+                                 loop_index, val, exec_mask);
+         continue;
+      }
+
       struct lp_build_loop_state loop_state;
       lp_build_loop_begin(&loop_state, gallivm, lp_build_const_int32(gallivm, 0));
       LLVMValueRef value_ptr = LLVMBuildExtractElement(gallivm->builder, val,
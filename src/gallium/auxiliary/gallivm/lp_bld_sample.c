@@ -2115,6 +2115,100 @@ lp_build_sample_offset(struct lp_build_context *bld,
    *out_offset = offset;
 }
 
+
+/**
+ * Compute the partial offset of a texel along the x (axis 0) or y (axis 1)
+ * axis of a texture stored in LP_TEXTURE_TILE_SIZE x LP_TEXTURE_TILE_SIZE
+ * tiles. As with linear textures the x and y terms are independent, so
+ * they can be computed separately and added together.
+ *
+ * @param texel_bytes  size of a texel in bytes
+ * @param coord        coordinate in texels
+ * @param row_stride   linear row stride in bytes (y axis only)
+ */
+LLVMValueRef
+lp_build_sample_tiled_partial_offset(struct lp_build_context *bld,
+                                     unsigned axis,
+                                     unsigned texel_bytes,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef row_stride)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   const unsigned tile_size = LP_TEXTURE_TILE_SIZE;
+   LLVMValueRef sub_mask, tile_mask;
+   LLVMValueRef subcoord, tilecoord, offset;
+
+   assert(axis < 2);
+
+   sub_mask = lp_build_const_int_vec(bld->gallivm, bld->type, tile_size - 1);
+   tile_mask = lp_build_const_int_vec(bld->gallivm, bld->type, -(int)tile_size);
+   subcoord = LLVMBuildAnd(builder, coord, sub_mask, "");
+   tilecoord = LLVMBuildAnd(builder, coord, tile_mask, "");
+
+   if (axis == 0) {
+      /*
+       * (x / 4) * 4 * 4 * texel_bytes + (x % 4) * texel_bytes
+       */
+      offset = lp_build_shl_imm(bld, tilecoord, util_logbase2(tile_size));
+      offset = LLVMBuildOr(builder, offset, subcoord, "");
+      offset = lp_build_mul_imm(bld, offset, texel_bytes);
+   }
+   else {
+      /*
+       * (y / 4) * 4 * row_stride + (y % 4) * 4 * texel_bytes
+       */
+      offset = lp_build_mul(bld, tilecoord, row_stride);
+      subcoord = lp_build_mul_imm(bld, subcoord, tile_size * texel_bytes);
+      offset = lp_build_add(bld, offset, subcoord);
+   }
+
+   return offset;
+}
+
+
+/**
+ * Tiled counterpart of lp_build_sample_offset().
+ *
+ * Only formats with 1x1 pixel blocks can be tiled, so the returned
+ * sub-block coordinates are always zero.
+ */
+void
+lp_build_sample_tiled_offset(struct lp_build_context *bld,
+                             const struct util_format_description *format_desc,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef z,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef z_stride,
+                             LLVMValueRef *out_offset,
+                             LLVMValueRef *out_i,
+                             LLVMValueRef *out_j)
+{
+   const unsigned texel_bytes = format_desc->block.bits / 8;
+   LLVMValueRef offset;
+
+   assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+
+   offset = lp_build_sample_tiled_partial_offset(bld, 0, texel_bytes,
+                                                 x, NULL);
+
+   if (y && y_stride) {
+      LLVMValueRef y_offset;
+      y_offset = lp_build_sample_tiled_partial_offset(bld, 1, texel_bytes,
+                                                      y, y_stride);
+      offset = lp_build_add(bld, offset, y_offset);
+   }
+
+   if (z && z_stride) {
+      LLVMValueRef z_offset = lp_build_mul(bld, z, z_stride);
+      offset = lp_build_add(bld, offset, z_offset);
+   }
+
+   *out_offset = offset;
+   *out_i = bld->zero;
+   *out_j = bld->zero;
+}
+
 static LLVMValueRef
 lp_build_sample_min(struct lp_build_context *bld,
                     LLVMValueRef x,
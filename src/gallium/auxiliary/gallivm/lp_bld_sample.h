@@ -174,9 +174,20 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+   unsigned tiled:1;         /**< stored in LP_TEXTURE_TILE_SIZE tiles? */
 };
 
 
+/**
+ * Width and height in texels of the tiles used by textures with the
+ * lp_static_texture_state::tiled bit set.  Tiles are stored in row-major
+ * order, and so are the texels within a tile, so a row of tiles takes up
+ * exactly as much memory as LP_TEXTURE_TILE_SIZE rows of a linear texture
+ * with the same row stride.
+ */
+#define LP_TEXTURE_TILE_SIZE 4
+
+
 /**
  * Sampler static state.
  *
@@ -677,6 +688,27 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef *out_j);
 
 
+LLVMValueRef
+lp_build_sample_tiled_partial_offset(struct lp_build_context *bld,
+                                     unsigned axis,
+                                     unsigned texel_bytes,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef row_stride);
+
+
+void
+lp_build_sample_tiled_offset(struct lp_build_context *bld,
+                             const struct util_format_description *format_desc,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef z,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef z_stride,
+                             LLVMValueRef *out_offset,
+                             LLVMValueRef *out_i,
+                             LLVMValueRef *out_j);
+
+
 void
 lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
                     const struct lp_static_sampler_state *static_sampler_state,
@@ -59,11 +59,40 @@
 #include "lp_bld_quad.h"
 
 
+/**
+ * Compute the partial offset of a wrapped texel coordinate along the
+ * given axis (0 = x, 1 = y, 2 = z), honouring the texture layout.
+ */
+static void
+lp_build_sample_wrapped_offset(struct lp_build_sample_context *bld,
+                               unsigned block_length,
+                               unsigned axis,
+                               LLVMValueRef coord,
+                               LLVMValueRef stride,
+                               LLVMValueRef *out_offset,
+                               LLVMValueRef *out_subcoord)
+{
+   if (bld->static_texture_state->tiled && axis < 2) {
+      *out_offset = lp_build_sample_tiled_partial_offset(&bld->int_coord_bld,
+                                                         axis,
+                                                         bld->format_desc->block.bits/8,
+                                                         coord, stride);
+      *out_subcoord = bld->int_coord_bld.zero;
+   }
+   else {
+      lp_build_sample_partial_offset(&bld->int_coord_bld, block_length,
+                                     coord, stride,
+                                     out_offset, out_subcoord);
+   }
+}
+
+
 /**
  * Build LLVM code for texture coord wrapping, for nearest filtering,
  * for scaled integer texcoords.
  * \param block_length  is the length of the pixel block along the
  *                      coordinate axis
+ * \param axis  the coordinate axis (0 = x, 1 = y, 2 = z)
  * \param coord  the incoming texcoord (s,t or r) scaled to the texture size
  * \param coord_f  the incoming texcoord (s,t or r) as float vec
  * \param length  the texture size along one dimension
@@ -77,6 +106,7 @@
 static void
 lp_build_sample_wrap_nearest_int(struct lp_build_sample_context *bld,
                                  unsigned block_length,
+                                 unsigned axis,
                                  LLVMValueRef coord,
                                  LLVMValueRef coord_f,
                                  LLVMValueRef length,
@@ -126,7 +156,7 @@ lp_build_sample_wrap_nearest_int(struct lp_build_sample_context *bld,
       assert(0);
    }
 
-   lp_build_sample_partial_offset(int_coord_bld, block_length, coord, stride,
+   lp_build_sample_wrapped_offset(bld, block_length, axis, coord, stride,
                                   out_offset, out_i);
 }
 
@@ -198,6 +228,7 @@ lp_build_coord_repeat_npot_linear_int(struct lp_build_sample_context *bld,
  * for scaled integer texcoords.
  * \param block_length  is the length of the pixel block along the
  *                      coordinate axis
+ * \param axis  the coordinate axis (0 = x, 1 = y, 2 = z)
  * \param coord0  the incoming texcoord (s,t or r) scaled to the texture size
  * \param coord_f  the incoming texcoord (s,t or r) as float vec
  * \param length  the texture size along one dimension
@@ -213,6 +244,7 @@ lp_build_coord_repeat_npot_linear_int(struct lp_build_sample_context *bld,
 static void
 lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
                                 unsigned block_length,
+                                unsigned axis,
                                 LLVMValueRef coord0,
                                 LLVMValueRef *weight_i,
                                 LLVMValueRef coord_f,
@@ -232,15 +264,16 @@ lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
    LLVMValueRef lmask, umask, mask;
 
    /*
-    * If the pixel block covers more than one pixel then there is no easy
-    * way to calculate offset1 relative to offset0. Instead, compute them
-    * independently. Otherwise, try to compute offset0 and offset1 with
-    * a single stride multiplication.
+    * If the pixel block covers more than one pixel, or the texture is
+    * tiled, then there is no easy way to calculate offset1 relative to
+    * offset0. Instead, compute them independently. Otherwise, try to
+    * compute offset0 and offset1 with a single stride multiplication.
     */
 
    length_minus_one = lp_build_sub(int_coord_bld, length, int_coord_bld->one);
 
-   if (block_length != 1) {
+   if (block_length != 1 ||
+       (bld->static_texture_state->tiled && axis < 2)) {
       LLVMValueRef coord1;
       switch(wrap_mode) {
       case PIPE_TEX_WRAP_REPEAT:
@@ -289,9 +322,9 @@ lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
          coord1 = int_coord_bld->zero;
          break;
       }
-      lp_build_sample_partial_offset(int_coord_bld, block_length, coord0, stride,
+      lp_build_sample_wrapped_offset(bld, block_length, axis, coord0, stride,
                                      offset0, i0);
-      lp_build_sample_partial_offset(int_coord_bld, block_length, coord1, stride,
+      lp_build_sample_wrapped_offset(bld, block_length, axis, coord1, stride,
                                      offset1, i1);
       return;
    }
@@ -507,6 +540,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
    /* Do texcoord wrapping, compute texel offset */
    lp_build_sample_wrap_nearest_int(bld,
                                     bld->format_desc->block.width,
+                                    0,
                                     s_ipart, s_float,
                                     width_vec, x_stride, offsets[0],
                                     bld->static_texture_state->pot_width,
@@ -517,6 +551,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
       LLVMValueRef y_offset;
       lp_build_sample_wrap_nearest_int(bld,
                                        bld->format_desc->block.height,
+                                       1,
                                        t_ipart, t_float,
                                        height_vec, row_stride_vec, offsets[1],
                                        bld->static_texture_state->pot_height,
@@ -527,6 +562,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
          LLVMValueRef z_offset;
          lp_build_sample_wrap_nearest_int(bld,
                                           1, /* block length (depth) */
+                                          2,
                                           r_ipart, r_float,
                                           depth_vec, img_stride_vec, offsets[2],
                                           bld->static_texture_state->pot_depth,
@@ -873,6 +909,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    /* do texcoord wrapping and compute texel offsets */
    lp_build_sample_wrap_linear_int(bld,
                                    bld->format_desc->block.width,
+                                   0,
                                    s_ipart, &s_fpart, s_float,
                                    width_vec, x_stride, offsets[0],
                                    bld->static_texture_state->pot_width,
@@ -903,6 +940,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    if (dims >= 2) {
       lp_build_sample_wrap_linear_int(bld,
                                       bld->format_desc->block.height,
+                                      1,
                                       t_ipart, &t_fpart, t_float,
                                       height_vec, y_stride, offsets[1],
                                       bld->static_texture_state->pot_height,
@@ -923,6 +961,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    if (dims >= 3) {
       lp_build_sample_wrap_linear_int(bld,
                                       1, /* block length (depth) */
+                                      2,
                                       r_ipart, &r_fpart, r_float,
                                       depth_vec, z_stride, offsets[2],
                                       bld->static_texture_state->pot_depth,
@@ -53,6 +53,15 @@ extern "C" {
  */
 extern unsigned lp_native_vector_width;
 
+/**
+ * SIMD width used for compute shaders.
+ *
+ * Normally the same as lp_native_vector_width, but may be raised to 512
+ * bits on AVX-512 capable CPUs, since compute shaders aren't tied to the
+ * 4x4 pixel block layout of fragment shading.
+ */
+extern unsigned lp_compute_vector_width;
+
 /**
  * Maximum supported vector width (not necessarily supported at run-time).
  *
@@ -30,8 +30,29 @@
 
 #include "util/u_thread.h"
 #include "util/u_memory.h"
+#include "util/os_time.h"
 #include "lp_cs_tpool.h"
 
+/* Aim for each batch of iterations to take roughly this long, which keeps
+ * the pool mutex out of the profile for tiny workgroups while leaving
+ * enough batches for load balancing.
+ */
+#define LP_CS_TPOOL_BATCH_NS 50000
+
+/*
+ * Pick the batch size for the following trips to the queue from the time
+ * the last batch took.
+ */
+static void
+lp_cs_tpool_update_batch(struct lp_cs_tpool_task *task,
+                         unsigned num_iters, int64_t elapsed_ns)
+{
+   int64_t per_iter = MAX2(elapsed_ns / num_iters, 1);
+   int64_t batch = LP_CS_TPOOL_BATCH_NS / per_iter;
+
+   task->iter_per_batch = CLAMP(batch, 1, task->iter_batch_max);
+}
+
 static int
 lp_cs_tpool_worker(void *data)
 {
@@ -52,15 +73,22 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
-      unsigned this_iter = task->iter_start++;
+      unsigned this_iter = task->iter_start;
+      unsigned num_iters = MIN2(task->iter_per_batch,
+                                task->iter_total - this_iter);
+      task->iter_start += num_iters;
 
       if (task->iter_start == task->iter_total)
          list_del(&task->list);
 
       mtx_unlock(&pool->m);
-      task->work(task->data, this_iter, &lmem);
+      int64_t start_time = os_time_get_nano();
+      for (unsigned i = 0; i < num_iters; i++)
+         task->work(task->data, this_iter + i, &lmem);
+      int64_t elapsed = os_time_get_nano() - start_time;
       mtx_lock(&pool->m);
-      task->iter_finished++;
+      lp_cs_tpool_update_batch(task, num_iters, elapsed);
+      task->iter_finished += num_iters;
       if (task->iter_finished == task->iter_total)
          cnd_broadcast(&task->finish);
    }
@@ -81,7 +109,15 @@ lp_cs_tpool_create(unsigned num_threads)
    cnd_init(&pool->new_work);
 
    list_inithead(&pool->workqueue);
-   assert (num_threads <= LP_MAX_THREADS);
+   if (num_threads) {
+      pool->threads = CALLOC(num_threads, sizeof(thrd_t));
+      if (!pool->threads) {
+         cnd_destroy(&pool->new_work);
+         mtx_destroy(&pool->m);
+         FREE(pool);
+         return NULL;
+      }
+   }
    pool->num_threads = num_threads;
    for (unsigned i = 0; i < num_threads; i++)
       pool->threads[i] = u_thread_create(lp_cs_tpool_worker, pool);
@@ -105,6 +141,7 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->threads);
    FREE(pool);
 }
 
@@ -131,6 +168,11 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->work = work;
    task->data = data;
    task->iter_total = num_iters;
+   /* Start with single iterations until we know what one costs, and never
+    * batch so much that some threads are left without work.
+    */
+   task->iter_per_batch = 1;
+   task->iter_batch_max = MAX2(num_iters / (pool->num_threads * 4), 1);
    cnd_init(&task->finish);
 
    mtx_lock(&pool->m);
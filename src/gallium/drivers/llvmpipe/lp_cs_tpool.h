@@ -30,6 +30,8 @@
  * structs with just unique indexes in them.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
+ * Cheap iterations are handed out in batches so that workers don't
+ * contend on the pool mutex for every iteration.
  */
 #ifndef LP_CS_QUEUE
 #define LP_CS_QUEUE
@@ -45,7 +47,7 @@ struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
    unsigned num_threads;
    struct list_head workqueue;
    bool shutdown;
@@ -66,6 +68,10 @@ struct lp_cs_tpool_task {
    unsigned iter_total;
    unsigned iter_start;
    unsigned iter_finished;
+   /* iterations a worker takes per trip to the queue, adapted to the
+    * measured cost of an iteration */
+   unsigned iter_per_batch;
+   unsigned iter_batch_max;
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
@@ -39,6 +39,9 @@
 #include "lp_context.h"
 #include "lp_state.h"
 #include "lp_query.h"
+#include "lp_flush.h"
+#include "lp_setup.h"
+#include "lp_texture.h"
 
 #include "draw/draw_context.h"
 
@@ -63,19 +66,40 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
    struct llvmpipe_context *lp = llvmpipe_context(pipe);
    struct draw_context *draw = lp->draw;
    const void *mapped_indices = NULL;
+   struct u_indirect_params *indirect_draws = NULL;
+   unsigned num_indirect_draws = 0;
    unsigned i;
 
    if (!llvmpipe_check_render_cond(lp))
       return;
 
    if (indirect && indirect->buffer) {
-      util_draw_indirect(pipe, info, indirect);
-      return;
+      /* Read all the sub-draws up front so that state validation, buffer
+       * mapping and sampler setup happen once for the whole multi-draw
+       * rather than once per sub-draw.
+       */
+      indirect_draws = util_draw_indirect_read(pipe, info, indirect,
+                                               &num_indirect_draws);
+      if (!indirect_draws || !num_indirect_draws) {
+         free(indirect_draws);
+         return;
+      }
    }
 
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   /* Vertex processing doesn't go through the scenes */
+   llvmpipe_flush_shader_resources(lp, PIPE_SHADER_VERTEX, "draw vs");
+   if (info->index_size && !info->has_user_indices)
+      llvmpipe_wait_resource(pipe->screen, info->index.resource, TRUE, FALSE);
+   if (lp->gs)
+      llvmpipe_flush_shader_resources(lp, PIPE_SHADER_GEOMETRY, "draw gs");
+   if (lp->tcs)
+      llvmpipe_flush_shader_resources(lp, PIPE_SHADER_TESS_CTRL, "draw tcs");
+   if (lp->tes)
+      llvmpipe_flush_shader_resources(lp, PIPE_SHADER_TESS_EVAL, "draw tes");
+
    /*
     * Map vertex buffers
     */
@@ -146,7 +170,18 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
                                      !lp->queries_disabled);
 
    /* draw! */
-   draw_vbo(draw, info, drawid_offset, indirect, draws, num_draws);
+   if (indirect_draws) {
+      for (i = 0; i < num_indirect_draws; i++) {
+         if (!indirect_draws[i].draw.count ||
+             !indirect_draws[i].info.instance_count)
+            continue;
+         draw_vbo(draw, &indirect_draws[i].info, drawid_offset + i, NULL,
+                  &indirect_draws[i].draw, 1);
+      }
+      free(indirect_draws);
+   } else {
+      draw_vbo(draw, info, drawid_offset, indirect, draws, num_draws);
+   }
 
    /*
     * unmap vertex/index buffers
@@ -37,7 +37,12 @@
 #include "draw/draw_context.h"
 #include "lp_flush.h"
 #include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_fence.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
+#include "lp_state_cs.h"
+#include "lp_texture.h"
 
 
 /**
@@ -129,5 +134,159 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
       }
    }
 
+   /* Scenes flushed by other contexts sharing the resource */
+   if (cpu_access)
+      return llvmpipe_wait_resource(pipe->screen, resource, read_only,
+                                    do_not_block);
+
    return TRUE;
 }
+
+
+/**
+ * Wait for the flushed scenes of any context which may still access the
+ * resource in a way which conflicts with a CPU read (read_only) or write.
+ *
+ * Returns FALSE if it would have blocked, but do_not_block was set, TRUE
+ * otherwise.
+ */
+boolean
+llvmpipe_wait_resource(struct pipe_screen *screen,
+                       struct pipe_resource *resource,
+                       boolean read_only,
+                       boolean do_not_block)
+{
+   struct llvmpipe_screen *lp_screen = llvmpipe_screen(screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct lp_fence *fence = NULL;
+   boolean ret = TRUE;
+
+   mtx_lock(&lp_screen->rast_mutex);
+   lp_fence_reference(&fence, read_only ? lpr->write_fence : lpr->read_fence);
+   mtx_unlock(&lp_screen->rast_mutex);
+
+   if (fence && !lp_fence_signalled(fence)) {
+      if (do_not_block)
+         ret = FALSE;
+      else
+         lp_fence_wait(fence);
+   }
+
+   lp_fence_reference(&fence, NULL);
+   return ret;
+}
+
+
+/* Called with the screen's rast_mutex held. */
+static inline boolean
+resource_conflicts(struct pipe_resource *resource, boolean write)
+{
+   const struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct lp_fence *fence = write ? lpr->read_fence : lpr->write_fence;
+
+   return fence && !lp_fence_signalled(fence);
+}
+
+
+/**
+ * Wait for flushed scenes which are still being rasterized if they
+ * conflict with the resources bound to the given shader stage.
+ *
+ * Binning of a new scene overlaps with rasterization of the previous
+ * ones, but vertex processing and compute run on the calling thread and
+ * access their resources directly, so they still have to synchronize
+ * against the rasterizer whenever there is a read/write hazard.  The
+ * scenes of other contexts sharing the resources count as well.
+ */
+void
+llvmpipe_flush_shader_resources(struct llvmpipe_context *llvmpipe,
+                                enum pipe_shader_type shader,
+                                const char *reason)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(llvmpipe->pipe.screen);
+   struct lp_fence *fence = NULL;
+   boolean conflict = FALSE;
+   unsigned i;
+
+   mtx_lock(&screen->rast_mutex);
+
+   if (!screen->last_fence || lp_fence_signalled(screen->last_fence)) {
+      mtx_unlock(&screen->rast_mutex);
+      return;
+   }
+
+   if (shader == PIPE_SHADER_COMPUTE) {
+      struct lp_cs_context *csctx = llvmpipe->csctx;
+
+      for (i = 0; i < ARRAY_SIZE(csctx->cs.current_tex) && !conflict; i++) {
+         if (csctx->cs.current_tex[i] &&
+             resource_conflicts(csctx->cs.current_tex[i], FALSE))
+            conflict = TRUE;
+      }
+      for (i = 0; i < ARRAY_SIZE(csctx->constants) && !conflict; i++) {
+         if (csctx->constants[i].current.buffer &&
+             resource_conflicts(csctx->constants[i].current.buffer, FALSE))
+            conflict = TRUE;
+      }
+      /* shader buffers and images may be written, so any use conflicts */
+      for (i = 0; i < ARRAY_SIZE(csctx->ssbos) && !conflict; i++) {
+         if (csctx->ssbos[i].current.buffer &&
+             resource_conflicts(csctx->ssbos[i].current.buffer, TRUE))
+            conflict = TRUE;
+      }
+      for (i = 0; i < ARRAY_SIZE(csctx->images) && !conflict; i++) {
+         if (csctx->images[i].current.resource &&
+             resource_conflicts(csctx->images[i].current.resource, TRUE))
+            conflict = TRUE;
+      }
+   } else {
+      if (shader == PIPE_SHADER_VERTEX) {
+         for (i = 0; i < llvmpipe->num_vertex_buffers && !conflict; i++) {
+            const struct pipe_vertex_buffer *vb = &llvmpipe->vertex_buffer[i];
+            if (!vb->is_user_buffer && vb->buffer.resource &&
+                resource_conflicts(vb->buffer.resource, FALSE))
+               conflict = TRUE;
+         }
+         /* stream output is written by the draw module */
+         for (i = 0; i < llvmpipe->num_so_targets && !conflict; i++) {
+            if (llvmpipe->so_targets[i] &&
+                resource_conflicts(llvmpipe->so_targets[i]->target.buffer,
+                                   TRUE))
+               conflict = TRUE;
+         }
+      }
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[shader]) && !conflict;
+           i++) {
+         if (llvmpipe->constants[shader][i].buffer &&
+             resource_conflicts(llvmpipe->constants[shader][i].buffer, FALSE))
+            conflict = TRUE;
+      }
+      for (i = 0; i < llvmpipe->num_sampler_views[shader] && !conflict; i++) {
+         struct pipe_sampler_view *view = llvmpipe->sampler_views[shader][i];
+         if (view && resource_conflicts(view->texture, FALSE))
+            conflict = TRUE;
+      }
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->ssbos[shader]) && !conflict; i++) {
+         if (llvmpipe->ssbos[shader][i].buffer &&
+             resource_conflicts(llvmpipe->ssbos[shader][i].buffer, TRUE))
+            conflict = TRUE;
+      }
+      for (i = 0; i < llvmpipe->num_images[shader] && !conflict; i++) {
+         if (llvmpipe->images[shader][i].resource &&
+             resource_conflicts(llvmpipe->images[shader][i].resource, TRUE))
+            conflict = TRUE;
+      }
+   }
+
+   /* Scenes complete in queue order, so the last one covers them all */
+   if (conflict)
+      lp_fence_reference(&fence, screen->last_fence);
+
+   mtx_unlock(&screen->rast_mutex);
+
+   if (fence) {
+      LP_DBG(DEBUG_SETUP, "%s: %s\n", __FUNCTION__, reason);
+      lp_fence_wait(fence);
+      lp_fence_reference(&fence, NULL);
+   }
+}
@@ -29,10 +29,13 @@
 #define LP_FLUSH_H
 
 #include "pipe/p_compiler.h"
+#include "pipe/p_defines.h"
 
 struct pipe_context;
+struct llvmpipe_context;
 struct pipe_fence_handle;
 struct pipe_resource;
+struct pipe_screen;
 
 void
 llvmpipe_flush(struct pipe_context *pipe,
@@ -52,4 +55,15 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
                         boolean do_not_block,
                         const char *reason);
 
+boolean
+llvmpipe_wait_resource(struct pipe_screen *screen,
+                       struct pipe_resource *resource,
+                       boolean read_only,
+                       boolean do_not_block);
+
+void
+llvmpipe_flush_shader_resources(struct llvmpipe_context *llvmpipe,
+                                enum pipe_shader_type shader,
+                                const char *reason);
+
 #endif
@@ -66,8 +66,6 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 16
-
 
 /**
  * Max bytes per scene.  This may be replaced by a runtime parameter.
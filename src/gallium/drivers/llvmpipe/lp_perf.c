@@ -98,10 +98,19 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_empty_4x4:               %9u (%3.0f%% of %u)\n", lp_count.nr_empty_4, p1, total_4);
       debug_printf("llvmpipe:   nr_non_empty_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_non_empty_4, p4, total_4);
 
+      debug_printf("llvmpipe: nr_hiz_culled_64x64:          %9u\n", lp_count.nr_hiz_culled_64);
+      debug_printf("llvmpipe: nr_hiz_culled_16x16:          %9u\n", lp_count.nr_hiz_culled_16);
+
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
+      debug_printf("llvmpipe: nr_bins_stolen:               %9u\n", lp_count.nr_bins_stolen);
+      debug_printf("llvmpipe: nr_data_blocks_allocated:     %9u\n", lp_count.nr_data_blocks_allocated);
+      debug_printf("llvmpipe: nr_data_blocks_recycled:      %9u\n", lp_count.nr_data_blocks_recycled);
+      debug_printf("llvmpipe: scene memory high water:      %9u KB\n", lp_count.scene_mem_high_water / 1024);
+      debug_printf("llvmpipe: rast thread idle time:        %.2f sec\n", lp_count.rast_idle_time / 1000000.0);
+
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
@@ -56,12 +56,20 @@ struct lp_counters
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_hiz_culled_64;    /**< tiles of triangles rejected by hi-z */
+   unsigned nr_hiz_culled_16;    /**< 16x16 blocks rejected by hi-z */
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_bins_stolen;
+   unsigned nr_data_blocks_allocated;
+   unsigned nr_data_blocks_recycled;
+   unsigned scene_mem_high_water;  /**< largest scene, in bytes */
+   int64_t rast_idle_time;  /**< total over all rast threads, in microseconds */
 };
 
 
@@ -53,13 +53,18 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
    assert(type < PIPE_QUERY_TYPES);
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* the per-thread counters are allocated along with the query */
+   pq = CALLOC(1, sizeof(*pq) + 2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
       pq->type = type;
       pq->index = index;
    }
@@ -225,8 +230,9 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
    else {
       unsigned i;
 
-      if (unflushed) {
-         llvmpipe_flush(pipe, NULL, __FUNCTION__);
+      if (unsignalled) {
+         if (unflushed)
+            llvmpipe_flush(pipe, NULL, __FUNCTION__);
 
          if (!wait)
             return;
@@ -320,6 +326,10 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
       }
    }
 
+   /* flushed scenes may still be accessing the destination */
+   llvmpipe_flush_resource(pipe, resource, 0, FALSE, TRUE, FALSE,
+                           __FUNCTION__);
+
    void *dst = (uint8_t *)lpr->data + offset;
 
    for (unsigned i = 0; i < num_values; i++) {
@@ -364,19 +374,22 @@ static bool
 llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
-   /* Check if the query is already in the scene.  If so, we need to
-    * flush the scene now.  Real apps shouldn't re-use a query in a
-    * frame of rendering.
+   /* Check if the query is already in a scene, either the one being
+    * binned or one still being rasterized.  If so, we need to flush and
+    * wait for it now.  Real apps shouldn't re-use a query in a frame of
+    * rendering.
     */
-   if (pq->fence && !lp_fence_issued(pq->fence)) {
+   if (pq->fence && !lp_fence_signalled(pq->fence)) {
       llvmpipe_finish(pipe, __FUNCTION__);
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, num_threads * sizeof(*pq->start));
+   memset(pq->end, 0, num_threads * sizeof(*pq->end));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -26,6 +26,8 @@
  **************************************************************************/
 
 #include <limits.h>
+#include "util/u_cpu_detect.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
@@ -49,6 +51,10 @@
 #include "lp_scene.h"
 #include "lp_tex_sample.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#endif
+
 
 #ifdef DEBUG
 int jit_line = 0;
@@ -78,11 +84,14 @@ lp_rast_begin( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * End rasterizing a scene.
+ * The scene itself is retired later by the setup module, once the scene
+ * fence has been signalled.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
-
    rast->curr_scene = NULL;
 }
 
@@ -113,17 +122,140 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    task->thread_data.vis_counter = 0;
    task->thread_data.ps_invocations = 0;
 
+   task->ms_tiles = FALSE;
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
       if (task->scene->fb.cbufs[i]) {
          task->color_tiles[i] = scene->cbufs[i].map +
                                 scene->cbufs[i].stride * task->y +
                                 scene->cbufs[i].format_bytes * task->x;
+         if (llvmpipe_resource(task->scene->fb.cbufs[i]->texture)->ms_tile_equal)
+            task->ms_tiles = TRUE;
       }
    }
    if (task->scene->fb.zsbuf) {
+      const struct util_format_description *zs_desc =
+         util_format_description(task->scene->fb.zsbuf->format);
+
       task->depth_tile = scene->zsbuf.map +
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
+      task->hiz_zs_float = util_format_has_depth(zs_desc) &&
+         zs_desc->channel[zs_desc->swizzle[0]].type == UTIL_FORMAT_TYPE_FLOAT;
+   }
+
+   /* nothing is known about depth contents left by earlier scenes */
+   task->hiz_zmin = -INFINITY;
+   task->hiz_zmax = INFINITY;
+   task->hiz_test_blocks = FALSE;
+}
+
+
+/**
+ * A depth clear sets the depth bounds of the tile to the clear value.
+ */
+static void
+lp_rast_hiz_clear(struct lp_rasterizer_task *task,
+                  uint64_t clear_value, uint64_t clear_mask)
+{
+   const enum pipe_format format = task->scene->fb.zsbuf->format;
+   const uint64_t zmask = util_pack64_mask_z(format, ~0);
+   union {
+      uint16_t u16;
+      uint32_t u32;
+      uint64_t u64;
+   } packed;
+   float z;
+
+   if (!util_format_has_depth(util_format_description(format)) ||
+       (clear_mask & zmask) != zmask)
+      return;
+
+   switch (util_format_get_blocksize(format)) {
+   case 2:
+      packed.u16 = (uint16_t)clear_value;
+      break;
+   case 4:
+      packed.u32 = (uint32_t)clear_value;
+      break;
+   case 8:
+      packed.u64 = clear_value;
+      break;
+   default:
+      return;
+   }
+
+   util_format_unpack_z_float(format, &z, &packed, 1);
+   task->hiz_zmin = z;
+   task->hiz_zmax = z;
+}
+
+
+/**
+ * Does the current tile cover the whole corresponding tile of the resource?
+ * The framebuffer can be smaller than its attachments.
+ */
+static inline boolean
+lp_rast_ms_tile_covered(const struct lp_rasterizer_task *task,
+                        const struct llvmpipe_resource *lpr)
+{
+   return task->width == MIN2(TILE_SIZE, lpr->base.width0 - task->x) &&
+          task->height == MIN2(TILE_SIZE, lpr->base.height0 - task->y);
+}
+
+
+/**
+ * Keep track of which tiles of multisample color buffers have all samples
+ * equal, after a command ran the fragment shader on the current tile.
+ */
+static void
+lp_rast_ms_tile_update(struct lp_rasterizer_task *task,
+                       unsigned cmd,
+                       const struct lp_rast_shader_inputs *inputs)
+{
+   const struct lp_scene *scene = task->scene;
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   const unsigned layer = inputs->layer + inputs->view_index;
+   enum lp_ms_tile op;
+   unsigned i;
+
+   if (inputs->disable)
+      return;
+
+   if (cmd == LP_RAST_OP_SHADE_TILE || cmd == LP_RAST_OP_SHADE_TILE_OPAQUE)
+      op = variant->ms_tile_whole;
+   else
+      op = variant->ms_tile_partial;
+
+   /* the sample mask state can leave out samples */
+   if (variant->key.multisample) {
+      const uint32_t full_mask = (1u << variant->key.coverage_samples) - 1;
+      if ((task->state->jit_context.sample_mask & full_mask) != full_mask)
+         op = LP_MS_TILE_BREAK;
+   }
+
+   if (op == LP_MS_TILE_KEEP)
+      return;
+
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      struct pipe_surface *cbuf = scene->fb.cbufs[i];
+      struct llvmpipe_resource *lpr;
+      uint8_t *equal;
+
+      if (!cbuf)
+         continue;
+
+      lpr = llvmpipe_resource(cbuf->texture);
+      if (!lpr->ms_tile_equal)
+         continue;
+
+      assert(cbuf->u.tex.first_layer + layer < lpr->base.array_size);
+      equal = llvmpipe_resource_ms_tile(lpr, cbuf->u.tex.first_layer + layer,
+                                        task->x / TILE_SIZE,
+                                        task->y / TILE_SIZE);
+      if (op == LP_MS_TILE_BREAK)
+         *equal = 0;
+      else if (lp_rast_ms_tile_covered(task, lpr))
+         *equal = 1;
    }
 }
 
@@ -171,6 +303,20 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
                     &uc);
    }
 
+   if (task->ms_tiles) {
+      struct pipe_surface *surf = scene->fb.cbufs[cbuf];
+      struct llvmpipe_resource *lpr = llvmpipe_resource(surf->texture);
+
+      if (lpr->ms_tile_equal && lp_rast_ms_tile_covered(task, lpr)) {
+         unsigned layer;
+
+         for (layer = 0; layer <= scene->fb_max_layer; layer++)
+            *llvmpipe_resource_ms_tile(lpr, surf->u.tex.first_layer + layer,
+                                       task->x / TILE_SIZE,
+                                       task->y / TILE_SIZE) = 1;
+      }
+   }
+
    /* this will increase for each rb which probably doesn't mean much */
    LP_COUNT(nr_color_tile_clear);
 }
@@ -290,6 +436,8 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
             dst_layer += scene->zsbuf.layer_stride;
          }
       }
+
+      lp_rast_hiz_clear(task, clear_value64, clear_mask64);
    }
 }
 
@@ -409,6 +557,128 @@ lp_rast_shade_tile_opaque(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * dst = src + dst * (1 - src.a) for a row of 8-bit unorm pixels, rounding
+ * exactly like the generated blend code does.
+ */
+static void
+lp_rast_blit_over_row(uint8_t *dst, const uint8_t *src, int src_pixel_step,
+                      unsigned width)
+{
+   unsigned i = 0;
+
+#if defined(PIPE_ARCH_SSE)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i ones = _mm_set1_epi16(0xff);
+      const __m128i half = _mm_set1_epi16(0x80);
+
+      for (; i + 4 <= width; i += 4) {
+         __m128i s, a, d_lo, d_hi, a_lo, a_hi;
+
+         if (src_pixel_step > 0) {
+            s = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+         } else {
+            s = _mm_loadu_si128((const __m128i *)(src - 4 * (i + 3)));
+            s = _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 1, 2, 3));
+         }
+
+         /* broadcast alpha (byte 3) to all bytes of each pixel */
+         a = _mm_srli_epi32(s, 24);
+         a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+         a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+
+         d_lo = _mm_loadu_si128((const __m128i *)(dst + 4 * i));
+         d_hi = _mm_unpackhi_epi8(d_lo, zero);
+         d_lo = _mm_unpacklo_epi8(d_lo, zero);
+         a_lo = _mm_sub_epi16(ones, _mm_unpacklo_epi8(a, zero));
+         a_hi = _mm_sub_epi16(ones, _mm_unpackhi_epi8(a, zero));
+
+         /* (ab + (ab >> 8) + 0x80) >> 8, which fits in 16 bits */
+         d_lo = _mm_mullo_epi16(d_lo, a_lo);
+         d_hi = _mm_mullo_epi16(d_hi, a_hi);
+         d_lo = _mm_add_epi16(d_lo, _mm_add_epi16(_mm_srli_epi16(d_lo, 8), half));
+         d_hi = _mm_add_epi16(d_hi, _mm_add_epi16(_mm_srli_epi16(d_hi, 8), half));
+         d_lo = _mm_srli_epi16(d_lo, 8);
+         d_hi = _mm_srli_epi16(d_hi, 8);
+
+         _mm_storeu_si128((__m128i *)(dst + 4 * i),
+                          _mm_adds_epu8(s, _mm_packus_epi16(d_lo, d_hi)));
+      }
+   }
+#endif
+
+   for (; i < width; i++) {
+      const uint8_t *s = src + src_pixel_step * (int)i;
+      uint8_t *d = dst + 4 * i;
+      unsigned inv_a = 255 - s[3];
+      unsigned c;
+
+      for (c = 0; c < 4; c++) {
+         unsigned ab = d[c] * inv_a;
+         d[c] = MIN2(s[c] + ((ab + (ab >> 8) + 0x80) >> 8), 255);
+      }
+   }
+}
+
+
+/**
+ * Copy or blend a texture rectangle into the color buffer, for the part
+ * which overlaps this tile.
+ * This is a bin command called during bin processing.
+ */
+static void
+lp_rast_blit(struct lp_rasterizer_task *task,
+             const union lp_rast_cmd_arg arg)
+{
+   const struct lp_scene *scene = task->scene;
+   const struct lp_rast_blit *blit = arg.blit;
+   const unsigned dst_stride = scene->cbufs[0].stride;
+   const int x0 = MAX2(blit->x0, task->x);
+   const int y0 = MAX2(blit->y0, task->y);
+   const int x1 = MIN2(blit->x1, task->x + (int)task->width);
+   const int y1 = MIN2(blit->y1, task->y + (int)task->height);
+   int x, y;
+
+   if (blit->disable) {
+      /* This command was partially binned and has been disabled */
+      return;
+   }
+
+   LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
+
+   for (y = y0; y < y1; y++) {
+      uint8_t *dst = scene->cbufs[0].map + y * dst_stride + 4 * x0;
+      const uint8_t *src = blit->src +
+                           (y - blit->y0) * blit->src_row_step +
+                           (x0 - blit->x0) * blit->src_pixel_step;
+
+      switch (blit->op) {
+      case LP_FS_BLIT_COPY:
+         if (blit->src_pixel_step == 4) {
+            memcpy(dst, src, 4 * (x1 - x0));
+            break;
+         }
+         for (x = 0; x < x1 - x0; x++)
+            memcpy(dst + 4 * x, src + blit->src_pixel_step * x, 4);
+         break;
+      case LP_FS_BLIT_COPY_RGB1:
+         for (x = 0; x < x1 - x0; x++) {
+            memcpy(dst + 4 * x, src + blit->src_pixel_step * x, 3);
+            dst[4 * x + 3] = 0xff;
+         }
+         break;
+      case LP_FS_BLIT_OVER:
+         lp_rast_blit_over_row(dst, src, blit->src_pixel_step, x1 - x0);
+         break;
+      default:
+         assert(0);
+         break;
+      }
+   }
+}
+
+
 /**
  * Compute shading for a 4x4 block of pixels inside a triangle.
  * This is a bin command called during bin processing.
@@ -597,6 +867,20 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
    task->bin = NULL;
 }
 
+/**
+ * The shader inputs of a command which runs the fragment shader, or NULL.
+ */
+static inline const struct lp_rast_shader_inputs *
+lp_rast_cmd_shader_inputs(unsigned cmd, union lp_rast_cmd_arg arg)
+{
+   if (cmd == LP_RAST_OP_SHADE_TILE || cmd == LP_RAST_OP_SHADE_TILE_OPAQUE)
+      return arg.shade_tile;
+   if ((cmd >= LP_RAST_OP_TRIANGLE_1 && cmd <= LP_RAST_OP_TRIANGLE_4_16) ||
+       (cmd >= LP_RAST_OP_TRIANGLE_32_1 && cmd <= LP_RAST_OP_MS_TRIANGLE_4_16))
+      return &arg.triangle.tri->inputs;
+   return NULL;
+}
+
 static lp_rast_cmd_func dispatch[LP_RAST_OP_MAX] =
 {
    lp_rast_clear_color,
@@ -639,6 +923,7 @@ static lp_rast_cmd_func dispatch[LP_RAST_OP_MAX] =
    lp_rast_triangle_ms_3_4,
    lp_rast_triangle_ms_3_16,
    lp_rast_triangle_ms_4_16,
+   lp_rast_blit,
 };
 
 
@@ -655,7 +940,27 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
 
    for (block = bin->head; block; block = block->next) {
       for (k = 0; k < block->count; k++) {
+         const struct lp_rast_shader_inputs *inputs =
+            lp_rast_cmd_shader_inputs(block->cmd[k], block->arg[k]);
+
+         if (inputs && task->depth_tile && task->state) {
+            if (lp_rast_hiz_reject(task, inputs, task->x, task->y, TILE_SIZE)) {
+               LP_COUNT(nr_hiz_culled_64);
+               continue;
+            }
+            task->hiz_test_blocks =
+               task->state->variant->hiz_test != LP_HIZ_TEST_NONE;
+         }
+
          dispatch[block->cmd[k]]( task, block->arg[k] );
+
+         if (inputs && task->depth_tile && task->state) {
+            task->hiz_test_blocks = FALSE;
+            lp_rast_hiz_update(task, inputs);
+         }
+
+         if (inputs && task->ms_tiles && task->state)
+            lp_rast_ms_tile_update(task, block->cmd[k], inputs);
       }
    }
 }
@@ -733,7 +1038,8 @@ rasterize_scene(struct lp_rasterizer_task *task,
          int i, j;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j))) {
             if (!is_empty_bin( bin ))
                rasterize_bin(task, bin, i, j);
          }
@@ -807,29 +1113,12 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
-{
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
-
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ * Completion of each scene is signalled through the scene's fence.
  */
 static int
 thread_function(void *init_data)
@@ -878,21 +1167,24 @@ thread_function(void *init_data)
 
       rasterize_scene(task,
                       rast->curr_scene);
-      
+
       /* wait for all threads to finish with this scene */
-      util_barrier_wait( &rast->barrier );
+      if (LP_DEBUG & DEBUG_COUNTERS) {
+         int64_t start = os_time_get_nano();
+         util_barrier_wait( &rast->barrier );
+         p_atomic_add(&lp_count.rast_idle_time,
+                      (os_time_get_nano() - start) / 1000);
+      }
+      else {
+         util_barrier_wait( &rast->barrier );
+      }
 
-      /* XXX: shouldn't be necessary:
-       */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -903,6 +1195,28 @@ thread_function(void *init_data)
 }
 
 
+/**
+ * Pin a rasterizer thread to the cpus sharing one L3 cache.
+ * Consecutive threads are packed onto the same L3 so that neighbouring
+ * thread indices share cache and memory locality; on multi-socket and
+ * chiplet systems an L3 domain never spans NUMA nodes.
+ */
+static void
+pin_rast_thread(struct lp_rasterizer *rast, unsigned thread_index)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+   unsigned L3_cache;
+
+   if (caps->num_L3_caches <= 1 || !caps->L3_affinity_mask)
+      return;
+
+   L3_cache = thread_index * caps->num_L3_caches / rast->num_threads;
+   util_set_thread_affinity(rast->threads[thread_index],
+                            caps->L3_affinity_mask[L3_cache],
+                            NULL, caps->num_cpu_mask_bits);
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -922,6 +1236,11 @@ create_rast_threads(struct lp_rasterizer *rast)
          break;
       }
    }
+
+   if (rast->pin_threads) {
+      for (i = 0; i < rast->num_threads; i++)
+         pin_rast_thread(rast, i);
+   }
 }
 
 
@@ -947,6 +1266,18 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof(*rast->tasks));
+   if (!rast->tasks) {
+      goto no_tasks;
+   }
+
+   if (num_threads) {
+      rast->threads = CALLOC(num_threads, sizeof(*rast->threads));
+      if (!rast->threads) {
+         goto no_thread_data_cache;
+      }
+   }
+
    for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
@@ -961,6 +1292,7 @@ lp_rast_create( unsigned num_threads )
    rast->num_threads = num_threads;
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
+   rast->pin_threads = debug_get_bool_option("LP_PIN_THREADS", FALSE);
 
    create_rast_threads(rast);
 
@@ -974,12 +1306,15 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
    }
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
+no_tasks:
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
@@ -1030,6 +1365,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
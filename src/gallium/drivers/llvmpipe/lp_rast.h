@@ -152,6 +152,25 @@ struct lp_rast_clear_rb {
 };
 
 
+/**
+ * A screen-aligned rectangle which gets its colors straight from a linear
+ * texture (see lp_setup_rect.c), bypassing the fragment shader.
+ * Objects of this type are put into the lp_setup_context::data buffer.
+ */
+struct lp_rast_blit {
+   unsigned op:2;            /**< enum lp_fs_blit */
+   unsigned disable:1;       /**< Partially binned, disable this command */
+
+   /* destination pixels, x1 and y1 exclusive */
+   int x0, y0, x1, y1;
+
+   /* texel for pixel (x0, y0), and how to get to its neighbours */
+   const uint8_t *src;
+   int src_pixel_step;
+   int src_row_step;
+};
+
+
 #define GET_A0(inputs) ((float (*)[4])((inputs)+1))
 #define GET_DADX(inputs) ((float (*)[4])((char *)((inputs) + 1) + (inputs)->stride))
 #define GET_DADY(inputs) ((float (*)[4])((char *)((inputs) + 1) + 2 * (inputs)->stride))
@@ -169,9 +188,6 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
-void
-lp_rast_finish( struct lp_rasterizer *rast );
-
 
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
@@ -188,6 +204,7 @@ union lp_rast_cmd_arg {
    const struct lp_rast_state *state;
    struct lp_fence *fence;
    struct llvmpipe_query *query_obj;
+   const struct lp_rast_blit *blit;
 };
 
 
@@ -262,6 +279,14 @@ lp_rast_arg_query( struct llvmpipe_query *pq )
    return arg;
 }
 
+static inline union lp_rast_cmd_arg
+lp_rast_arg_blit( const struct lp_rast_blit *blit )
+{
+   union lp_rast_cmd_arg arg;
+   arg.blit = blit;
+   return arg;
+}
+
 static inline union lp_rast_cmd_arg
 lp_rast_arg_null( void )
 {
@@ -317,7 +342,8 @@ lp_rast_arg_null( void )
 #define LP_RAST_OP_MS_TRIANGLE_3_4   0x25
 #define LP_RAST_OP_MS_TRIANGLE_3_16  0x26
 #define LP_RAST_OP_MS_TRIANGLE_4_16  0x27
-#define LP_RAST_OP_MAX               0x28
+#define LP_RAST_OP_BLIT              0x28
+#define LP_RAST_OP_MAX               0x29
 #define LP_RAST_OP_MASK              0xff
 
 void
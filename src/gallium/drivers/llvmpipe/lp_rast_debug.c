@@ -54,6 +54,18 @@ static const char *cmd_names[LP_RAST_OP_MAX] =
    "triangle_32_3_4",
    "triangle_32_3_16",
    "triangle_32_4_16",
+   "ms_triangle_1",
+   "ms_triangle_2",
+   "ms_triangle_3",
+   "ms_triangle_4",
+   "ms_triangle_5",
+   "ms_triangle_6",
+   "ms_triangle_7",
+   "ms_triangle_8",
+   "ms_triangle_3_4",
+   "ms_triangle_3_16",
+   "ms_triangle_4_16",
+   "blit",
 };
 
 static const char *cmd_name(unsigned cmd)
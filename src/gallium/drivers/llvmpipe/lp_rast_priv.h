@@ -29,6 +29,7 @@
 #define LP_RAST_PRIV_H
 
 #include "util/format/u_format.h"
+#include "util/u_math.h"
 #include "util/u_thread.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
@@ -100,6 +101,18 @@ struct lp_rasterizer_task
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   /**
+    * Conservative bounds of the depth values in the current tile, -INF and
+    * +INF when unknown.  Used to reject triangles which provably fail the
+    * depth test, see lp_rast_hiz_reject().
+    */
+   float hiz_zmin, hiz_zmax;
+   boolean hiz_zs_float;     /**< depth buffer has a float format */
+   boolean hiz_test_blocks;  /**< test 16x16 blocks of the current triangle */
+
+   /** some color buffer tracks tiles with equal samples, see lp_rast_ms_tile_update() */
+   boolean ms_tiles;
+
    pipe_semaphore work_ready;
    pipe_semaphore work_done;
 };
@@ -122,10 +135,13 @@ struct lp_rasterizer
    struct lp_scene *curr_scene;
 
    /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
+
+   /** Pin threads to the cpus sharing an L3 cache (LP_PIN_THREADS) */
+   boolean pin_threads;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -219,6 +235,105 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 
 
 
+/* Slack for depth buffer quantization and rounding differences with the
+ * interpolation done by the fragment shader.
+ */
+#define LP_HIZ_EPSILON (1.0f / 32768.0f)
+
+/**
+ * Conservative range of the depth values a triangle can produce within the
+ * size x size square at x, y (in window coords), as seen by the depth test.
+ */
+static inline void
+lp_rast_hiz_tri_bounds(const struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs,
+                       int x, int y, int size,
+                       float *zlow, float *zhigh)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   /* position is always in slot zero */
+   const float z0 = GET_A0(inputs)[0][2];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   /* the depth plane is linear, so its extrema are at the corners; pad by
+    * a pixel to cover pixel center and sample offsets
+    */
+   const float zx0 = dzdx * (float)(x - 1), zx1 = dzdx * (float)(x + size + 1);
+   const float zy0 = dzdy * (float)(y - 1), zy1 = dzdy * (float)(y + size + 1);
+   const float err = (fabsf(z0) + MAX2(fabsf(zx0), fabsf(zx1)) +
+                      MAX2(fabsf(zy0), fabsf(zy1))) * (1.0f / (1 << 20));
+   float lo = z0 + MIN2(zx0, zx1) + MIN2(zy0, zy1) - err;
+   float hi = z0 + MAX2(zx0, zx1) + MAX2(zy0, zy1) + err;
+
+   /* clamping is monotonic, so it can be applied to the bounds directly */
+   if (variant->key.depth_clamp) {
+      const struct lp_jit_viewport *vp =
+         &task->state->jit_context.viewports[inputs->viewport_index];
+      lo = CLAMP(lo, vp->min_depth, vp->max_depth);
+      hi = CLAMP(hi, vp->min_depth, vp->max_depth);
+   }
+   if (!task->hiz_zs_float) {
+      lo = CLAMP(lo, 0.0f, 1.0f);
+      hi = CLAMP(hi, 0.0f, 1.0f);
+   }
+
+   *zlow = lo - LP_HIZ_EPSILON;
+   *zhigh = hi + LP_HIZ_EPSILON;
+}
+
+
+/**
+ * Whether all fragments of a triangle within the size x size square at
+ * x, y are behind the current tile's depth bounds.
+ */
+static inline boolean
+lp_rast_hiz_reject(const struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   int x, int y, int size)
+{
+   float zlow, zhigh;
+
+   switch (task->state->variant->hiz_test) {
+   case LP_HIZ_TEST_LESS:
+      if (task->hiz_zmax == INFINITY)
+         return FALSE;
+      lp_rast_hiz_tri_bounds(task, inputs, x, y, size, &zlow, &zhigh);
+      return zlow > task->hiz_zmax;
+   case LP_HIZ_TEST_GREATER:
+      if (task->hiz_zmin == -INFINITY)
+         return FALSE;
+      lp_rast_hiz_tri_bounds(task, inputs, x, y, size, &zlow, &zhigh);
+      return zhigh < task->hiz_zmin;
+   default:
+      return FALSE;
+   }
+}
+
+
+/**
+ * Widen the tile's depth bounds after a triangle may have written depth.
+ */
+static inline void
+lp_rast_hiz_update(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   float zlow = -INFINITY, zhigh = INFINITY;
+
+   if (variant->hiz_update == LP_HIZ_UPDATE_NONE)
+      return;
+
+   if (!variant->shader->info.base.writes_z)
+      lp_rast_hiz_tri_bounds(task, inputs, task->x, task->y, TILE_SIZE,
+                             &zlow, &zhigh);
+
+   if (variant->hiz_update != LP_HIZ_UPDATE_RAISE)
+      task->hiz_zmin = MIN2(task->hiz_zmin, zlow);
+   if (variant->hiz_update != LP_HIZ_UPDATE_LOWER)
+      task->hiz_zmax = MAX2(task->hiz_zmax, zhigh);
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -322,6 +322,12 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       partial_mask &= ~(1 << i);
 
+      if (task->hiz_test_blocks &&
+          lp_rast_hiz_reject(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_culled_16);
+         continue;
+      }
+
       LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
@@ -337,6 +343,12 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
+      if (task->hiz_test_blocks &&
+          lp_rast_hiz_reject(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_culled_16);
+         continue;
+      }
+
       LP_COUNT(nr_fully_covered_16);
       block_full_16(task, tri, px, py);
    }
@@ -27,6 +27,7 @@
 
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
 #include "util/simple_list.h"
@@ -35,7 +36,10 @@
 #include "lp_fence.h"
 #include "lp_debug.h"
 #include "lp_context.h"
+#include "lp_perf.h"
+#include "lp_screen.h"
 #include "lp_state_fs.h"
+#include "lp_texture.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -43,6 +47,7 @@
 /** List of resource references */
 struct resource_ref {
    struct pipe_resource *resource[RESOURCE_REF_SZ];
+   boolean writeable[RESOURCE_REF_SZ];
    int count;
    struct resource_ref *next;
 };
@@ -63,22 +68,34 @@ struct shader_ref {
 struct lp_scene *
 lp_scene_create( struct pipe_context *pipe )
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_scene *scene = CALLOC_STRUCT(lp_scene);
+   unsigned i;
+
    if (!scene)
       return NULL;
 
    scene->pipe = pipe;
 
+   scene->num_bin_queues = MAX2(1, screen->num_threads);
+   scene->bin_queues = CALLOC(scene->num_bin_queues,
+                              sizeof(*scene->bin_queues));
+   if (!scene->bin_queues) {
+      FREE(scene);
+      return NULL;
+   }
+
+   for (i = 0; i < scene->num_bin_queues; i++)
+      (void) mtx_init(&scene->bin_queues[i].mutex, mtx_plain);
+
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   (void) mtx_init(&scene->mutex, mtx_plain);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
       size_t maxBins = TILES_X * TILES_Y;
-      size_t maxCommandBytes = sizeof(struct cmd_block) * maxBins;
+      size_t maxCommandBytes = lp_cmd_block_size(CMD_BLOCK_MIN) * maxBins;
       size_t maxCommandPlusData = maxCommandBytes + DATA_BLOCK_SIZE;
       /* We'll need at least one command block per bin.  Make sure that's
        * less than the max allowed scene size.
@@ -99,10 +116,19 @@ lp_scene_create( struct pipe_context *pipe )
 void
 lp_scene_destroy(struct lp_scene *scene)
 {
+   unsigned i;
+
    lp_fence_reference(&scene->fence, NULL);
-   mtx_destroy(&scene->mutex);
+   for (i = 0; i < scene->num_bin_queues; i++)
+      mtx_destroy(&scene->bin_queues[i].mutex);
+   FREE(scene->bin_queues);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
+   while (scene->free_blocks) {
+      struct data_block *block = scene->free_blocks;
+      scene->free_blocks = block->next;
+      FREE(block);
+   }
    FREE(scene);
 }
 
@@ -198,10 +224,19 @@ void
 lp_scene_begin_rasterization(struct lp_scene *scene)
 {
    const struct pipe_framebuffer_state *fb = &scene->fb;
+   const struct resource_ref *ref;
    int i;
 
    //LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
+   /* fragment shader image stores don't keep samples equal */
+   for (ref = scene->resources; ref; ref = ref->next) {
+      for (i = 0; i < ref->count; i++) {
+         if (ref->writeable[i])
+            llvmpipe_resource_ms_tiles_invalidate(ref->resource[i]);
+      }
+   }
+
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       struct pipe_surface *cbuf = scene->fb.cbufs[i];
       init_scene_texture(&scene->cbufs[i], cbuf);
@@ -304,17 +339,25 @@ lp_scene_end_rasterization(struct lp_scene *scene )
       }
    }
 
-   /* Free all scene data blocks:
+   /* Keep the data blocks used by this scene for its next use, and free
+    * those left over from the previous use which weren't needed this
+    * time, so the cached memory follows the current working set.
     */
    {
       struct data_block_list *list = &scene->data;
       struct data_block *block, *tmp;
 
-      for (block = list->head->next; block; block = tmp) {
+#ifdef DEBUG
+      lp_count.scene_mem_high_water = MAX2(lp_count.scene_mem_high_water,
+                                           scene->scene_size);
+#endif
+
+      for (block = scene->free_blocks; block; block = tmp) {
          tmp = block->next;
-	 FREE(block);
+         FREE(block);
       }
 
+      scene->free_blocks = list->head->next;
       list->head->next = NULL;
       list->head->used = 0;
    }
@@ -340,8 +383,12 @@ struct cmd_block *
 lp_scene_new_cmd_block( struct lp_scene *scene,
                         struct cmd_bin *bin )
 {
-   struct cmd_block *block = lp_scene_alloc(scene, sizeof(struct cmd_block));
+   unsigned max = bin->tail ? MIN2(bin->tail->max * 2, CMD_BLOCK_MAX) :
+                              CMD_BLOCK_MIN;
+   struct cmd_block *block = lp_scene_alloc(scene, lp_cmd_block_size(max));
    if (block) {
+      block->max = max;
+      block->cmd = (uint8_t *)&block->arg[max];
       if (bin->tail) {
          bin->tail->next = block;
          bin->tail = block;
@@ -367,10 +414,17 @@ lp_scene_new_data_block( struct lp_scene *scene )
       return NULL;
    }
    else {
-      struct data_block *block = MALLOC_STRUCT(data_block);
-      if (!block)
-         return NULL;
-      
+      struct data_block *block = scene->free_blocks;
+      if (block) {
+         scene->free_blocks = block->next;
+         LP_COUNT(nr_data_blocks_recycled);
+      } else {
+         block = MALLOC_STRUCT(data_block);
+         if (!block)
+            return NULL;
+         LP_COUNT(nr_data_blocks_allocated);
+      }
+
       scene->scene_size += sizeof *block;
 
       block->used = 0;
@@ -405,7 +459,8 @@ lp_scene_data_size( const struct lp_scene *scene )
 boolean
 lp_scene_add_resource_reference(struct lp_scene *scene,
                                 struct pipe_resource *resource,
-                                boolean initializing_scene)
+                                boolean initializing_scene,
+                                boolean writeable)
 {
    struct resource_ref *ref, **last = &scene->resources;
    int i;
@@ -417,9 +472,12 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
       /* Search for this resource:
        */
-      for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
+      for (i = 0; i < ref->count; i++) {
+         if (ref->resource[i] == resource) {
+            ref->writeable[i] |= writeable;
             return TRUE;
+         }
+      }
 
       if (ref->count < RESOURCE_REF_SZ) {
          /* If the block is half-empty, then append the reference here.
@@ -448,6 +506,7 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
    /* Append the reference to the reference block.
     */
+   ref->writeable[ref->count] = writeable;
    pipe_resource_reference(&ref->resource[ref->count++], resource);
    scene->resource_reference_size += llvmpipe_resource_size(resource);
 
@@ -464,6 +523,43 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 }
 
 
+/**
+ * Record the scene fence in all resources the scene references, so that
+ * any context can wait for the scene before accessing them on the CPU.
+ * Called with the screen's rast_mutex held, when queueing the scene.
+ */
+void
+lp_scene_fence_resources(struct lp_scene *scene)
+{
+   const struct resource_ref *ref;
+   int i;
+
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i]) {
+         struct llvmpipe_resource *lpr =
+            llvmpipe_resource(scene->fb.cbufs[i]->texture);
+         lp_fence_reference(&lpr->read_fence, scene->fence);
+         lp_fence_reference(&lpr->write_fence, scene->fence);
+      }
+   }
+   if (scene->fb.zsbuf) {
+      struct llvmpipe_resource *lpr =
+         llvmpipe_resource(scene->fb.zsbuf->texture);
+      lp_fence_reference(&lpr->read_fence, scene->fence);
+      lp_fence_reference(&lpr->write_fence, scene->fence);
+   }
+
+   for (ref = scene->resources; ref; ref = ref->next) {
+      for (i = 0; i < ref->count; i++) {
+         struct llvmpipe_resource *lpr = llvmpipe_resource(ref->resource[i]);
+         lp_fence_reference(&lpr->read_fence, scene->fence);
+         if (ref->writeable[i])
+            lp_fence_reference(&lpr->write_fence, scene->fence);
+      }
+   }
+}
+
+
 /**
  * Add a reference to a fragment shader variant
  */
@@ -513,81 +609,166 @@ lp_scene_add_frag_shader_reference(struct lp_scene *scene,
 
 /**
  * Does this scene have a reference to the given resource?
+ * Returns a mask of LP_REFERENCED_FOR_READ/WRITE.
  */
-boolean
+unsigned
 lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
    const struct resource_ref *ref;
    int i;
 
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == resource)
+      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
    for (ref = scene->resources; ref; ref = ref->next) {
-      for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
-            return TRUE;
+      for (i = 0; i < ref->count; i++) {
+         if (ref->resource[i] == resource) {
+            return ref->writeable[i] ?
+               LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE :
+               LP_REFERENCED_FOR_READ;
+         }
+      }
    }
 
-   return FALSE;
+   return LP_UNREFERENCED;
 }
 
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Estimate the cost of rasterizing a bin as its number of commands.
+ */
+static unsigned
+bin_cost(const struct cmd_bin *bin)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
-   }
-   return TRUE;
+   const struct cmd_block *block;
+   unsigned cost = 0;
+
+   for (block = bin->head; block; block = block->next)
+      cost += block->count;
+
+   return cost;
+}
+
+
+static inline struct cmd_bin *
+get_bin_linear(struct lp_scene *scene, int i)
+{
+   return lp_scene_get_bin(scene, i % scene->tiles_x, i / scene->tiles_x);
 }
 
 
+/**
+ * Split the bins into one contiguous range per thread, with roughly the
+ * same estimated cost in each.  Contiguous ranges keep neighbouring tiles,
+ * which tend to share textures, on the same thread.
+ * Called by a single thread before any thread starts iterating.
+ */
 void
 lp_scene_bin_iter_begin( struct lp_scene *scene )
 {
-   scene->curr_x = scene->curr_y = -1;
+   const int num_bins = lp_scene_get_num_bins(scene);
+   const unsigned num_queues = scene->num_bin_queues;
+   struct lp_bin_queue *queues = scene->bin_queues;
+   uint64_t total_cost = 0, cost = 0;
+   unsigned q = 0;
+   int i;
+
+   for (i = 0; i < num_bins; i++)
+      total_cost += bin_cost(get_bin_linear(scene, i));
+
+   queues[0].head = 0;
+   for (i = 0; i < num_bins; i++) {
+      cost += bin_cost(get_bin_linear(scene, i));
+      while (q + 1 < num_queues &&
+             cost * num_queues >= total_cost * (q + 1)) {
+         queues[q].tail = i + 1;
+         q++;
+         queues[q].head = i + 1;
+      }
+   }
+   queues[q].tail = num_bins;
+
+   for (q++; q < num_queues; q++) {
+      queues[q].head = queues[q].tail = num_bins;
+   }
+}
+
+
+/**
+ * Steal a bin from the tail of the queue with the most bins left.
+ * Returns the bin's linear index or -1 if there's no work left anywhere.
+ */
+static int
+steal_bin(struct lp_scene *scene, unsigned thread_index)
+{
+   while (1) {
+      struct lp_bin_queue *victim = NULL;
+      int most = 0, i = -1;
+      unsigned q;
+
+      /* unlocked peek, only used to pick the victim */
+      for (q = 0; q < scene->num_bin_queues; q++) {
+         struct lp_bin_queue *queue = &scene->bin_queues[q];
+         int left = p_atomic_read(&queue->tail) - p_atomic_read(&queue->head);
+
+         if (q != thread_index && left > most) {
+            most = left;
+            victim = queue;
+         }
+      }
+
+      if (!victim)
+         return -1;
+
+      mtx_lock(&victim->mutex);
+      if (victim->head < victim->tail)
+         i = --victim->tail;
+      mtx_unlock(&victim->mutex);
+
+      if (i >= 0) {
+         LP_COUNT(nr_bins_stolen);
+         return i;
+      }
+   }
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * Return pointer to next bin to be rendered by the given thread.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  Each thread first drains its own queue,
+ * then steals from the others.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
+   struct lp_bin_queue *queue = &scene->bin_queues[thread_index];
+   int i = -1;
 
-   mtx_lock(&scene->mutex);
+   assert(thread_index < scene->num_bin_queues);
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+   mtx_lock(&queue->mutex);
+   if (queue->head < queue->tail)
+      i = queue->head++;
+   mtx_unlock(&queue->mutex);
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   if (i < 0)
+      i = steal_bin(scene, thread_index);
+
+   if (i < 0)
+      return NULL;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   *x = i % scene->tiles_x;
+   *y = i / scene->tiles_x;
+   return lp_scene_get_bin(scene, *x, *y);
 }
 
 
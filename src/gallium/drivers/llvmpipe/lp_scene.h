@@ -49,10 +49,13 @@ struct lp_rast_state;
 #define TILES_Y (LP_MAX_HEIGHT / TILE_SIZE)
 
 
-/* Commands per command block (ideally so sizeof(cmd_block) is a power of
- * two in size.)
+/* Commands per command block.  The first block of a bin holds
+ * CMD_BLOCK_MIN commands, as most bins only ever see a handful of them;
+ * following blocks double in size up to CMD_BLOCK_MAX so that busy bins
+ * don't end up as long lists of small blocks.
  */
-#define CMD_BLOCK_MAX 29
+#define CMD_BLOCK_MIN 8
+#define CMD_BLOCK_MAX 128
 
 /* Bytes per data block.
  */
@@ -75,13 +78,24 @@ typedef void (*lp_rast_cmd_func)( struct lp_rasterizer_task *,
 
    
 struct cmd_block {
-   uint8_t cmd[CMD_BLOCK_MAX];
-   union lp_rast_cmd_arg arg[CMD_BLOCK_MAX];
    unsigned count;
+   unsigned max;                 /**< number of commands the block holds */
    struct cmd_block *next;
+   uint8_t *cmd;                 /**< points just past arg[max - 1] */
+   union lp_rast_cmd_arg arg[];
 };
 
 
+/** Size in bytes of a command block holding max commands */
+static inline unsigned
+lp_cmd_block_size(unsigned max)
+{
+   return align(sizeof(struct cmd_block) +
+                max * (sizeof(union lp_rast_cmd_arg) + sizeof(uint8_t)),
+                sizeof(void *));
+}
+
+
 struct data_block {
    ubyte data[DATA_BLOCK_SIZE];
    unsigned used;
@@ -128,6 +142,17 @@ struct lp_scene_surface {
    unsigned nr_samples;
 };
 
+/**
+ * Range of bins (as linear indices, y * tiles_x + x) a rasterizer thread
+ * works through.  The owning thread takes bins from the head, idle
+ * threads steal them from the tail.
+ */
+struct lp_bin_queue {
+   mtx_t mutex;
+   int head, tail;
+};
+
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -187,11 +212,17 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /** One queue of bins per rasterizer thread, for iterating over bins */
+   struct lp_bin_queue *bin_queues;
+   unsigned num_bin_queues;
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
+
+   /** Data blocks kept from the previous use of this scene, so that a
+    * steady workload doesn't go back to malloc for every frame.
+    */
+   struct data_block *free_blocks;
 };
 
 
@@ -211,10 +242,13 @@ struct cmd_block *lp_scene_new_cmd_block( struct lp_scene *scene,
 
 boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
-                                        boolean initializing_scene);
+                                        boolean initializing_scene,
+                                        boolean writeable);
+
+unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+void lp_scene_fence_resources(struct lp_scene *scene);
 
 boolean lp_scene_add_frag_shader_reference(struct lp_scene *scene,
                                            struct lp_fragment_shader_variant *variant);
@@ -327,7 +361,7 @@ lp_scene_bin_command( struct lp_scene *scene,
    assert(y < scene->tiles_y);
    assert(cmd < LP_RAST_OP_MAX);
 
-   if (tail == NULL || tail->count == CMD_BLOCK_MAX) {
+   if (tail == NULL || tail->count == tail->max) {
       tail = lp_scene_new_cmd_block( scene, bin );
       if (!tail) {
          return FALSE;
@@ -400,7 +434,8 @@ void
 lp_scene_bin_iter_begin( struct lp_scene *scene );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y );
 
 
 
@@ -57,12 +57,20 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    mtx_t rast_mutex;
+   /* Fence of the last scene queued by any context, under rast_mutex */
+   struct lp_fence *last_fence;
 
    struct lp_cs_tpool *cs_tpool;
    mtx_t cs_mutex;
 
    bool use_tgsi;
    bool allow_cl;
+   /* Store sampler-only textures in LP_TEXTURE_TILE_SIZE tiles */
+   bool tiled_textures;
+   /* Increments whenever a tiled texture is converted to linear, so that
+    * all contexts rebuild the sampler keys of their shaders.
+    */
+   unsigned tiled_generation;
 
    mtx_t late_mutex;
    bool late_init_done;
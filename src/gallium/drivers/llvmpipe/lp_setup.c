@@ -64,6 +64,26 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
+/**
+ * Wait for the rasterizer to be done with a flushed scene, then release
+ * everything the scene holds on to.  This is done here rather than by the
+ * rasterizer threads so that resources and shader variants are only ever
+ * released by the thread owning the context.
+ */
+static void
+lp_setup_retire_scene(struct lp_scene *scene)
+{
+   if (scene->fence) {
+      if (LP_DEBUG & DEBUG_SETUP)
+         debug_printf("%s: wait for scene %d\n",
+                      __FUNCTION__, scene->fence->id);
+
+      lp_fence_wait(scene->fence);
+      lp_scene_end_rasterization(scene);
+   }
+}
+
+
 static void
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
@@ -74,13 +94,7 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
 
    setup->scene = setup->scenes[setup->scene_idx];
 
-   if (setup->scene->fence) {
-      if (LP_DEBUG & DEBUG_SETUP)
-         debug_printf("%s: wait for scene %d\n",
-                      __FUNCTION__, setup->scene->fence->id);
-
-      lp_fence_wait(setup->scene->fence);
-   }
+   lp_setup_retire_scene(setup->scene);
 
    lp_scene_begin_binning(setup->scene, &setup->fb);
 
@@ -166,23 +180,20 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   mtx_lock(&screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer here: binning of the next scenes
+    * proceeds while this one is rasterized.  Scenes are rasterized in
+    * queue order, so anything rendered by this scene is visible to the
+    * following ones.  Whoever accesses resources outside of the scenes
+    * waits for the scene fence instead, see
+    * lp_setup_is_resource_referenced() and lp_scene_fence_resources(),
+    * and the scene is retired when it is reused.
     */
+   mtx_lock(&screen->rast_mutex);
+   lp_scene_fence_resources(scene);
+   lp_fence_reference(&screen->last_fence, scene->fence);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    mtx_unlock(&screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -1063,6 +1074,34 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
 }
 
 
+/**
+ * Is the given texture referenced by a scene of this context which was
+ * flushed but may not have been rasterized yet?
+ * The scenes of other contexts are tracked by the resource fences, see
+ * llvmpipe_wait_resource().
+ */
+unsigned
+lp_setup_is_resource_referenced_by_pending( const struct lp_setup_context *setup,
+                                           const struct pipe_resource *texture )
+{
+   unsigned referenced = LP_UNREFERENCED;
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+      const struct lp_scene *scene = setup->scenes[i];
+
+      /* scene contents are stable until the fence is signalled */
+      if (scene == setup->scene || !scene->fence ||
+          lp_fence_signalled(scene->fence))
+         continue;
+
+      referenced |= lp_scene_is_resource_referenced(scene, texture);
+   }
+
+   return referenced;
+}
+
+
 /**
  * Is the given texture referenced by any scene?
  * Note: we have to check all scenes including any scenes currently
@@ -1072,6 +1111,7 @@ unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture )
 {
+   unsigned referenced = LP_UNREFERENCED;
    unsigned i;
 
    /* check the render targets */
@@ -1083,13 +1123,6 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
-   }
-
    for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
       if (setup->ssbos[i].current.buffer == texture)
          return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
@@ -1100,7 +1133,15 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
          return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   return LP_UNREFERENCED;
+   /* Combine the scene being built with any scenes still being rasterized,
+    * the current scene may only read what an earlier one still writes.
+    */
+   if (setup->scene)
+      referenced |= lp_scene_is_resource_referenced(setup->scene, texture);
+
+   referenced |= lp_setup_is_resource_referenced_by_pending(setup, texture);
+
+   return referenced;
 }
 
 
@@ -1305,7 +1346,33 @@ try_update_scene_state( struct lp_setup_context *setup )
             if (setup->fs.current_tex[i]) {
                if (!lp_scene_add_resource_reference(scene,
                                                     setup->fs.current_tex[i],
-                                                    new_scene)) {
+                                                    new_scene, FALSE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         /* Shader buffers and images may be written by the fragment
+          * shader.  The references also keep them alive while the scene
+          * is in flight.
+          */
+         for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+            if (setup->ssbos[i].current.buffer) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->ssbos[i].current.buffer,
+                                                    new_scene, TRUE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         for (i = 0; i < ARRAY_SIZE(setup->images); i++) {
+            if (setup->images[i].current.resource) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->images[i].current.resource,
+                                                    new_scene, TRUE)) {
                   assert(!new_scene);
                   return FALSE;
                }
@@ -1371,6 +1438,8 @@ lp_setup_update_state( struct lp_setup_context *setup,
 		    setup->setup.variant->key.size) == 0);
    }
 
+   lp_setup_choose_rect(setup);
+
    if (update_scene && setup->state != SETUP_ACTIVE) {
       if (!set_scene_state( setup, SETUP_ACTIVE, __FUNCTION__ ))
          return FALSE;
@@ -1437,8 +1506,7 @@ lp_setup_destroy( struct lp_setup_context *setup )
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
-         lp_fence_wait(scene->fence);
+      lp_setup_retire_scene(scene);
 
       lp_scene_destroy(scene);
    }
@@ -54,9 +54,11 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/**
+ * Max number of scenes. While one scene is being binned, the others can
+ * be queued for or undergoing rasterization.
+ */
+#define MAX_SCENES 4
 
 
 
@@ -178,6 +180,15 @@ struct lp_setup_context
                      const float (*v0)[4],
                      const float (*v1)[4],
                      const float (*v2)[4]);
+
+   /** Two triangles as one textured rectangle, NULL if not possible */
+   boolean (*rect)( struct lp_setup_context *,
+                    const float (*v0)[4],
+                    const float (*v1)[4],
+                    const float (*v2)[4],
+                    const float (*v3)[4],
+                    const float (*v4)[4],
+                    const float (*v5)[4]);
 };
 
 static inline void
@@ -198,6 +209,7 @@ scissor_planes_needed(boolean scis_planes[4], const struct u_rect *bbox,
 void lp_setup_choose_triangle( struct lp_setup_context *setup );
 void lp_setup_choose_line( struct lp_setup_context *setup );
 void lp_setup_choose_point( struct lp_setup_context *setup );
+void lp_setup_choose_rect( struct lp_setup_context *setup );
 
 void lp_setup_init_vbuf(struct lp_setup_context *setup);
 
@@ -0,0 +1,323 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Binning of screen-aligned rectangles which map a texture 1:1 onto the
+ * color buffer, as drawn by compositors and 2D blitters.  When the
+ * fragment shader merely samples the texture (see lp_state_fs_analysis.c)
+ * the texels can be copied or blended straight into the color buffer by
+ * the rasterizer, without interpolating inputs or running the shader.
+ *
+ * Anything which doesn't fit is left to the regular triangle path.
+ */
+
+
+#include <math.h>
+#include "util/u_math.h"
+#include "lp_setup_context.h"
+#include "lp_context.h"
+#include "lp_perf.h"
+#include "lp_rast.h"
+#include "lp_scene.h"
+#include "lp_state_fs.h"
+#include "lp_texture.h"
+
+
+/** Tolerance when checking texel coords, small enough for bilinear */
+#define RECT_TEXEL_EPS (1.0f / 1024.0f)
+
+
+/**
+ * How texel coords map to pixels along one axis.  Pixel p (with its center
+ * at p + 0.5) samples texel dir * p + offset.
+ */
+struct rect_axis {
+   int dir;
+   int offset;
+};
+
+
+/**
+ * Find the 1:1 mapping of texel coords u0 at window coord p0 and u1 at p1.
+ */
+static boolean
+rect_axis_mapping(float p0, float p1, float u0, float u1,
+                  struct rect_axis *axis)
+{
+   float k;
+
+   if (u1 > u0) {
+      k = u0 - p0;
+      axis->dir = 1;
+      axis->offset = (int)roundf(k);
+      return fabsf(k - axis->offset) <= RECT_TEXEL_EPS &&
+             fabsf(u1 - p1 - axis->offset) <= RECT_TEXEL_EPS;
+   } else {
+      k = u0 + p0;
+      axis->dir = -1;
+      axis->offset = (int)roundf(k) - 1;
+      return fabsf(k - 1 - axis->offset) <= RECT_TEXEL_EPS &&
+             fabsf(u1 + p1 - 1 - axis->offset) <= RECT_TEXEL_EPS;
+   }
+}
+
+
+/**
+ * Check whether two triangles make up an axis-aligned rectangle with
+ * integer corners, and if so return its bounds and the texture coords
+ * at its corners (indexed by (x == xmax) | (y == ymax) << 1).
+ */
+static boolean
+rect_from_tris(const float (*v[6])[4], unsigned attr,
+               float *xmin, float *ymin, float *xmax, float *ymax,
+               float st[4][2])
+{
+   unsigned mask[2] = { 0, 0 };
+   unsigned seen = 0;
+   unsigned missing[2];
+   unsigned i;
+
+   *xmin = *xmax = v[0][0][0];
+   *ymin = *ymax = v[0][0][1];
+   for (i = 1; i < 6; i++) {
+      *xmin = MIN2(*xmin, v[i][0][0]);
+      *xmax = MAX2(*xmax, v[i][0][0]);
+      *ymin = MIN2(*ymin, v[i][0][1]);
+      *ymax = MAX2(*ymax, v[i][0][1]);
+   }
+
+   if (!(*xmin < *xmax && *ymin < *ymax) ||
+       *xmin != floorf(*xmin) || *xmax != floorf(*xmax) ||
+       *ymin != floorf(*ymin) || *ymax != floorf(*ymax))
+      return FALSE;
+
+   for (i = 0; i < 6; i++) {
+      const float *pos = v[i][0];
+      const float *coord = v[i][attr];
+      unsigned corner;
+
+      if ((pos[0] != *xmin && pos[0] != *xmax) ||
+          (pos[1] != *ymin && pos[1] != *ymax) ||
+          pos[3] != v[0][0][3])
+         return FALSE;
+
+      corner = (pos[0] == *xmax) | (pos[1] == *ymax) << 1;
+      if (mask[i / 3] & (1 << corner))
+         return FALSE;
+      mask[i / 3] |= 1 << corner;
+
+      if (seen & (1 << corner)) {
+         if (st[corner][0] != coord[0] || st[corner][1] != coord[1])
+            return FALSE;
+      } else {
+         st[corner][0] = coord[0];
+         st[corner][1] = coord[1];
+         seen |= 1 << corner;
+      }
+   }
+
+   /* each triangle must leave out the corner opposite the other's */
+   missing[0] = ffs(~mask[0] & 0xf) - 1;
+   missing[1] = ffs(~mask[1] & 0xf) - 1;
+   if ((missing[0] ^ missing[1]) != 3)
+      return FALSE;
+
+   /* s must only depend on x and t only on y */
+   return st[0][0] == st[2][0] && st[1][0] == st[3][0] &&
+          st[0][1] == st[1][1] && st[2][1] == st[3][1];
+}
+
+
+/**
+ * Bin a blit command into all tiles overlapping its rectangle.
+ */
+static boolean
+bin_rect(struct lp_setup_context *setup, const struct lp_rast_blit *template)
+{
+   struct lp_scene *scene = setup->scene;
+   struct lp_rast_blit *blit;
+   const boolean opaque = template->op != LP_FS_BLIT_OVER;
+   int tx0 = template->x0 / TILE_SIZE;
+   int ty0 = template->y0 / TILE_SIZE;
+   int tx1 = (template->x1 - 1) / TILE_SIZE;
+   int ty1 = (template->y1 - 1) / TILE_SIZE;
+   int tx, ty;
+
+   blit = lp_scene_alloc(scene, sizeof *blit);
+   if (!blit)
+      return FALSE;
+
+   *blit = *template;
+
+   for (ty = ty0; ty <= ty1; ty++) {
+      for (tx = tx0; tx <= tx1; tx++) {
+         /*
+          * As with opaque shade_tile commands, fully covered tiles don't
+          * need anything binned before.
+          */
+         if (opaque &&
+             !scene->fb.zsbuf && scene->fb_max_layer == 0 &&
+             !scene->had_queries &&
+             blit->x0 <= tx * TILE_SIZE &&
+             blit->y0 <= ty * TILE_SIZE &&
+             blit->x1 >= MIN2((tx + 1) * TILE_SIZE, (int)scene->fb.width) &&
+             blit->y1 >= MIN2((ty + 1) * TILE_SIZE, (int)scene->fb.height))
+            lp_scene_bin_reset(scene, tx, ty);
+
+         if (!lp_scene_bin_command(scene, tx, ty, LP_RAST_OP_BLIT,
+                                   lp_rast_arg_blit(blit))) {
+            /* don't draw the part which made it in twice */
+            blit->disable = TRUE;
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Try to draw the two triangles v0, v1, v2 and v3, v4, v5 as a single
+ * texture copy.  Returns FALSE if they have to go through the regular
+ * triangle path instead.
+ */
+static boolean
+setup_rect(struct lp_setup_context *setup,
+           const float (*v0)[4],
+           const float (*v1)[4],
+           const float (*v2)[4],
+           const float (*v3)[4],
+           const float (*v4)[4],
+           const float (*v5)[4])
+{
+   const struct lp_fragment_shader_variant *variant =
+      setup->fs.current.variant;
+   const struct lp_jit_texture *tex = &setup->fs.current.jit_context.textures[0];
+   const struct u_rect *region = &setup->draw_regions[0];
+   const float (*v[6])[4] = { v0, v1, v2, v3, v4, v5 };
+   struct lp_rast_blit blit;
+   struct rect_axis axis_x, axis_y;
+   float xmin, ymin, xmax, ymax;
+   float st[4][2];
+   float scale_s, scale_t;
+   unsigned level, width, height;
+   int tx0, ty0, tx1, ty1;
+
+   if (setup->active_binned_queries || setup->view_index != 0)
+      return FALSE;
+
+   if (!rect_from_tris(v, variant->shader->blit_input + 1,
+                       &xmin, &ymin, &xmax, &ymax, st))
+      return FALSE;
+
+   level = tex->first_level;
+   width = u_minify(tex->width, level);
+   height = u_minify(tex->height, level);
+   if (variant->key.samplers[0].sampler_state.normalized_coords) {
+      scale_s = (float)width;
+      scale_t = (float)height;
+   } else {
+      scale_s = scale_t = 1.0f;
+   }
+
+   /* pixel centers are half a pixel in from the corners */
+   if (!rect_axis_mapping(xmin, xmax,
+                          st[0][0] * scale_s, st[1][0] * scale_s, &axis_x) ||
+       !rect_axis_mapping(ymin, ymax,
+                          st[0][1] * scale_t, st[2][1] * scale_t, &axis_y))
+      return FALSE;
+
+   blit.op = variant->blit;
+   blit.disable = FALSE;
+   blit.x0 = MAX2((int)xmin, region->x0);
+   blit.y0 = MAX2((int)ymin, region->y0);
+   blit.x1 = MIN2((int)xmax, region->x1 + 1);
+   blit.y1 = MIN2((int)ymax, region->y1 + 1);
+   if (blit.x0 >= blit.x1 || blit.y0 >= blit.y1)
+      return TRUE;
+
+   /* texels outside of the texture would depend on the wrap modes */
+   tx0 = axis_x.dir * blit.x0 + axis_x.offset;
+   tx1 = axis_x.dir * (blit.x1 - 1) + axis_x.offset;
+   ty0 = axis_y.dir * blit.y0 + axis_y.offset;
+   ty1 = axis_y.dir * (blit.y1 - 1) + axis_y.offset;
+   if (MIN2(tx0, tx1) < 0 || MAX2(tx0, tx1) >= (int)width ||
+       MIN2(ty0, ty1) < 0 || MAX2(ty0, ty1) >= (int)height)
+      return FALSE;
+
+   blit.src_pixel_step = axis_x.dir * 4;
+   blit.src_row_step = axis_y.dir * (int)tex->row_stride[level];
+   blit.src = (const uint8_t *)tex->base + tex->mip_offsets[level] +
+              ty0 * tex->row_stride[level] + tx0 * 4;
+
+   if (!bin_rect(setup, &blit)) {
+      if (!lp_setup_flush_and_restart(setup))
+         return TRUE;
+
+      bin_rect(setup, &blit);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Decide whether the current state allows drawing rectangles as texture
+ * copies; the variant has already checked the shader, blend and formats.
+ */
+void
+lp_setup_choose_rect(struct lp_setup_context *setup)
+{
+   const struct lp_fragment_shader_variant *variant =
+      setup->fs.current.variant;
+   const struct pipe_surface *cbuf = setup->fb.cbufs[0];
+
+   setup->rect = NULL;
+
+   if (!variant ||
+       variant->blit == LP_FS_BLIT_NONE ||
+       setup->rasterizer_discard ||
+       setup->multisample ||
+       setup->cullmode != PIPE_FACE_NONE ||
+       setup->pixel_offset != 0.5f ||
+       setup->layer_slot >= 0 ||
+       setup->viewport_index_slot >= 0 ||
+       setup->fb.nr_cbufs != 1 ||
+       !cbuf ||
+       cbuf->u.tex.first_layer != cbuf->u.tex.last_layer)
+      return;
+
+   /* don't let the copy read what it writes */
+   if (!setup->fs.current_tex[0] ||
+       setup->fs.current_tex[0] == cbuf->texture ||
+       setup->fs.current_tex[0]->nr_samples > 1)
+      return;
+
+   setup->rect = setup_rect;
+}
@@ -191,6 +191,18 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 
    case PIPE_PRIM_TRIANGLES:
       for (i = 2; i < nr; i += 3) {
+         /* try consecutive triangles as a rectangle */
+         if (i + 3 < nr && setup->rect &&
+             setup->rect( setup,
+                          get_vert(vertex_buffer, indices[i-2], stride),
+                          get_vert(vertex_buffer, indices[i-1], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride),
+                          get_vert(vertex_buffer, indices[i+1], stride),
+                          get_vert(vertex_buffer, indices[i+2], stride),
+                          get_vert(vertex_buffer, indices[i+3], stride) )) {
+            i += 3;
+            continue;
+         }
          setup->triangle( setup,
                           get_vert(vertex_buffer, indices[i-2], stride),
                           get_vert(vertex_buffer, indices[i-1], stride),
@@ -199,6 +211,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLE_STRIP:
+      if (nr == 4 && setup->rect &&
+          setup->rect( setup,
+                       get_vert(vertex_buffer, indices[0], stride),
+                       get_vert(vertex_buffer, indices[1], stride),
+                       get_vert(vertex_buffer, indices[2], stride),
+                       get_vert(vertex_buffer, indices[1], stride),
+                       get_vert(vertex_buffer, indices[2], stride),
+                       get_vert(vertex_buffer, indices[3], stride) ))
+         break;
       if (flatshade_first) {
          for (i = 2; i < nr; i += 1) {
             /* emit first triangle vertex as first triangle vertex */
@@ -221,6 +242,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLE_FAN:
+      if (nr == 4 && setup->rect &&
+          setup->rect( setup,
+                       get_vert(vertex_buffer, indices[0], stride),
+                       get_vert(vertex_buffer, indices[1], stride),
+                       get_vert(vertex_buffer, indices[2], stride),
+                       get_vert(vertex_buffer, indices[0], stride),
+                       get_vert(vertex_buffer, indices[2], stride),
+                       get_vert(vertex_buffer, indices[3], stride) ))
+         break;
       if (flatshade_first) {
          for (i = 2; i < nr; i += 1) {
             /* emit first non-spoke vertex as first vertex */
@@ -246,6 +276,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       if (flatshade_first) { 
          /* emit last quad vertex as first triangle vertex */
          for (i = 3; i < nr; i += 4) {
+            if (setup->rect &&
+                setup->rect( setup,
+                             get_vert(vertex_buffer, indices[i-3], stride),
+                             get_vert(vertex_buffer, indices[i-2], stride),
+                             get_vert(vertex_buffer, indices[i-0], stride),
+                             get_vert(vertex_buffer, indices[i-2], stride),
+                             get_vert(vertex_buffer, indices[i-1], stride),
+                             get_vert(vertex_buffer, indices[i-0], stride) ))
+               continue;
             setup->triangle( setup,
                              get_vert(vertex_buffer, indices[i-0], stride),
                              get_vert(vertex_buffer, indices[i-3], stride),
@@ -260,6 +299,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       else {
          /* emit last quad vertex as last triangle vertex */
          for (i = 3; i < nr; i += 4) {
+            if (setup->rect &&
+                setup->rect( setup,
+                             get_vert(vertex_buffer, indices[i-3], stride),
+                             get_vert(vertex_buffer, indices[i-2], stride),
+                             get_vert(vertex_buffer, indices[i-0], stride),
+                             get_vert(vertex_buffer, indices[i-2], stride),
+                             get_vert(vertex_buffer, indices[i-1], stride),
+                             get_vert(vertex_buffer, indices[i-0], stride) ))
+               continue;
             setup->triangle( setup,
                           get_vert(vertex_buffer, indices[i-3], stride),
                           get_vert(vertex_buffer, indices[i-2], stride),
@@ -389,6 +437,18 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
 
    case PIPE_PRIM_TRIANGLES:
       for (i = 2; i < nr; i += 3) {
+         /* try consecutive triangles as a rectangle */
+         if (i + 3 < nr && setup->rect &&
+             setup->rect( setup,
+                          get_vert(vertex_buffer, i-2, stride),
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-0, stride),
+                          get_vert(vertex_buffer, i+1, stride),
+                          get_vert(vertex_buffer, i+2, stride),
+                          get_vert(vertex_buffer, i+3, stride) )) {
+            i += 3;
+            continue;
+         }
          setup->triangle( setup,
                           get_vert(vertex_buffer, i-2, stride),
                           get_vert(vertex_buffer, i-1, stride),
@@ -397,6 +457,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLE_STRIP:
+      if (nr == 4 && setup->rect &&
+          setup->rect( setup,
+                       get_vert(vertex_buffer, 0, stride),
+                       get_vert(vertex_buffer, 1, stride),
+                       get_vert(vertex_buffer, 2, stride),
+                       get_vert(vertex_buffer, 1, stride),
+                       get_vert(vertex_buffer, 2, stride),
+                       get_vert(vertex_buffer, 3, stride) ))
+         break;
       if (flatshade_first) {
          for (i = 2; i < nr; i++) {
             /* emit first triangle vertex as first triangle vertex */
@@ -418,6 +487,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLE_FAN:
+      if (nr == 4 && setup->rect &&
+          setup->rect( setup,
+                       get_vert(vertex_buffer, 0, stride),
+                       get_vert(vertex_buffer, 1, stride),
+                       get_vert(vertex_buffer, 2, stride),
+                       get_vert(vertex_buffer, 0, stride),
+                       get_vert(vertex_buffer, 2, stride),
+                       get_vert(vertex_buffer, 3, stride) ))
+         break;
       if (flatshade_first) {
          for (i = 2; i < nr; i += 1) {
             /* emit first non-spoke vertex as first vertex */
@@ -443,6 +521,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       if (flatshade_first) { 
          /* emit last quad vertex as first triangle vertex */
          for (i = 3; i < nr; i += 4) {
+            if (setup->rect &&
+                setup->rect( setup,
+                             get_vert(vertex_buffer, i-3, stride),
+                             get_vert(vertex_buffer, i-2, stride),
+                             get_vert(vertex_buffer, i-0, stride),
+                             get_vert(vertex_buffer, i-2, stride),
+                             get_vert(vertex_buffer, i-1, stride),
+                             get_vert(vertex_buffer, i-0, stride) ))
+               continue;
             setup->triangle( setup,
                              get_vert(vertex_buffer, i-0, stride),
                              get_vert(vertex_buffer, i-3, stride),
@@ -456,6 +543,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       else {
          /* emit last quad vertex as last triangle vertex */
          for (i = 3; i < nr; i += 4) {
+            if (setup->rect &&
+                setup->rect( setup,
+                             get_vert(vertex_buffer, i-3, stride),
+                             get_vert(vertex_buffer, i-2, stride),
+                             get_vert(vertex_buffer, i-0, stride),
+                             get_vert(vertex_buffer, i-2, stride),
+                             get_vert(vertex_buffer, i-1, stride),
+                             get_vert(vertex_buffer, i-0, stride) ))
+               continue;
             setup->triangle( setup,
                              get_vert(vertex_buffer, i-3, stride),
                              get_vert(vertex_buffer, i-2, stride),
@@ -44,6 +44,7 @@
 #include "lp_screen.h"
 #include "lp_memory.h"
 #include "lp_query.h"
+#include "lp_flush.h"
 #include "lp_cs_tpool.h"
 #include "frontend/sw_winsys.h"
 #include "nir/nir_to_tgsi_info.h"
@@ -84,21 +85,26 @@ generate_compute(struct llvmpipe_context *lp,
    struct lp_build_image_soa *image;
    LLVMValueRef function, coro;
    struct lp_type cs_type;
+   bool use_coro = shader->has_barrier;
    unsigned i;
 
    /*
     * This function has two parts
     * a) setup the coroutine execution environment loop.
     * b) build the compute shader llvm for use inside the coroutine.
+    *
+    * Shaders without barriers never suspend, so for those (b) is built as
+    * a plain function and (a) just calls it once per subgroup, avoiding the
+    * coroutine frame allocation and the resume loop.
     */
-   assert(lp_native_vector_width / 32 >= 4);
+   assert(lp_compute_vector_width / 32 >= 4);
 
    memset(&cs_type, 0, sizeof cs_type);
    cs_type.floating = TRUE;      /* floating point values */
    cs_type.sign = TRUE;          /* values are signed */
    cs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    cs_type.width = 32;           /* 32-bit float */
-   cs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   cs_type.length = MIN2(lp_compute_vector_width / 32, 16); /* n*4 elements per vector */
    snprintf(func_name, sizeof(func_name), "cs_variant");
 
    snprintf(func_name_coro, sizeof(func_name), "cs_co_variant");
@@ -135,6 +141,13 @@ generate_compute(struct llvmpipe_context *lp,
 
    variant->function = function;
 
+   if (lp_compute_vector_width > 256) {
+      /* CPUs which prefer 256-bit vectors would otherwise get the 512-bit
+       * vectors split in two by codegen. */
+      LLVMAddTargetDependentFunctionAttr(function, "min-legal-vector-width", "512");
+      LLVMAddTargetDependentFunctionAttr(coro, "min-legal-vector-width", "512");
+   }
+
    for(i = 0; i < ARRAY_SIZE(arg_types); ++i) {
       if(LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind) {
          lp_add_function_attr(coro, i + 1, LP_FUNC_ATTR_NOALIAS);
@@ -188,11 +201,14 @@ generate_compute(struct llvmpipe_context *lp,
    num_x_loop = LLVMBuildUDiv(gallivm->builder, num_x_loop, vec_length, "");
    LLVMValueRef partials = LLVMBuildURem(gallivm->builder, x_size_arg, vec_length, "");
 
-   LLVMValueRef coro_num_hdls = LLVMBuildMul(gallivm->builder, num_x_loop, y_size_arg, "");
-   coro_num_hdls = LLVMBuildMul(gallivm->builder, coro_num_hdls, z_size_arg, "");
-
    LLVMTypeRef hdl_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
-   LLVMValueRef coro_hdls = LLVMBuildArrayAlloca(gallivm->builder, hdl_ptr_type, coro_num_hdls, "coro_hdls");
+   LLVMValueRef coro_hdls = NULL;
+   if (use_coro) {
+      LLVMValueRef coro_num_hdls = LLVMBuildMul(gallivm->builder, num_x_loop, y_size_arg, "");
+      coro_num_hdls = LLVMBuildMul(gallivm->builder, coro_num_hdls, z_size_arg, "");
+
+      coro_hdls = LLVMBuildArrayAlloca(gallivm->builder, hdl_ptr_type, coro_num_hdls, "coro_hdls");
+   }
 
    unsigned end_coroutine = INT_MAX;
 
@@ -202,8 +218,9 @@ generate_compute(struct llvmpipe_context *lp,
     * passes it checks if the coroutine has completed and resumes it if not.
     */
    /* take x_width - round up to type.length width */
-   lp_build_loop_begin(&loop_state[3], gallivm,
-                       lp_build_const_int32(gallivm, 0)); /* coroutine reentry loop */
+   if (use_coro)
+      lp_build_loop_begin(&loop_state[3], gallivm,
+                          lp_build_const_int32(gallivm, 0)); /* coroutine reentry loop */
    lp_build_loop_begin(&loop_state[2], gallivm,
                        lp_build_const_int32(gallivm, 0)); /* z loop */
    lp_build_loop_begin(&loop_state[1], gallivm,
@@ -240,31 +257,37 @@ generate_compute(struct llvmpipe_context *lp,
                                   loop_state[0].counter, "");
 
       args[17] = coro_hdl_idx;
-      LLVMValueRef coro_entry = LLVMBuildGEP(gallivm->builder, coro_hdls, &coro_hdl_idx, 1, "");
-
-      LLVMValueRef coro_hdl = LLVMBuildLoad(gallivm->builder, coro_entry, "coro_hdl");
-
-      struct lp_build_if_state ifstate;
-      LLVMValueRef cmp = LLVMBuildICmp(gallivm->builder, LLVMIntEQ, loop_state[3].counter,
-                                       lp_build_const_int32(gallivm, 0), "");
-      /* first time here - call the coroutine function entry point */
-      lp_build_if(&ifstate, gallivm, cmp);
-      LLVMValueRef coro_ret = LLVMBuildCall(gallivm->builder, coro, args, 18, "");
-      LLVMBuildStore(gallivm->builder, coro_ret, coro_entry);
-      lp_build_else(&ifstate);
-      /* subsequent calls for this invocation - check if done. */
-      LLVMValueRef coro_done = lp_build_coro_done(gallivm, coro_hdl);
-      struct lp_build_if_state ifstate2;
-      lp_build_if(&ifstate2, gallivm, coro_done);
-      /* if done destroy and force loop exit */
-      lp_build_coro_destroy(gallivm, coro_hdl);
-      lp_build_loop_force_set_counter(&loop_state[3], lp_build_const_int32(gallivm, end_coroutine - 1));
-      lp_build_else(&ifstate2);
-      /* otherwise resume the coroutine */
-      lp_build_coro_resume(gallivm, coro_hdl);
-      lp_build_endif(&ifstate2);
-      lp_build_endif(&ifstate);
-      lp_build_loop_force_reload_counter(&loop_state[3]);
+
+      if (use_coro) {
+         LLVMValueRef coro_entry = LLVMBuildGEP(gallivm->builder, coro_hdls, &coro_hdl_idx, 1, "");
+
+         LLVMValueRef coro_hdl = LLVMBuildLoad(gallivm->builder, coro_entry, "coro_hdl");
+
+         struct lp_build_if_state ifstate;
+         LLVMValueRef cmp = LLVMBuildICmp(gallivm->builder, LLVMIntEQ, loop_state[3].counter,
+                                          lp_build_const_int32(gallivm, 0), "");
+         /* first time here - call the coroutine function entry point */
+         lp_build_if(&ifstate, gallivm, cmp);
+         LLVMValueRef coro_ret = LLVMBuildCall(gallivm->builder, coro, args, 18, "");
+         LLVMBuildStore(gallivm->builder, coro_ret, coro_entry);
+         lp_build_else(&ifstate);
+         /* subsequent calls for this invocation - check if done. */
+         LLVMValueRef coro_done = lp_build_coro_done(gallivm, coro_hdl);
+         struct lp_build_if_state ifstate2;
+         lp_build_if(&ifstate2, gallivm, coro_done);
+         /* if done destroy and force loop exit */
+         lp_build_coro_destroy(gallivm, coro_hdl);
+         lp_build_loop_force_set_counter(&loop_state[3], lp_build_const_int32(gallivm, end_coroutine - 1));
+         lp_build_else(&ifstate2);
+         /* otherwise resume the coroutine */
+         lp_build_coro_resume(gallivm, coro_hdl);
+         lp_build_endif(&ifstate2);
+         lp_build_endif(&ifstate);
+         lp_build_loop_force_reload_counter(&loop_state[3]);
+      } else {
+         /* no barriers - run the subgroup to completion in one call */
+         LLVMBuildCall(gallivm->builder, coro, args, 18, "");
+      }
    }
    lp_build_loop_end_cond(&loop_state[0],
                           num_x_loop,
@@ -275,9 +298,10 @@ generate_compute(struct llvmpipe_context *lp,
    lp_build_loop_end_cond(&loop_state[2],
                           z_size_arg,
                           NULL,  LLVMIntUGE);
-   lp_build_loop_end_cond(&loop_state[3],
-                          lp_build_const_int32(gallivm, end_coroutine),
-                          NULL, LLVMIntEQ);
+   if (use_coro)
+      lp_build_loop_end_cond(&loop_state[3],
+                             lp_build_const_int32(gallivm, end_coroutine),
+                             NULL, LLVMIntEQ);
    LLVMBuildRetVoid(builder);
 
    /* This is stage (b) - generate the compute shader code inside the coroutine. */
@@ -320,8 +344,11 @@ generate_compute(struct llvmpipe_context *lp,
       shared_ptr = lp_jit_cs_thread_data_shared(gallivm, thread_data_ptr);
 
       /* these are coroutine entrypoint necessities */
-      LLVMValueRef coro_id = lp_build_coro_id(gallivm);
-      LLVMValueRef coro_hdl = lp_build_coro_begin_alloc_mem(gallivm, coro_id);
+      LLVMValueRef coro_id = NULL, coro_hdl = NULL;
+      if (use_coro) {
+         coro_id = lp_build_coro_id(gallivm);
+         coro_hdl = lp_build_coro_begin_alloc_mem(gallivm, coro_id);
+      }
 
       LLVMValueRef has_partials = LLVMBuildICmp(gallivm->builder, LLVMIntNE, partials, lp_build_const_int32(gallivm, 0), "");
       LLVMValueRef tid_vals[3];
@@ -380,9 +407,12 @@ generate_compute(struct llvmpipe_context *lp,
       lp_build_mask_begin(&mask, gallivm, cs_type, mask_val);
 
       struct lp_build_coro_suspend_info coro_info;
+      LLVMBasicBlockRef sus_block = NULL, clean_block = NULL;
 
-      LLVMBasicBlockRef sus_block = LLVMAppendBasicBlockInContext(gallivm->context, coro, "suspend");
-      LLVMBasicBlockRef clean_block = LLVMAppendBasicBlockInContext(gallivm->context, coro, "cleanup");
+      if (use_coro) {
+         sus_block = LLVMAppendBasicBlockInContext(gallivm->context, coro, "suspend");
+         clean_block = LLVMAppendBasicBlockInContext(gallivm->context, coro, "cleanup");
+      }
 
       coro_info.suspend = sus_block;
       coro_info.cleanup = clean_block;
@@ -402,7 +432,7 @@ generate_compute(struct llvmpipe_context *lp,
       params.ssbo_sizes_ptr = num_ssbo_ptr;
       params.image = image;
       params.shared_ptr = shared_ptr;
-      params.coro = &coro_info;
+      params.coro = use_coro ? &coro_info : NULL;
       params.kernel_args = kernel_args_ptr;
 
       if (shader->base.type == PIPE_SHADER_IR_TGSI)
@@ -413,16 +443,20 @@ generate_compute(struct llvmpipe_context *lp,
 
       mask_val = lp_build_mask_end(&mask);
 
-      lp_build_coro_suspend_switch(gallivm, &coro_info, NULL, true);
-      LLVMPositionBuilderAtEnd(builder, clean_block);
+      if (use_coro) {
+         lp_build_coro_suspend_switch(gallivm, &coro_info, NULL, true);
+         LLVMPositionBuilderAtEnd(builder, clean_block);
 
-      lp_build_coro_free_mem(gallivm, coro_id, coro_hdl);
+         lp_build_coro_free_mem(gallivm, coro_id, coro_hdl);
 
-      LLVMBuildBr(builder, sus_block);
-      LLVMPositionBuilderAtEnd(builder, sus_block);
+         LLVMBuildBr(builder, sus_block);
+         LLVMPositionBuilderAtEnd(builder, sus_block);
 
-      lp_build_coro_end(gallivm, coro_hdl);
-      LLVMBuildRet(builder, coro_hdl);
+         lp_build_coro_end(gallivm, coro_hdl);
+         LLVMBuildRet(builder, coro_hdl);
+      } else {
+         LLVMBuildRet(builder, LLVMConstNull(hdl_ptr_type));
+      }
    }
 
    sampler->destroy(sampler);
@@ -432,6 +466,32 @@ generate_compute(struct llvmpipe_context *lp,
    gallivm_verify_function(gallivm, function);
 }
 
+/**
+ * Whether the shader contains a workgroup execution barrier, which means
+ * its invocations must be run as coroutines that can be suspended.
+ */
+static bool
+cs_nir_has_barrier(const struct nir_shader *nir)
+{
+   nir_foreach_function(function, nir) {
+      if (!function->impl)
+         continue;
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr(instr, block) {
+            if (instr->type != nir_instr_type_intrinsic)
+               continue;
+            nir_intrinsic_instr *intr = nir_instr_as_intrinsic(instr);
+            if (intr->intrinsic == nir_intrinsic_control_barrier)
+               return true;
+            if (intr->intrinsic == nir_intrinsic_scoped_barrier &&
+                nir_intrinsic_execution_scope(intr) != NIR_SCOPE_NONE)
+               return true;
+         }
+      }
+   }
+   return false;
+}
+
 static void *
 llvmpipe_create_compute_state(struct pipe_context *pipe,
                                      const struct pipe_compute_state *templ)
@@ -467,8 +527,10 @@ llvmpipe_create_compute_state(struct pipe_context *pipe,
 
       /* we need to keep a local copy of the tokens */
       shader->base.tokens = tgsi_dup_tokens(templ->prog);
+      shader->has_barrier = shader->info.base.opcode_count[TGSI_OPCODE_BARRIER] > 0;
    } else {
       nir_tgsi_scan_shader(shader->base.ir.nir, &shader->info.base, false);
+      shader->has_barrier = cs_nir_has_barrier(shader->base.ir.nir);
    }
 
    make_empty_list(&shader->variants);
@@ -590,8 +652,8 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1u << (i & 31))) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+            llvmpipe_sampler_static_texture_state(&cs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
          }
       }
    }
@@ -599,8 +661,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+            llvmpipe_sampler_static_texture_state(&cs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
          }
       }
    }
@@ -657,6 +719,8 @@ dump_cs_variant_key(const struct lp_compute_shader_variant_key *key)
                    texture->pot_width,
                    texture->pot_height,
                    texture->pot_depth);
+      debug_printf("  .tiled = %u\n",
+                   texture->tiled);
    }
    struct lp_image_static_state *images = lp_cs_variant_key_images(key);
    for (i = 0; i < key->nr_images; ++i) {
@@ -1223,6 +1287,8 @@ update_csctx_ssbo(struct llvmpipe_context *llvmpipe)
 static void
 llvmpipe_cs_update_derived(struct llvmpipe_context *llvmpipe, void *input)
 {
+   llvmpipe_check_tiled_generation(llvmpipe);
+
    if (llvmpipe->cs_dirty & LP_CSNEW_CONSTANTS) {
       lp_csctx_set_cs_constants(llvmpipe->csctx,
                                 ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_COMPUTE]),
@@ -1339,6 +1405,9 @@ static void llvmpipe_launch_grid(struct pipe_context *pipe,
    memset(&job_info, 0, sizeof(job_info));
 
    llvmpipe_cs_update_derived(llvmpipe, info->input);
+   llvmpipe_flush_shader_resources(llvmpipe, PIPE_SHADER_COMPUTE, "compute");
+   llvmpipe_images_ms_tiles_invalidate(llvmpipe->num_images[PIPE_SHADER_COMPUTE],
+                                       llvmpipe->images[PIPE_SHADER_COMPUTE]);
 
    fill_grid_size(pipe, info, job_info.grid_size);
 
@@ -106,6 +106,9 @@ struct lp_compute_shader {
 
    uint32_t req_local_mem;
 
+   /* Barrier-free shaders are built without coroutines */
+   bool has_barrier;
+
    /* For debugging/profiling purposes */
    unsigned variant_key_size;
    unsigned no;
@@ -3421,6 +3421,8 @@ dump_fs_variant_key(struct lp_fragment_shader_variant_key *key)
                    texture->pot_width,
                    texture->pot_height,
                    texture->pot_depth);
+      debug_printf("  .tiled = %u\n",
+                   texture->tiled);
    }
    struct lp_image_static_state *images = lp_fs_variant_key_images(key);
    for (i = 0; i < key->nr_images; ++i) {
@@ -3476,6 +3478,203 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
    blob_finish(&blob);
 }
 
+/**
+ * Figure out how a variant can use and affects the per-tile depth bounds
+ * the rasterizer keeps for hierarchical-z rejection.
+ */
+static void
+lp_fs_variant_init_hiz(struct lp_fragment_shader_variant *variant)
+{
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct tgsi_shader_info *info = &variant->shader->info.base;
+
+   variant->hiz_test = LP_HIZ_TEST_NONE;
+   variant->hiz_update = LP_HIZ_UPDATE_NONE;
+
+   if (!key->depth.enabled)
+      return;
+
+   /*
+    * Rejecting fragments must not drop any side effect: stencil ops run on
+    * depth failure and shaders may store to memory before the depth test.
+    * Shader-written depth isn't bounded by the interpolated one.
+    */
+   if (!key->stencil[0].enabled &&
+       !info->writes_memory &&
+       !info->writes_z &&
+       !(LP_PERF & PERF_NO_HIZ)) {
+      switch (key->depth.func) {
+      case PIPE_FUNC_LESS:
+      case PIPE_FUNC_LEQUAL:
+         variant->hiz_test = LP_HIZ_TEST_LESS;
+         break;
+      case PIPE_FUNC_GREATER:
+      case PIPE_FUNC_GEQUAL:
+         variant->hiz_test = LP_HIZ_TEST_GREATER;
+         break;
+      default:
+         break;
+      }
+   }
+
+   if (key->depth.writemask) {
+      switch (key->depth.func) {
+      case PIPE_FUNC_NEVER:
+      case PIPE_FUNC_EQUAL:
+         break;
+      case PIPE_FUNC_LESS:
+      case PIPE_FUNC_LEQUAL:
+         variant->hiz_update = LP_HIZ_UPDATE_LOWER;
+         break;
+      case PIPE_FUNC_GREATER:
+      case PIPE_FUNC_GEQUAL:
+         variant->hiz_update = LP_HIZ_UPDATE_RAISE;
+         break;
+      default:
+         variant->hiz_update = LP_HIZ_UPDATE_ANY;
+         break;
+      }
+   }
+}
+
+/**
+ * Figure out whether a variant keeps the samples of multisample color
+ * buffers equal, so that resolves can skip the averaging.
+ */
+static void
+lp_fs_variant_init_ms_tile(struct lp_fragment_shader_variant *variant)
+{
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct tgsi_shader_info *info = &variant->shader->info.base;
+   boolean writes_all;
+   unsigned i;
+
+   /*
+    * Whether every pixel of a fully covered tile gets overwritten without
+    * looking at the previous contents.
+    */
+   writes_all = !key->blend.logicop_enable &&
+                !key->blend.alpha_to_coverage &&
+                !key->alpha.enabled &&
+                !key->depth.enabled &&
+                !key->stencil[0].enabled &&
+                !info->uses_kill &&
+                !info->writes_samplemask;
+   for (i = 0; i < key->nr_cbufs; i++) {
+      if (key->cbuf_format[i] == PIPE_FORMAT_NONE)
+         continue;
+      if (key->blend.rt[i].blend_enable ||
+          !util_format_colormask_full(util_format_description(key->cbuf_format[i]),
+                                      key->blend.rt[i].colormask))
+         writes_all = FALSE;
+   }
+
+   if (!key->multisample) {
+      /* all samples of a pixel get the same value */
+      variant->ms_tile_partial = LP_MS_TILE_KEEP;
+      variant->ms_tile_whole = writes_all ? LP_MS_TILE_SET : LP_MS_TILE_KEEP;
+      return;
+   }
+
+   /*
+    * Partially covered tiles have pixels with partial sample coverage.
+    * Depth/stencil tests and sample masks work per sample, and with sample
+    * shading each sample gets its own color.
+    */
+   variant->ms_tile_partial = LP_MS_TILE_BREAK;
+   if (key->min_samples > 1 ||
+       key->blend.alpha_to_coverage ||
+       key->depth.enabled ||
+       key->stencil[0].enabled ||
+       info->writes_samplemask)
+      variant->ms_tile_whole = LP_MS_TILE_BREAK;
+   else
+      variant->ms_tile_whole = writes_all ? LP_MS_TILE_SET : LP_MS_TILE_KEEP;
+}
+
+/**
+ * Figure out whether rectangles drawn with a variant can be rasterized as
+ * texture copies (see lp_setup_rect.c).  Only the formats where a texel
+ * can be stored into the color buffer without conversion are handled.
+ */
+static void
+lp_fs_variant_init_blit(struct lp_fragment_shader_variant *variant)
+{
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_static_texture_state *texture;
+   const struct lp_static_sampler_state *sampler;
+   const struct pipe_rt_blend_state *blend = &key->blend.rt[0];
+   enum pipe_format tex_format;
+   boolean rgb1;
+
+   variant->blit = LP_FS_BLIT_NONE;
+
+   if (shader->kind == LP_FS_KIND_GENERAL ||
+       (LP_PERF & (PERF_NO_RECT | PERF_NO_TEX | PERF_TEX_MEM | PERF_NO_BLEND)) ||
+       key->nr_cbufs != 1 ||
+       key->nr_samplers < 1 ||
+       key->nr_sampler_views < 1 ||
+       key->multisample ||
+       key->cbuf_nr_samples[0] > 1 ||
+       key->occlusion_count ||
+       key->depth.enabled ||
+       key->stencil[0].enabled ||
+       key->alpha.enabled ||
+       key->blend.logicop_enable ||
+       key->blend.alpha_to_coverage ||
+       key->blend.alpha_to_one ||
+       blend->colormask != PIPE_MASK_RGBA)
+      return;
+
+   texture = &key->samplers[0].texture_state;
+   sampler = &key->samplers[0].sampler_state;
+   if (texture->tiled ||
+       (texture->target != PIPE_TEXTURE_2D &&
+        texture->target != PIPE_TEXTURE_RECT) ||
+       texture->swizzle_r != PIPE_SWIZZLE_X ||
+       texture->swizzle_g != PIPE_SWIZZLE_Y ||
+       texture->swizzle_b != PIPE_SWIZZLE_Z ||
+       (texture->swizzle_a != PIPE_SWIZZLE_W &&
+        texture->swizzle_a != PIPE_SWIZZLE_1) ||
+       sampler->min_mip_filter != PIPE_TEX_MIPFILTER_NONE ||
+       sampler->compare_mode != PIPE_TEX_COMPARE_NONE)
+      return;
+
+   /* the texture must have the color buffer's layout, up to alpha */
+   tex_format = texture->format;
+   rgb1 = shader->kind == LP_FS_KIND_BLIT_RGB1 ||
+          texture->swizzle_a == PIPE_SWIZZLE_1;
+   switch (key->cbuf_format[0]) {
+   case PIPE_FORMAT_B8G8R8A8_UNORM:
+      if (tex_format == PIPE_FORMAT_B8G8R8X8_UNORM)
+         rgb1 = TRUE;
+      else if (tex_format != PIPE_FORMAT_B8G8R8A8_UNORM)
+         return;
+      break;
+   case PIPE_FORMAT_R8G8B8A8_UNORM:
+      if (tex_format == PIPE_FORMAT_R8G8B8X8_UNORM)
+         rgb1 = TRUE;
+      else if (tex_format != PIPE_FORMAT_R8G8B8A8_UNORM)
+         return;
+      break;
+   default:
+      return;
+   }
+
+   if (!blend->blend_enable) {
+      variant->blit = rgb1 ? LP_FS_BLIT_COPY_RGB1 : LP_FS_BLIT_COPY;
+   } else if (blend->rgb_func == PIPE_BLEND_ADD &&
+              blend->alpha_func == PIPE_BLEND_ADD &&
+              blend->rgb_src_factor == PIPE_BLENDFACTOR_ONE &&
+              blend->alpha_src_factor == PIPE_BLENDFACTOR_ONE &&
+              blend->rgb_dst_factor == PIPE_BLENDFACTOR_INV_SRC_ALPHA &&
+              blend->alpha_dst_factor == PIPE_BLENDFACTOR_INV_SRC_ALPHA) {
+      /* premultiplied "over", which degenerates to a copy when opaque */
+      variant->blit = rgb1 ? LP_FS_BLIT_COPY_RGB1 : LP_FS_BLIT_OVER;
+   }
+}
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -3547,6 +3746,10 @@ generate_variant(struct llvmpipe_context *lp,
          !shader->info.base.writes_samplemask
       ? TRUE : FALSE;
 
+   lp_fs_variant_init_hiz(variant);
+   lp_fs_variant_init_ms_tile(variant);
+   lp_fs_variant_init_blit(variant);
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
@@ -3677,6 +3880,9 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
       shader->inputs[i].src_index = i+1;
    }
 
+   if (shader->base.ir.nir)
+      llvmpipe_fs_analyse_nir(shader);
+
    if (LP_DEBUG & DEBUG_TGSI && templ->type == PIPE_SHADER_IR_TGSI) {
       unsigned attrib;
       debug_printf("llvmpipe: Create fragment shader #%u %p:\n",
@@ -4129,8 +4335,8 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1u << (i & 31))) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -4138,8 +4344,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
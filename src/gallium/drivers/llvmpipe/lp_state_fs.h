@@ -135,11 +135,57 @@ struct lp_fs_variant_list_item
 };
 
 
+/**
+ * How a fragment shader variant interacts with the conservative per-tile
+ * depth bounds the rasterizer keeps (see lp_rast_hiz_reject()).
+ */
+enum lp_hiz_test {
+   LP_HIZ_TEST_NONE,     /**< fragments can't be rejected early */
+   LP_HIZ_TEST_LESS,     /**< PIPE_FUNC_LESS or LEQUAL */
+   LP_HIZ_TEST_GREATER,  /**< PIPE_FUNC_GREATER or GEQUAL */
+};
+
+enum lp_hiz_update {
+   LP_HIZ_UPDATE_NONE,   /**< depth values are left alone */
+   LP_HIZ_UPDATE_LOWER,  /**< depth values can only decrease */
+   LP_HIZ_UPDATE_RAISE,  /**< depth values can only increase */
+   LP_HIZ_UPDATE_ANY,    /**< depth values can move either way */
+};
+
+/**
+ * How a fragment shader variant affects the tiles of multisample color
+ * buffers known to have equal samples (see lp_rast_ms_tile_update()).
+ */
+enum lp_ms_tile {
+   LP_MS_TILE_BREAK,     /**< samples of a pixel may end up different */
+   LP_MS_TILE_KEEP,      /**< samples stay equal if they were */
+   LP_MS_TILE_SET,       /**< all samples of all pixels get written equally */
+};
+
+/**
+ * How rectangles drawn with a fragment shader variant may be rasterized as
+ * plain texture copies, bypassing the shader (see lp_setup_rect.c).
+ */
+enum lp_fs_blit {
+   LP_FS_BLIT_NONE,      /**< must go through the shader */
+   LP_FS_BLIT_COPY,      /**< texels are copied as they are */
+   LP_FS_BLIT_COPY_RGB1, /**< texels are copied with alpha set to one */
+   LP_FS_BLIT_OVER,      /**< texels are blended premultiplied over dst */
+};
+
 struct lp_fragment_shader_variant
 {
    struct pipe_reference reference;
    boolean opaque;
 
+   unsigned hiz_test:2;    /**< enum lp_hiz_test */
+   unsigned hiz_update:2;  /**< enum lp_hiz_update */
+
+   unsigned ms_tile_whole:2;    /**< enum lp_ms_tile, for fully covered tiles */
+   unsigned ms_tile_partial:2;  /**< enum lp_ms_tile, for other tiles */
+
+   unsigned blit:2;        /**< enum lp_fs_blit */
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
@@ -164,6 +210,15 @@ struct lp_fragment_shader_variant
 };
 
 
+/**
+ * What a fragment shader does, as far as the rectangle fast path cares.
+ */
+enum lp_fs_kind {
+   LP_FS_KIND_GENERAL,
+   LP_FS_KIND_BLIT_RGBA,  /**< outputs texture unit 0 sampled at an input */
+   LP_FS_KIND_BLIT_RGB1,  /**< same, with alpha replaced by one */
+};
+
 /** Subclass of pipe_shader_state */
 struct lp_fragment_shader
 {
@@ -184,12 +239,18 @@ struct lp_fragment_shader
 
    /** Fragment shader input interpolation info */
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
+
+   enum lp_fs_kind kind;
+   unsigned blit_input;  /**< input holding the texture coords, if not GENERAL */
 };
 
 
 void
 lp_debug_fs_variant(struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_fs_analyse_nir(struct lp_fragment_shader *shader);
+
 void
 llvmpipe_destroy_fs(struct llvmpipe_context *llvmpipe,
                     struct lp_fragment_shader *shader);
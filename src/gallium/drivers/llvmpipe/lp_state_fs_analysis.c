@@ -0,0 +1,270 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Recognize fragment shaders which merely copy a texture, so that screen
+ * aligned rectangles drawn with them can bypass the fragment shader (see
+ * lp_setup_rect.c).
+ */
+
+
+#include "pipe/p_defines.h"
+#include "compiler/nir/nir.h"
+#include "lp_state_fs.h"
+
+
+/**
+ * Whether a value is the first two components of a fragment shader input,
+ * and if so which one.
+ */
+static bool
+get_coord_input(const nir_ssa_def *def, unsigned *input)
+{
+   const nir_instr *instr = def->parent_instr;
+   const nir_intrinsic_instr *intrin;
+   const nir_variable *var;
+   nir_deref_instr *deref;
+
+   if (instr->type == nir_instr_type_alu) {
+      const nir_alu_instr *alu = nir_instr_as_alu(instr);
+      unsigned i;
+
+      if (alu->op == nir_op_mov) {
+         if (alu->src[0].swizzle[0] != 0 || alu->src[0].swizzle[1] != 1)
+            return false;
+      } else if (alu->op == nir_op_vec2) {
+         if (alu->src[0].src.ssa != alu->src[1].src.ssa ||
+             alu->src[0].swizzle[0] != 0 || alu->src[1].swizzle[0] != 1)
+            return false;
+      } else {
+         return false;
+      }
+      if (alu->dest.saturate)
+         return false;
+      for (i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+         if (alu->src[i].abs || alu->src[i].negate)
+            return false;
+      }
+
+      instr = alu->src[0].src.ssa->parent_instr;
+   }
+
+   if (instr->type != nir_instr_type_intrinsic)
+      return false;
+
+   intrin = nir_instr_as_intrinsic(instr);
+   if (intrin->intrinsic != nir_intrinsic_load_deref)
+      return false;
+
+   deref = nir_src_as_deref(intrin->src[0]);
+   if (deref->deref_type != nir_deref_type_var)
+      return false;
+
+   var = deref->var;
+   if (var->data.mode != nir_var_shader_in ||
+       var->data.location_frac != 0 ||
+       var->data.compact ||
+       !(var->data.location >= VARYING_SLOT_VAR0 ||
+         (var->data.location >= VARYING_SLOT_TEX0 &&
+          var->data.location <= VARYING_SLOT_TEX7)))
+      return false;
+
+   *input = var->data.driver_location;
+   return true;
+}
+
+
+/**
+ * Whether a texture instruction plainly samples a 2D texture from unit 0 at
+ * a fragment shader input.
+ */
+static bool
+is_plain_tex(const nir_tex_instr *tex, unsigned *input)
+{
+   int coord = -1;
+   unsigned i;
+
+   if (tex->op != nir_texop_tex ||
+       (tex->sampler_dim != GLSL_SAMPLER_DIM_2D &&
+        tex->sampler_dim != GLSL_SAMPLER_DIM_RECT) ||
+       tex->is_array ||
+       tex->is_shadow ||
+       tex->texture_index != 0 ||
+       tex->sampler_index != 0 ||
+       nir_alu_type_get_base_type(tex->dest_type) != nir_type_float)
+      return false;
+
+   for (i = 0; i < tex->num_srcs; i++) {
+      nir_deref_instr *deref;
+
+      switch (tex->src[i].src_type) {
+      case nir_tex_src_coord:
+         coord = i;
+         break;
+      case nir_tex_src_texture_deref:
+      case nir_tex_src_sampler_deref:
+         deref = nir_src_as_deref(tex->src[i].src);
+         if (deref->deref_type != nir_deref_type_var ||
+             deref->var->data.binding != 0)
+            return false;
+         break;
+      default:
+         return false;
+      }
+   }
+
+   return coord >= 0 &&
+          tex->coord_components == 2 &&
+          get_coord_input(tex->src[coord].src.ssa, input);
+}
+
+
+/**
+ * Whether the value stored to the color output is the result of the
+ * texture instruction, optionally with alpha replaced by one.
+ */
+static enum lp_fs_kind
+get_output_kind(const nir_ssa_def *value, const nir_tex_instr *tex)
+{
+   const nir_alu_instr *alu;
+   unsigned i;
+
+   if (value == &tex->dest.ssa)
+      return LP_FS_KIND_BLIT_RGBA;
+
+   if (value->parent_instr->type != nir_instr_type_alu)
+      return LP_FS_KIND_GENERAL;
+
+   alu = nir_instr_as_alu(value->parent_instr);
+   if (alu->op != nir_op_vec4 || alu->dest.saturate)
+      return LP_FS_KIND_GENERAL;
+
+   for (i = 0; i < 3; i++) {
+      if (alu->src[i].src.ssa != &tex->dest.ssa ||
+          alu->src[i].swizzle[0] != i ||
+          alu->src[i].abs || alu->src[i].negate)
+         return LP_FS_KIND_GENERAL;
+   }
+
+   if (alu->src[3].src.ssa == &tex->dest.ssa &&
+       alu->src[3].swizzle[0] == 3 &&
+       !alu->src[3].abs && !alu->src[3].negate)
+      return LP_FS_KIND_BLIT_RGBA;
+
+   if (nir_src_is_const(alu->src[3].src) &&
+       nir_src_comp_as_float(alu->src[3].src, alu->src[3].swizzle[0]) == 1.0)
+      return LP_FS_KIND_BLIT_RGB1;
+
+   return LP_FS_KIND_GENERAL;
+}
+
+
+/**
+ * Classify a NIR fragment shader, see enum lp_fs_kind.
+ */
+void
+llvmpipe_fs_analyse_nir(struct lp_fragment_shader *shader)
+{
+   nir_shader *nir = shader->base.ir.nir;
+   nir_function_impl *impl;
+   nir_tex_instr *tex = NULL;
+   nir_intrinsic_instr *store = NULL;
+   unsigned input = 0;
+   nir_block *block;
+
+   shader->kind = LP_FS_KIND_GENERAL;
+
+   if (nir->info.fs.uses_discard ||
+       nir->info.fs.uses_demote ||
+       nir->info.outputs_written & ~(BITFIELD64_BIT(FRAG_RESULT_COLOR) |
+                                     BITFIELD64_BIT(FRAG_RESULT_DATA0)))
+      return;
+
+   impl = nir_shader_get_entrypoint(nir);
+   if (!impl || !exec_list_is_singular(&impl->body))
+      return;
+
+   block = nir_start_block(impl);
+   nir_foreach_instr(instr, block) {
+      switch (instr->type) {
+      case nir_instr_type_deref:
+      case nir_instr_type_load_const:
+         break;
+      case nir_instr_type_alu:
+         /* only for swizzling, checked along with their uses below */
+         switch (nir_instr_as_alu(instr)->op) {
+         case nir_op_mov:
+         case nir_op_vec2:
+         case nir_op_vec4:
+            break;
+         default:
+            return;
+         }
+         break;
+      case nir_instr_type_tex:
+         if (tex)
+            return;
+         tex = nir_instr_as_tex(instr);
+         if (!is_plain_tex(tex, &input))
+            return;
+         break;
+      case nir_instr_type_intrinsic: {
+         nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+
+         if (intrin->intrinsic == nir_intrinsic_load_deref) {
+            if (!nir_deref_mode_is(nir_src_as_deref(intrin->src[0]),
+                                   nir_var_shader_in))
+               return;
+            break;
+         }
+         if (intrin->intrinsic != nir_intrinsic_store_deref || store)
+            return;
+         store = intrin;
+         break;
+      }
+      default:
+         return;
+      }
+   }
+
+   if (!tex || !store ||
+       !nir_deref_mode_is(nir_src_as_deref(store->src[0]), nir_var_shader_out) ||
+       nir_intrinsic_write_mask(store) != 0xf ||
+       store->src[1].ssa->num_components != 4)
+      return;
+
+   /* the coords must vary linearly across the primitive */
+   if (input >= shader->info.base.num_inputs ||
+       shader->inputs[input].cyl_wrap ||
+       (shader->inputs[input].interp != LP_INTERP_LINEAR &&
+        shader->inputs[input].interp != LP_INTERP_PERSPECTIVE))
+      return;
+
+   shader->kind = get_output_kind(store->src[1].ssa, tex);
+   shader->blit_input = input;
+}
@@ -258,6 +258,21 @@ llvmpipe_delete_sampler_state(struct pipe_context *pipe,
 }
 
 
+/**
+ * lp_sampler_static_texture_state() plus the llvmpipe specific texture
+ * layout.
+ */
+void
+llvmpipe_sampler_static_texture_state(struct lp_static_texture_state *state,
+                                      const struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+
+   if (view && view->texture)
+      state->tiled = llvmpipe_resource_is_tiled(view->texture);
+}
+
+
 static void
 prepare_shader_sampling(
    struct llvmpipe_context *lp,
@@ -267,14 +282,17 @@ prepare_shader_sampling(
 {
 
    unsigned i;
+   uint32_t tiled_mask = 0;
    uint32_t row_stride[PIPE_MAX_TEXTURE_LEVELS];
    uint32_t img_stride[PIPE_MAX_TEXTURE_LEVELS];
    uint32_t mip_offsets[PIPE_MAX_TEXTURE_LEVELS];
    const void *addr;
 
    assert(num <= PIPE_MAX_SHADER_SAMPLER_VIEWS);
-   if (!num)
+   if (!num) {
+      draw_set_tiled_sampler_views(lp->draw, shader_type, 0);
       return;
+   }
 
    for (i = 0; i < num; i++) {
       struct pipe_sampler_view *view = i < num ? views[i] : NULL;
@@ -355,8 +373,12 @@ prepare_shader_sampling(
                                  num_samples, sample_stride,
                                  addr,
                                  row_stride, img_stride, mip_offsets);
+         if (lp_tex->tiled)
+            tiled_mask |= 1u << i;
       }
    }
+
+   draw_set_tiled_sampler_views(lp->draw, shader_type, tiled_mask);
 }
 
 
@@ -447,6 +469,8 @@ prepare_shader_images(
    if (!num)
       return;
 
+   llvmpipe_images_ms_tiles_invalidate(num, views);
+
    for (i = 0; i < num; i++) {
       struct pipe_image_view *view = i < num ? &views[i] : NULL;
 
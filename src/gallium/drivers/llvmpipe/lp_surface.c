@@ -113,6 +113,128 @@ lp_resource_copy(struct pipe_context *pipe,
 }
 
 
+/**
+ * Resolve a multisample color buffer on the CPU.  Tiles which the
+ * rasterizer left with equal samples (see lp_rast_ms_tile_update()) are
+ * copied from the first sample, only the other ones need all samples.
+ * Returns false if the blit has to go through the blitter instead.
+ */
+static bool
+lp_blit_resolve(struct pipe_context *pipe,
+                const struct pipe_blit_info *info)
+{
+   struct pipe_resource *src = info->src.resource;
+   struct pipe_resource *dst = info->dst.resource;
+   const struct llvmpipe_resource *lpr = llvmpipe_resource(src);
+   const enum pipe_format format = info->src.format;
+   const unsigned nr_samples = util_res_sample_count(src);
+   struct pipe_transfer *src_trans[LP_MAX_SAMPLES];
+   const uint8_t *src_map[LP_MAX_SAMPLES];
+   struct pipe_transfer *dst_trans;
+   uint8_t *dst_map;
+   unsigned bpp, s, x, y, z;
+   bool average;
+
+   if (!lpr->ms_tile_equal ||
+       nr_samples > LP_MAX_SAMPLES ||
+       dst->nr_samples > 1 ||
+       info->dst.format != format ||
+       util_format_description(format)->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       info->mask != PIPE_MASK_RGBA ||
+       info->scissor_enable ||
+       info->num_window_rectangles ||
+       info->alpha_blend ||
+       info->src.box.width != info->dst.box.width ||
+       info->src.box.height != info->dst.box.height ||
+       info->src.box.depth != info->dst.box.depth)
+      return false;
+
+   /* like the blitter, integer formats resolve to the first sample */
+   average = !util_format_is_pure_integer(format);
+   if (average &&
+       (!util_format_unpack_description(format)->unpack_rgba ||
+        !util_format_pack_description(format)->pack_rgba_float))
+      return false;
+
+   for (s = 0; s < nr_samples; s++) {
+      src_map[s] = llvmpipe_transfer_map_ms(pipe, src, 0, PIPE_MAP_READ, s,
+                                            &info->src.box, &src_trans[s]);
+      if (!src_map[s]) {
+         while (s--)
+            pipe->texture_unmap(pipe, src_trans[s]);
+         return false;
+      }
+   }
+
+   dst_map = pipe->texture_map(pipe, dst, info->dst.level, PIPE_MAP_WRITE,
+                               &info->dst.box, &dst_trans);
+   if (!dst_map) {
+      for (s = 0; s < nr_samples; s++)
+         pipe->texture_unmap(pipe, src_trans[s]);
+      return false;
+   }
+
+   bpp = util_format_get_blocksize(format);
+
+   for (z = 0; z < info->src.box.depth; z++) {
+      const unsigned layer = info->src.box.z + z;
+
+      for (y = 0; y < info->src.box.height; y++) {
+         const unsigned ty = (info->src.box.y + y) / TILE_SIZE;
+         const unsigned src_offset = z * src_trans[0]->layer_stride +
+                                     y * src_trans[0]->stride;
+         uint8_t *dst_row = dst_map + z * dst_trans->layer_stride +
+                            y * dst_trans->stride;
+
+         /* go through the row one tile at a time */
+         for (x = 0; x < info->src.box.width; ) {
+            const unsigned sx = info->src.box.x + x;
+            const unsigned span = MIN2(info->src.box.width - x,
+                                       TILE_SIZE - sx % TILE_SIZE);
+            const uint8_t *equal =
+               llvmpipe_resource_ms_tile(lpr, layer, sx / TILE_SIZE, ty);
+
+            if (*equal || !average) {
+               memcpy(dst_row + x * bpp, src_map[0] + src_offset + x * bpp,
+                      span * bpp);
+            } else {
+               float sum[TILE_SIZE][4], texels[TILE_SIZE][4];
+               unsigned i;
+
+               memset(sum, 0, sizeof sum);
+               for (s = 0; s < nr_samples; s++) {
+                  util_format_unpack_rgba(format, texels,
+                                          src_map[s] + src_offset + x * bpp,
+                                          span);
+                  for (i = 0; i < span; i++) {
+                     sum[i][0] += texels[i][0];
+                     sum[i][1] += texels[i][1];
+                     sum[i][2] += texels[i][2];
+                     sum[i][3] += texels[i][3];
+                  }
+               }
+               for (i = 0; i < span; i++) {
+                  sum[i][0] /= nr_samples;
+                  sum[i][1] /= nr_samples;
+                  sum[i][2] /= nr_samples;
+                  sum[i][3] /= nr_samples;
+               }
+               util_format_pack_rgba(format, dst_row + x * bpp, sum, span);
+            }
+
+            x += span;
+         }
+      }
+   }
+
+   pipe->texture_unmap(pipe, dst_trans);
+   for (s = 0; s < nr_samples; s++)
+      pipe->texture_unmap(pipe, src_trans[s]);
+
+   return true;
+}
+
+
 static void lp_blit(struct pipe_context *pipe,
                     const struct pipe_blit_info *blit_info)
 {
@@ -126,6 +248,10 @@ static void lp_blit(struct pipe_context *pipe,
       return; /* done */
    }
 
+   if (lp_blit_resolve(pipe, &info)) {
+      return; /* done */
+   }
+
    if (!util_blitter_is_blit_supported(lp->blitter, &info)) {
       debug_printf("llvmpipe: blit unsupported %s -> %s\n",
                    util_format_short_name(info.src.resource->format),
@@ -188,6 +314,9 @@ llvmpipe_create_surface(struct pipe_context *pipe,
 
    if (!(pt->bind & (PIPE_BIND_DEPTH_STENCIL | PIPE_BIND_RENDER_TARGET))) {
       debug_printf("Illegal surface creation without bind flag\n");
+      /* rendering needs the linear layout */
+      if (!llvmpipe_resource_untile(pipe, pt))
+         return NULL;
       if (util_format_is_depth_or_stencil(surf_tmpl->format)) {
          pt->bind |= PIPE_BIND_DEPTH_STENCIL;
       }
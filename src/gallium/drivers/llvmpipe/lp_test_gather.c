@@ -0,0 +1,343 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Unit tests and throughput measurements for masked gathers and scatters,
+ * as used for shader storage and shared memory accesses.
+ */
+
+
+#include <string.h>
+
+#include "util/u_pointer.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_gather.h"
+#include "gallivm/lp_bld_debug.h"
+#include "lp_test.h"
+
+
+#define ARRAY_ELEMS (4 * LP_MAX_VECTOR_LENGTH)
+
+
+typedef void (*gather_test_ptr_t)(const void *src, void *gathered, void *dst,
+                                  const uint32_t *indices,
+                                  const uint32_t *mask);
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_channel\t"
+           "type\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              struct lp_type type,
+              double cycles,
+              boolean success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+
+   fprintf(fp, "%.1f\t", cycles / type.length);
+
+   dump_type(fp, type);
+   fprintf(fp, "\n");
+
+   fflush(fp);
+}
+
+
+/*
+ * Build
+ *
+ *    gathered = masked_gather(src, indices, mask);
+ *    masked_scatter(dst, indices, gathered, mask);
+ */
+static LLVMValueRef
+add_gather_test(struct gallivm_state *gallivm, struct lp_type type)
+{
+   LLVMModuleRef module = gallivm->module;
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type int_type = lp_type_uint_vec(32, 32 * type.length);
+   LLVMTypeRef int_vec_type = lp_build_vec_type(gallivm, int_type);
+   LLVMTypeRef i8_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+   LLVMTypeRef args[5];
+   LLVMValueRef func;
+   LLVMValueRef indices, mask, gathered;
+   LLVMBasicBlockRef block;
+
+   args[0] = i8_ptr_type;
+   args[1] = LLVMPointerType(lp_build_vec_type(gallivm, type), 0);
+   args[2] = i8_ptr_type;
+   args[3] = LLVMPointerType(int_vec_type, 0);
+   args[4] = LLVMPointerType(int_vec_type, 0);
+
+   func = LLVMAddFunction(module, "test",
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           args, 5, 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   if (type.width * type.length > 256)
+      LLVMAddTargetDependentFunctionAttr(func, "min-legal-vector-width", "512");
+
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   indices = LLVMBuildLoad(builder, LLVMGetParam(func, 3), "");
+   mask = LLVMBuildLoad(builder, LLVMGetParam(func, 4), "");
+
+   gathered = lp_build_masked_gather(gallivm, type, LLVMGetParam(func, 0),
+                                     indices, mask);
+   LLVMBuildStore(builder, gathered, LLVMGetParam(func, 1));
+
+   lp_build_masked_scatter(gallivm, type, LLVMGetParam(func, 2),
+                           indices, gathered, mask);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_one(unsigned verbose,
+         FILE *fp,
+         struct lp_type type)
+{
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   LLVMValueRef func = NULL;
+   gather_test_ptr_t gather_test_ptr;
+   boolean success;
+   const unsigned n = LP_TEST_NUM_SAMPLES;
+   const unsigned elem_size = type.width / 8;
+   int64_t cycles[LP_TEST_NUM_SAMPLES];
+   double cycles_avg = 0.0;
+   unsigned i, j;
+
+   if (verbose >= 1) {
+      dump_type(stderr, type);
+      fprintf(stderr, " ...\n");
+   }
+
+   context = LLVMContextCreate();
+   gallivm = gallivm_create("test_module", context, NULL);
+
+   func = add_gather_test(gallivm, type);
+
+   gallivm_compile_module(gallivm);
+
+   gather_test_ptr = (gather_test_ptr_t)gallivm_jit_function(gallivm, func);
+
+   gallivm_free_ir(gallivm);
+
+   success = TRUE;
+   for (i = 0; i < n && success; ++i) {
+      PIPE_ALIGN_VAR(LP_MIN_VECTOR_ALIGN) uint8_t src[ARRAY_ELEMS * 8];
+      PIPE_ALIGN_VAR(LP_MIN_VECTOR_ALIGN) uint8_t dst[ARRAY_ELEMS * 8];
+      PIPE_ALIGN_VAR(LP_MIN_VECTOR_ALIGN) uint8_t gathered[LP_MAX_VECTOR_LENGTH * 8];
+      PIPE_ALIGN_VAR(LP_MIN_VECTOR_ALIGN) uint32_t indices[LP_MAX_VECTOR_LENGTH];
+      PIPE_ALIGN_VAR(LP_MIN_VECTOR_ALIGN) uint32_t mask[LP_MAX_VECTOR_LENGTH];
+      boolean used[ARRAY_ELEMS];
+      int64_t start_counter = 0;
+      int64_t end_counter = 0;
+
+      for (j = 0; j < sizeof src; ++j)
+         src[j] = rand();
+      memset(dst, 0xa5, sizeof dst);
+      memset(used, 0, sizeof used);
+
+      /* distinct indices, so that the scatter has no conflicting lanes */
+      for (j = 0; j < type.length; ++j) {
+         unsigned idx;
+         do {
+            idx = rand() % ARRAY_ELEMS;
+         } while (used[idx]);
+         used[idx] = TRUE;
+         indices[j] = idx;
+         mask[j] = (rand() & 3) ? ~0u : 0;
+      }
+
+      start_counter = rdtsc();
+      gather_test_ptr(src, gathered, dst, indices, mask);
+      end_counter = rdtsc();
+
+      cycles[i] = end_counter - start_counter;
+
+      for (j = 0; j < type.length; ++j) {
+         const uint8_t *ref = src + indices[j] * elem_size;
+         const uint8_t *res = gathered + j * elem_size;
+         const uint8_t *stored = dst + indices[j] * elem_size;
+         uint8_t untouched[8];
+
+         memset(untouched, 0xa5, sizeof untouched);
+
+         if (mask[j]) {
+            if (memcmp(res, ref, elem_size) || memcmp(stored, ref, elem_size))
+               success = FALSE;
+         } else {
+            uint8_t zero[8] = { 0 };
+            if (memcmp(res, zero, elem_size) ||
+                memcmp(stored, untouched, elem_size))
+               success = FALSE;
+         }
+      }
+
+      if (!success || verbose >= 3) {
+         if (verbose < 1) {
+            dump_type(stderr, type);
+            fprintf(stderr, "\n");
+         }
+         fprintf(stderr, success ? "PASS\n" : "MISMATCH\n");
+
+         fprintf(stderr, "  Indices:");
+         for (j = 0; j < type.length; ++j)
+            fprintf(stderr, " %u%s", indices[j], mask[j] ? "" : "(masked)");
+         fprintf(stderr, "\n");
+
+         fprintf(stderr, "  Gathered: ");
+         dump_vec(stderr, type, gathered);
+         fprintf(stderr, "\n");
+      }
+   }
+
+   /*
+    * Remove outliers from the cycle counts, see lp_test_conv.c.
+    */
+   {
+      double sum = 0.0, sum2 = 0.0;
+      double avg, std;
+      unsigned m;
+
+      for (i = 0; i < n; ++i) {
+         sum += cycles[i];
+         sum2 += cycles[i]*cycles[i];
+      }
+
+      avg = sum/n;
+      std = sqrtf((sum2 - n*avg*avg)/n);
+
+      m = 0;
+      sum = 0.0;
+      for (i = 0; i < n; ++i) {
+         if (fabs(cycles[i] - avg) <= 4.0*std) {
+            sum += cycles[i];
+            ++m;
+         }
+      }
+
+      cycles_avg = sum/m;
+   }
+
+   if (fp)
+      write_tsv_row(fp, type, cycles_avg, success);
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   return success;
+}
+
+
+const struct lp_type gather_types[] = {
+   /* float, fixed,  sign,  norm, width, len */
+   {   TRUE, FALSE,  TRUE, FALSE,    32,   4 },
+   {   TRUE, FALSE,  TRUE, FALSE,    32,   8 },
+   {   TRUE, FALSE,  TRUE, FALSE,    32,  16 },
+
+   {  FALSE, FALSE, FALSE, FALSE,    32,   4 },
+   {  FALSE, FALSE, FALSE, FALSE,    32,   8 },
+   {  FALSE, FALSE, FALSE, FALSE,    32,  16 },
+
+   {  FALSE, FALSE, FALSE, FALSE,    64,   4 },
+   {  FALSE, FALSE, FALSE, FALSE,    64,   8 },
+   {  FALSE, FALSE, FALSE, FALSE,    64,  16 },
+};
+
+
+const unsigned num_types = ARRAY_SIZE(gather_types);
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+   int error_count = 0;
+   unsigned i;
+
+   for (i = 0; i < num_types; ++i) {
+      if (!test_one(verbose, fp, gather_types[i])) {
+         success = FALSE;
+         ++error_count;
+      }
+   }
+
+   fprintf(stderr, "%d failures\n", error_count);
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   unsigned long i;
+   boolean success = TRUE;
+
+   for (i = 0; i < n; ++i) {
+      if (!test_one(verbose, fp, gather_types[rand() % num_types]))
+         success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   /*    float, fixed,  sign,  norm, width, len */
+   struct lp_type f32x16_type =
+      {   TRUE, FALSE,  TRUE, FALSE,    32,  16 };
+
+   return test_one(verbose, fp, f32x16_type);
+}
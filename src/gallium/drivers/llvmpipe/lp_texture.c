@@ -44,6 +44,7 @@
 #include "util/u_transfer.h"
 
 #include "lp_context.h"
+#include "lp_fence.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
@@ -51,6 +52,8 @@
 #include "lp_state.h"
 #include "lp_rast.h"
 
+#include "gallivm/lp_bld_sample.h"
+
 #include "frontend/sw_winsys.h"
 
 #ifndef _WIN32
@@ -65,6 +68,48 @@ static mtx_t resource_list_mutex = _MTX_INITIALIZER_NP;
 static unsigned id_counter = 0;
 
 
+/**
+ * Can the texels of this resource be stored in LP_TEXTURE_TILE_SIZE tiles?
+ * Only textures which are exclusively read through the sampler are tiled,
+ * everything else (rendering, shader images, display) relies on the linear
+ * layout.
+ */
+static bool
+llvmpipe_texture_can_tile(const struct pipe_resource *pt)
+{
+   const struct util_format_description *desc =
+      util_format_description(pt->format);
+
+   if (pt->bind != PIPE_BIND_SAMPLER_VIEW)
+      return false;
+
+   if (pt->usage == PIPE_USAGE_STAGING || pt->usage == PIPE_USAGE_STREAM)
+      return false;
+
+   if (pt->flags & (PIPE_RESOURCE_FLAG_MAP_PERSISTENT |
+                    PIPE_RESOURCE_FLAG_MAP_COHERENT))
+      return false;
+
+   if (pt->nr_samples > 1)
+      return false;
+
+   if (desc->block.width != 1 || desc->block.height != 1)
+      return false;
+
+   switch (pt->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_3D:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      return true;
+   default:
+      return false;
+   }
+}
+
+
 /**
  * Conventional allocation path for non-display textures:
  * Compute strides and allocate data (unless asked not to).
@@ -95,6 +140,13 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
    assert(LP_MAX_TEXTURE_2D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
    assert(LP_MAX_TEXTURE_3D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
 
+   /*
+    * The tiled layout relies on the LP_RASTER_BLOCK_SIZE alignment below
+    * so that a row of tiles fits exactly in LP_TEXTURE_TILE_SIZE rows.
+    */
+   STATIC_ASSERT(LP_TEXTURE_TILE_SIZE == LP_RASTER_BLOCK_SIZE);
+   lpr->tiled = screen->tiled_textures && llvmpipe_texture_can_tile(pt);
+
    for (level = 0; level <= pt->last_level; level++) {
       uint64_t mipsize;
       unsigned align_x, align_y, nblocksx, nblocksy, block_size, num_slices;
@@ -175,6 +227,18 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       }
    }
 
+   if (num_samples > 1 && !util_format_is_depth_or_stencil(pt->format)) {
+      lpr->ms_tiles_x = DIV_ROUND_UP(pt->width0, TILE_SIZE);
+      lpr->ms_tiles_y = DIV_ROUND_UP(pt->height0, TILE_SIZE);
+      lpr->ms_tile_equal = CALLOC(lpr->ms_tiles_x * lpr->ms_tiles_y,
+                                  pt->array_size);
+      if (!lpr->ms_tile_equal) {
+         align_free(lpr->tex_data);
+         lpr->tex_data = NULL;
+         return FALSE;
+      }
+   }
+
    return TRUE;
 
 fail:
@@ -359,6 +423,10 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
             align_free(lpr->data);
       }
    }
+   FREE(lpr->ms_tile_equal);
+   lp_fence_reference(&lpr->read_fence, NULL);
+   lp_fence_reference(&lpr->write_fence, NULL);
+
 #ifdef DEBUG
    mtx_lock(&resource_list_mutex);
    if (lpr->next)
@@ -532,6 +600,157 @@ llvmpipe_resource_get_handle(struct pipe_screen *screen,
 }
 
 
+/**
+ * Copy a box of texels between a tiled texture level and a linear buffer.
+ * Each tile row holds LP_TEXTURE_TILE_SIZE contiguous texels, so this
+ * copies spans of up to that many texels at a time.
+ */
+static void
+llvmpipe_copy_tiled_box(struct llvmpipe_resource *lpr,
+                        unsigned level,
+                        const struct pipe_box *box,
+                        uint8_t *linear,
+                        unsigned linear_stride,
+                        uint64_t linear_layer_stride,
+                        bool to_tiled)
+{
+   const unsigned tile_size = LP_TEXTURE_TILE_SIZE;
+   const unsigned tile_mask = tile_size - 1;
+   const unsigned bpp = util_format_get_blocksize(lpr->base.format);
+   const unsigned row_stride = lpr->row_stride[level];
+   int x, y, z;
+
+   assert(lpr->tiled);
+
+   for (z = 0; z < box->depth; z++) {
+      uint8_t *image = llvmpipe_get_texture_image_address(lpr, box->z + z,
+                                                          level);
+      uint8_t *linear_image = linear + z * linear_layer_stride;
+
+      for (y = 0; y < box->height; y++) {
+         const unsigned ty = box->y + y;
+         uint8_t *tiled_row = image + (ty & ~tile_mask) * row_stride +
+                              (ty & tile_mask) * tile_size * bpp;
+         uint8_t *linear_row = linear_image + y * linear_stride;
+
+         for (x = 0; x < box->width; ) {
+            const unsigned tx = box->x + x;
+            const unsigned span = MIN2(tile_size - (tx & tile_mask),
+                                       box->width - x);
+            uint8_t *tiled = tiled_row +
+               ((tx & ~tile_mask) * tile_size + (tx & tile_mask)) * bpp;
+
+            if (to_tiled)
+               memcpy(tiled, linear_row + x * bpp, span * bpp);
+            else
+               memcpy(linear_row + x * bpp, tiled, span * bpp);
+
+            x += span;
+         }
+      }
+   }
+}
+
+
+/**
+ * Convert a tiled resource back to the linear layout in place.
+ * This is only needed when a sampler-only resource ends up being used
+ * in a way which requires direct access to its texels.
+ * Returns false, leaving the resource tiled, when out of memory.
+ */
+bool
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   unsigned level;
+   uint8_t *tmp;
+
+   if (!lpr->tiled)
+      return true;
+
+   /* The first level is the largest, allocate before touching any level */
+   tmp = MALLOC(lpr->img_stride[0] *
+                (resource->target == PIPE_TEXTURE_3D ?
+                    resource->depth0 : resource->array_size));
+   if (!tmp)
+      return false;
+
+   llvmpipe_flush_resource(pipe, resource, 0,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           __FUNCTION__);
+
+   for (level = 0; level <= resource->last_level; level++) {
+      struct pipe_box box;
+      uint64_t size;
+
+      u_box_3d(0, 0, 0,
+               u_minify(resource->width0, level),
+               u_minify(resource->height0, level),
+               resource->target == PIPE_TEXTURE_3D ?
+                  u_minify(resource->depth0, level) : resource->array_size,
+               &box);
+
+      size = lpr->img_stride[level] * box.depth;
+      llvmpipe_copy_tiled_box(lpr, level, &box, tmp,
+                              lpr->row_stride[level], lpr->img_stride[level],
+                              false);
+      memcpy(llvmpipe_get_texture_image_address(lpr, 0, level), tmp, size);
+   }
+   FREE(tmp);
+
+   lpr->tiled = false;
+
+   /* Shaders sampling this resource need to be rebuilt, in every context
+    * which may have it bound.
+    */
+   p_atomic_inc(&screen->tiled_generation);
+   llvmpipe_check_tiled_generation(llvmpipe);
+   return true;
+}
+
+
+/**
+ * Pick up resources untiled by any context since the last check.
+ * Called on state validation.
+ */
+void
+llvmpipe_check_tiled_generation(struct llvmpipe_context *llvmpipe)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(llvmpipe->pipe.screen);
+   unsigned generation = p_atomic_read(&screen->tiled_generation);
+
+   if (llvmpipe->tiled_generation != generation) {
+      llvmpipe->tiled_generation = generation;
+      llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
+      llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+   }
+}
+
+
+/**
+ * Shader image stores bypass the rasterizer, so multisample images which
+ * may be written can't be trusted to have equal samples anymore.
+ */
+void
+llvmpipe_images_ms_tiles_invalidate(unsigned num,
+                                    const struct pipe_image_view *images)
+{
+   unsigned i;
+
+   for (i = 0; i < num; i++) {
+      if (images[i].resource &&
+          images[i].resource->nr_samples > 1 &&
+          (images[i].access & PIPE_IMAGE_ACCESS_WRITE))
+         llvmpipe_resource_ms_tiles_invalidate(images[i].resource);
+   }
+}
+
+
 void *
 llvmpipe_transfer_map_ms( struct pipe_context *pipe,
                           struct pipe_resource *resource,
@@ -575,6 +794,9 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
       }
    }
 
+   if (usage & PIPE_MAP_WRITE)
+      llvmpipe_resource_ms_tiles_invalidate(resource);
+
    /* Check if we're mapping a current constant buffer */
    if ((usage & PIPE_MAP_WRITE) &&
        (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
@@ -625,6 +847,46 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
 
    format = lpr->base.format;
 
+   if (lpr->tiled) {
+      /*
+       * Hand out a linear copy of the box, which gets written back to the
+       * tiled texture when unmapping.
+       */
+      uint64_t size;
+
+      assert(sample == 0);
+
+      if (usage & PIPE_MAP_DIRECTLY) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
+      pt->stride = align(box->width * util_format_get_blocksize(format), 16);
+      pt->layer_stride = (uint64_t)pt->stride * box->height;
+      size = pt->layer_stride * box->depth;
+
+      lpt->staging = align_malloc(size, 16);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_MAP_DISCARD_RANGE |
+                     PIPE_MAP_DISCARD_WHOLE_RESOURCE))) {
+         llvmpipe_copy_tiled_box(lpr, level, box, lpt->staging,
+                                 pt->stride, pt->layer_stride, false);
+      }
+
+      if (usage & PIPE_MAP_WRITE)
+         screen->timestamp++;
+
+      return lpt->staging;
+   }
+
    map = llvmpipe_resource_map(resource,
                                level,
                                box->z,
@@ -663,11 +925,26 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
+
    assert(transfer->resource);
 
-   llvmpipe_resource_unmap(transfer->resource,
-                           transfer->level,
-                           transfer->box.z);
+   if (lpt->staging) {
+      struct llvmpipe_resource *lpr = llvmpipe_resource(transfer->resource);
+
+      if (transfer->usage & PIPE_MAP_WRITE) {
+         llvmpipe_copy_tiled_box(lpr, transfer->level, &transfer->box,
+                                 lpt->staging,
+                                 transfer->stride, transfer->layer_stride,
+                                 true);
+      }
+      align_free(lpt->staging);
+   }
+   else {
+      llvmpipe_resource_unmap(transfer->resource,
+                              transfer->level,
+                              transfer->box.z);
+   }
 
    /* Effectively do the texture_update work here - if texture images
     * needed post-processing to put them into hardware layout, this is
@@ -843,6 +1120,7 @@ static bool llvmpipe_resource_bind_backing(struct pipe_screen *screen,
          return FALSE;
 
       lpr->tex_data = (char *)pmem + offset;
+      llvmpipe_resource_ms_tiles_invalidate(pt);
    } else
       lpr->data = (char *)pmem + offset;
    lpr->backing_offset = offset;
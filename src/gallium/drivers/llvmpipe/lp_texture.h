@@ -29,6 +29,8 @@
 #define LP_TEXTURE_H
 
 
+#include <string.h>
+
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
 #include "lp_limits.h"
@@ -46,6 +48,7 @@ struct pipe_context;
 struct pipe_screen;
 struct llvmpipe_context;
 struct llvmpipe_screen;
+struct lp_fence;
 
 struct sw_displaytarget;
 
@@ -99,6 +102,31 @@ struct llvmpipe_resource
    uint64_t size_required;
    uint64_t backing_offset;
    bool backable;
+
+   /**
+    * Texels are stored in LP_TEXTURE_TILE_SIZE x LP_TEXTURE_TILE_SIZE tiles
+    * instead of linearly.  Only ever set for sampler-only resources; the
+    * tiled layout uses the same strides and size as the linear one.
+    */
+   bool tiled;
+
+   /**
+    * For multisample color textures, one byte per TILE_SIZE x TILE_SIZE
+    * tile of each layer, set when all samples of every pixel in the tile
+    * are known to be equal.  Only the rasterizer sets these (see
+    * lp_rast_ms_tile_update()), any other write clears them.  Resolves
+    * read a single sample for such tiles.
+    */
+   uint8_t *ms_tile_equal;
+   unsigned ms_tiles_x, ms_tiles_y;
+
+   /**
+    * Fences of the last flushed scenes, of any context, which referenced
+    * respectively wrote the resource.  Protected by the screen's
+    * rast_mutex, see lp_scene_fence_resources().
+    */
+   struct lp_fence *read_fence;
+   struct lp_fence *write_fence;
 #ifdef DEBUG
    /** for linked list */
    struct llvmpipe_resource *prev, *next;
@@ -111,6 +139,9 @@ struct llvmpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the mapped box, for tiled resources */
+   void *staging;
 };
 
 
@@ -210,6 +241,47 @@ llvmpipe_sample_stride(struct pipe_resource *resource)
    return lpr->sample_stride;
 }
 
+static inline bool
+llvmpipe_resource_is_tiled(const struct pipe_resource *resource)
+{
+   return llvmpipe_resource_const(resource)->tiled;
+}
+
+bool
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource);
+
+void
+llvmpipe_check_tiled_generation(struct llvmpipe_context *llvmpipe);
+
+static inline uint8_t *
+llvmpipe_resource_ms_tile(const struct llvmpipe_resource *lpr,
+                          unsigned layer, unsigned tx, unsigned ty)
+{
+   assert(lpr->ms_tile_equal);
+   assert(tx < lpr->ms_tiles_x && ty < lpr->ms_tiles_y);
+   return lpr->ms_tile_equal +
+          (layer * lpr->ms_tiles_y + ty) * lpr->ms_tiles_x + tx;
+}
+
+/**
+ * Forget which tiles have equal samples, after the resource got written
+ * by something other than the rasterizer.
+ */
+static inline void
+llvmpipe_resource_ms_tiles_invalidate(struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+
+   if (lpr->ms_tile_equal)
+      memset(lpr->ms_tile_equal, 0,
+             lpr->ms_tiles_x * lpr->ms_tiles_y * lpr->base.array_size);
+}
+
+void
+llvmpipe_images_ms_tiles_invalidate(unsigned num,
+                                    const struct pipe_image_view *images);
+
 void *
 llvmpipe_resource_map(struct pipe_resource *resource,
                       unsigned level,
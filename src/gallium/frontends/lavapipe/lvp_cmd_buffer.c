@@ -44,6 +44,8 @@ static VkResult lvp_create_cmd_buffer(
    cmd_buffer->pool = pool;
    list_inithead(&cmd_buffer->cmds);
    cmd_buffer->last_emit = &cmd_buffer->cmds;
+   list_inithead(&cmd_buffer->cmd_blocks);
+   cmd_buffer->cur_block = NULL;
    cmd_buffer->status = LVP_CMD_BUFFER_STATUS_INITIAL;
    if (pool) {
       list_addtail(&cmd_buffer->pool_link, &pool->cmd_buffers);
@@ -58,19 +60,34 @@ static VkResult lvp_create_cmd_buffer(
    return VK_SUCCESS;
 }
 
+/**
+ * Drop all recorded commands.  Unless release_resources is set, the
+ * arena blocks are kept and rewound so re-recording doesn't allocate.
+ */
 static void
-lvp_cmd_buffer_free_all_cmds(struct lvp_cmd_buffer *cmd_buffer)
-{
-   struct lvp_cmd_buffer_entry *tmp, *cmd;
-   LIST_FOR_EACH_ENTRY_SAFE(cmd, tmp, &cmd_buffer->cmds, cmd_link) {
-      list_del(&cmd->cmd_link);
-      vk_free(&cmd_buffer->pool->alloc, cmd);
+lvp_cmd_buffer_free_all_cmds(struct lvp_cmd_buffer *cmd_buffer,
+                             bool release_resources)
+{
+   if (release_resources) {
+      list_for_each_entry_safe(struct lvp_cmd_block, block,
+                               &cmd_buffer->cmd_blocks, link) {
+         list_del(&block->link);
+         vk_free(&cmd_buffer->pool->alloc, block);
+      }
+      cmd_buffer->cur_block = NULL;
+   } else {
+      list_for_each_entry(struct lvp_cmd_block, block,
+                          &cmd_buffer->cmd_blocks, link)
+         block->used = 0;
+      cmd_buffer->cur_block = list_is_empty(&cmd_buffer->cmd_blocks) ? NULL :
+         list_first_entry(&cmd_buffer->cmd_blocks, struct lvp_cmd_block, link);
    }
 }
 
-static VkResult lvp_reset_cmd_buffer(struct lvp_cmd_buffer *cmd_buffer)
+static VkResult lvp_reset_cmd_buffer(struct lvp_cmd_buffer *cmd_buffer,
+                                     bool release_resources)
 {
-   lvp_cmd_buffer_free_all_cmds(cmd_buffer);
+   lvp_cmd_buffer_free_all_cmds(cmd_buffer, release_resources);
    list_inithead(&cmd_buffer->cmds);
    cmd_buffer->last_emit = &cmd_buffer->cmds;
    cmd_buffer->status = LVP_CMD_BUFFER_STATUS_INITIAL;
@@ -96,7 +113,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_AllocateCommandBuffers(
          list_del(&cmd_buffer->pool_link);
          list_addtail(&cmd_buffer->pool_link, &pool->cmd_buffers);
 
-         result = lvp_reset_cmd_buffer(cmd_buffer);
+         result = lvp_reset_cmd_buffer(cmd_buffer, false);
          cmd_buffer->level = pAllocateInfo->level;
          vk_object_base_reset(&cmd_buffer->base);
 
@@ -122,7 +139,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_AllocateCommandBuffers(
 static void
 lvp_cmd_buffer_destroy(struct lvp_cmd_buffer *cmd_buffer)
 {
-   lvp_cmd_buffer_free_all_cmds(cmd_buffer);
+   lvp_cmd_buffer_free_all_cmds(cmd_buffer, true);
    list_del(&cmd_buffer->pool_link);
    vk_object_base_finish(&cmd_buffer->base);
    vk_free(&cmd_buffer->pool->alloc, cmd_buffer);
@@ -153,7 +170,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_ResetCommandBuffer(
 {
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
-   return lvp_reset_cmd_buffer(cmd_buffer);
+   return lvp_reset_cmd_buffer(cmd_buffer,
+                               flags & VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_BeginCommandBuffer(
@@ -163,7 +181,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_BeginCommandBuffer(
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
    VkResult result;
    if (cmd_buffer->status != LVP_CMD_BUFFER_STATUS_INITIAL) {
-      result = lvp_reset_cmd_buffer(cmd_buffer);
+      result = lvp_reset_cmd_buffer(cmd_buffer, false);
       if (result != VK_SUCCESS)
          return result;
    }
@@ -243,7 +261,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_ResetCommandPool(
 
    list_for_each_entry(struct lvp_cmd_buffer, cmd_buffer,
                        &pool->cmd_buffers, pool_link) {
-      result = lvp_reset_cmd_buffer(cmd_buffer);
+      result = lvp_reset_cmd_buffer(cmd_buffer,
+                                    flags & VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
       if (result != VK_SUCCESS)
          return result;
    }
@@ -266,15 +285,56 @@ VKAPI_ATTR void VKAPI_CALL lvp_TrimCommandPool(
    }
 }
 
+/**
+ * Bump allocate from the command buffer's arena, moving on to the next
+ * block (reused after a reset, or newly allocated) when the current one
+ * is full.
+ */
+static void *cmd_buf_arena_alloc(struct lvp_cmd_buffer *cmd_buffer,
+                                 uint32_t size)
+{
+   struct lvp_cmd_block *block = cmd_buffer->cur_block;
+   void *ptr;
+
+   size = align(size, 8);
+
+   if (!block || block->size - block->used < size) {
+      struct lvp_cmd_block *next = NULL;
+
+      if (block && block->link.next != &cmd_buffer->cmd_blocks)
+         next = LIST_ENTRY(struct lvp_cmd_block, block->link.next, link);
+
+      if (!next || next->size < size) {
+         uint32_t block_size = MAX2(size, LVP_CMD_BLOCK_SIZE);
+
+         next = vk_alloc(&cmd_buffer->pool->alloc,
+                         sizeof(*next) + block_size,
+                         8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         if (!next)
+            return NULL;
+
+         next->size = block_size;
+         next->used = 0;
+         if (block)
+            list_add(&next->link, &block->link);
+         else
+            list_add(&next->link, &cmd_buffer->cmd_blocks);
+      }
+      block = cmd_buffer->cur_block = next;
+   }
+
+   ptr = block->data + block->used;
+   block->used += size;
+   return ptr;
+}
+
 static struct lvp_cmd_buffer_entry *cmd_buf_entry_alloc_size(struct lvp_cmd_buffer *cmd_buffer,
                                                              uint32_t extra_size,
                                                              enum lvp_cmds type)
 {
    struct lvp_cmd_buffer_entry *cmd;
    uint32_t cmd_size = sizeof(*cmd) + extra_size;
-   cmd = vk_alloc(&cmd_buffer->pool->alloc,
-                  cmd_size,
-                  8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   cmd = cmd_buf_arena_alloc(cmd_buffer, cmd_size);
    if (!cmd)
       return NULL;
 
@@ -34,6 +34,7 @@
 #include "util/os_memory.h"
 #include "util/u_thread.h"
 #include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
 #include "util/timespec.h"
 #include "os_time.h"
 
@@ -122,6 +123,7 @@ static const struct vk_device_extension_table lvp_device_extensions_supported =
 #ifdef LVP_USE_WSI_PLATFORM
    .KHR_swapchain                         = true,
 #endif
+   .KHR_timeline_semaphore                = true,
    .KHR_uniform_buffer_standard_layout    = true,
    .KHR_variable_pointers                 = true,
    .EXT_calibrated_timestamps             = true,
@@ -131,6 +133,7 @@ static const struct vk_device_extension_table lvp_device_extensions_supported =
    .EXT_host_query_reset                  = true,
    .EXT_index_type_uint8                  = true,
    .EXT_multi_draw                        = true,
+   .EXT_pipeline_creation_cache_control   = true,
    .EXT_post_depth_coverage               = true,
    .EXT_private_data                      = true,
    .EXT_sampler_filter_minmax             = true,
@@ -509,6 +512,12 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceFeatures2(
          CORE_FEATURE(1, 1, storageInputOutput16);
          break;
       }
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_CREATION_CACHE_CONTROL_FEATURES_EXT: {
+         VkPhysicalDevicePipelineCreationCacheControlFeaturesEXT *features =
+            (VkPhysicalDevicePipelineCreationCacheControlFeaturesEXT *)ext;
+         features->pipelineCreationCacheControl = true;
+         break;
+      }
       case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRIVATE_DATA_FEATURES_EXT: {
          VkPhysicalDevicePrivateDataFeaturesEXT *features =
             (VkPhysicalDevicePrivateDataFeaturesEXT *)ext;
@@ -620,6 +629,12 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceFeatures2(
          features->shaderSharedInt64Atomics = true;
          break;
       }
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES: {
+         VkPhysicalDeviceTimelineSemaphoreFeatures *features =
+            (VkPhysicalDeviceTimelineSemaphoreFeatures *)ext;
+         features->timelineSemaphore = true;
+         break;
+      }
       case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGELESS_FRAMEBUFFER_FEATURES: {
          VkPhysicalDeviceImagelessFramebufferFeatures *features =
             (VkPhysicalDeviceImagelessFramebufferFeatures*)ext;
@@ -811,6 +826,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceProperties(VkPhysicalDevice phys
 }
 
 extern unsigned lp_native_vector_width;
+extern unsigned lp_compute_vector_width;
 static void
 lvp_get_physical_device_properties_1_1(struct lvp_physical_device *pdevice,
                                        VkPhysicalDeviceVulkan11Properties *p)
@@ -824,8 +840,11 @@ lvp_get_physical_device_properties_1_1(struct lvp_physical_device *pdevice,
    p->deviceLUIDValid = false;
    p->deviceNodeMask = 0;
 
-   p->subgroupSize = lp_native_vector_width / 32;
-   p->subgroupSupportedStages = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+   p->subgroupSize = lp_compute_vector_width / 32;
+   p->subgroupSupportedStages = VK_SHADER_STAGE_COMPUTE_BIT;
+   /* fragment shaders keep the native width when compute runs wider */
+   if (lp_compute_vector_width == lp_native_vector_width)
+      p->subgroupSupportedStages |= VK_SHADER_STAGE_FRAGMENT_BIT;
    p->subgroupSupportedOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_VOTE_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
    p->subgroupQuadOperationsInAllStages = false;
 
@@ -948,6 +967,12 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceProperties2(
          properties->filterMinmaxSingleComponentFormats = true;
          break;
       }
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_PROPERTIES: {
+         VkPhysicalDeviceTimelineSemaphoreProperties *properties =
+            (VkPhysicalDeviceTimelineSemaphoreProperties *)ext;
+         properties->maxTimelineSemaphoreValueDifference = UINT64_MAX;
+         break;
+      }
       case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_LINE_RASTERIZATION_PROPERTIES_EXT: {
          VkPhysicalDeviceLineRasterizationPropertiesEXT *properties =
             (VkPhysicalDeviceLineRasterizationPropertiesEXT *)ext;
@@ -993,14 +1018,19 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceProperties2(
    }
 }
 
+static const VkQueueFlags lvp_queue_family_flags[LVP_QUEUE_FAMILY_COUNT] = {
+   VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT,
+   /* dedicated compute/transfer family */
+   VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT,
+};
+
 static void lvp_get_physical_device_queue_family_properties(
+   uint32_t                                    family,
    VkQueueFamilyProperties*                    pQueueFamilyProperties)
 {
    *pQueueFamilyProperties = (VkQueueFamilyProperties) {
-      .queueFlags = VK_QUEUE_GRAPHICS_BIT |
-      VK_QUEUE_COMPUTE_BIT |
-      VK_QUEUE_TRANSFER_BIT,
-      .queueCount = 1,
+      .queueFlags = lvp_queue_family_flags[family],
+      .queueCount = LVP_MAX_QUEUES_PER_FAMILY,
       .timestampValidBits = 64,
       .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
    };
@@ -1012,12 +1042,13 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties(
    VkQueueFamilyProperties*                    pQueueFamilyProperties)
 {
    if (pQueueFamilyProperties == NULL) {
-      *pCount = 1;
+      *pCount = LVP_QUEUE_FAMILY_COUNT;
       return;
    }
 
-   assert(*pCount >= 1);
-   lvp_get_physical_device_queue_family_properties(pQueueFamilyProperties);
+   *pCount = MIN2(*pCount, LVP_QUEUE_FAMILY_COUNT);
+   for (uint32_t i = 0; i < *pCount; i++)
+      lvp_get_physical_device_queue_family_properties(i, &pQueueFamilyProperties[i]);
 }
 
 VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
@@ -1026,12 +1057,13 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
    VkQueueFamilyProperties2                   *pQueueFamilyProperties)
 {
    if (pQueueFamilyProperties == NULL) {
-      *pCount = 1;
+      *pCount = LVP_QUEUE_FAMILY_COUNT;
       return;
    }
 
-   assert(*pCount >= 1);
-   lvp_get_physical_device_queue_family_properties(&pQueueFamilyProperties->queueFamilyProperties);
+   *pCount = MIN2(*pCount, LVP_QUEUE_FAMILY_COUNT);
+   for (uint32_t i = 0; i < *pCount; i++)
+      lvp_get_physical_device_queue_family_properties(i, &pQueueFamilyProperties[i].queueFamilyProperties);
 }
 
 VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceMemoryProperties(
@@ -1108,9 +1140,73 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vk_icdGetPhysicalDeviceProcAddr(
    return vk_instance_get_physical_device_proc_addr(&instance->vk, pName);
 }
 
+static bool
+semaphore_op_done(const struct lvp_semaphore_op *op)
+{
+   return op->semaphore->value >= op->value;
+}
+
+/* Block until all the semaphores a task waits on have been signaled,
+ * possibly by another queue's thread or by the host.
+ */
+static void
+queue_wait_semaphores(struct lvp_queue *queue, struct lvp_queue_work *task)
+{
+   struct lvp_device *device = queue->device;
+
+   if (!task->wait_count)
+      return;
+
+   mtx_lock(&device->semaphore_lock);
+   for (unsigned i = 0; i < task->wait_count; i++) {
+      while (!semaphore_op_done(&task->waits[i]) && !queue->shutdown)
+         u_cnd_monotonic_wait(&device->semaphore_cond, &device->semaphore_lock);
+   }
+   mtx_unlock(&device->semaphore_lock);
+}
+
+static void
+queue_signal_semaphores(struct lvp_queue *queue, struct lvp_queue_work *task)
+{
+   struct lvp_device *device = queue->device;
+
+   mtx_lock(&device->semaphore_lock);
+   for (unsigned i = 0; i < task->signal_count; i++) {
+      struct lvp_semaphore *sema = task->signals[i].semaphore;
+      sema->value = MAX2(sema->value, task->signals[i].value);
+   }
+   u_cnd_monotonic_broadcast(&device->semaphore_cond);
+   mtx_unlock(&device->semaphore_lock);
+}
+
+static void
+queue_signal_fence(struct lvp_queue *queue, struct lvp_fence *fence,
+                   struct pipe_fence_handle *handle)
+{
+   struct lvp_device *device = queue->device;
+
+   mtx_lock(&device->fence_lock);
+   if (handle)
+      device->pscreen->fence_reference(device->pscreen, &fence->handle, handle);
+   else
+      fence->signaled = true;
+   u_cnd_monotonic_broadcast(&device->fence_cond);
+   mtx_unlock(&device->fence_lock);
+}
+
+/* Called with the queue mutex held, on the queue thread */
+static void
+queue_delete_csos(struct lvp_queue *queue)
+{
+   util_dynarray_foreach(&queue->deleted_csos, struct lvp_deleted_cso, deleted)
+      lvp_delete_shader_cso(queue->ctx, deleted->stage, deleted->cso);
+   util_dynarray_clear(&queue->deleted_csos);
+}
+
 static int queue_thread(void *data)
 {
    struct lvp_queue *queue = data;
+   struct pipe_screen *pscreen = queue->device->pscreen;
 
    mtx_lock(&queue->m);
    while (!queue->shutdown) {
@@ -1121,25 +1217,41 @@ static int queue_thread(void *data)
       if (queue->shutdown)
          break;
 
+      queue_delete_csos(queue);
+
       task = list_first_entry(&queue->workqueue, struct lvp_queue_work,
                               list);
 
       mtx_unlock(&queue->m);
+      queue_wait_semaphores(queue, task);
+
       //execute
       for (unsigned i = 0; i < task->cmd_buffer_count; i++) {
          lvp_execute_cmds(queue->device, queue, task->cmd_buffers[i]);
       }
 
-      if (task->cmd_buffer_count) {
-         struct pipe_fence_handle *handle = NULL;
-         queue->ctx->flush(queue->ctx, task->fence ? &handle : NULL, 0);
-         if (task->fence) {
-            mtx_lock(&queue->device->fence_lock);
-            task->fence->handle = handle;
-            mtx_unlock(&queue->device->fence_lock);
-         }
-      } else if (task->fence)
-         task->fence->signaled = true;
+      /* Also get a handle for empty batches, which must not signal before
+       * the rendering of earlier batches is complete.
+       */
+      struct pipe_fence_handle *handle = NULL;
+      bool need_handle = task->fence || task->signal_count;
+      if (task->cmd_buffer_count || need_handle)
+         queue->ctx->flush(queue->ctx, need_handle ? &handle : NULL, 0);
+
+      /* Another queue may consume the results as soon as the semaphores
+       * are signaled, so the rendering has to be complete by then.
+       */
+      if (task->signal_count) {
+         if (handle)
+            pscreen->fence_finish(pscreen, NULL, handle, PIPE_TIMEOUT_INFINITE);
+         queue_signal_semaphores(queue, task);
+      }
+
+      if (task->fence)
+         queue_signal_fence(queue, task->fence, handle);
+      if (handle)
+         pscreen->fence_reference(pscreen, &handle, NULL);
+
       p_atomic_dec(&queue->count);
       mtx_lock(&queue->m);
       list_del(&task->list);
@@ -1150,16 +1262,25 @@ static int queue_thread(void *data)
 }
 
 static VkResult
-lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue)
+lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
+               const VkDeviceQueueCreateInfo *create_info,
+               uint32_t queue_index)
 {
    queue->device = device;
 
-   queue->flags = 0;
+   queue->flags = create_info ? create_info->flags : 0;
+   queue->family_index = create_info ? create_info->queueFamilyIndex : 0;
+   queue->queue_index = queue_index;
+   queue->index = queue - device->queues;
    queue->ctx = device->pscreen->context_create(device->pscreen, NULL, PIPE_CONTEXT_ROBUST_BUFFER_ACCESS);
+   if (!queue->ctx)
+      return VK_ERROR_INITIALIZATION_FAILED;
    queue->cso = cso_create_context(queue->ctx, CSO_NO_VBUF);
    list_inithead(&queue->workqueue);
+   util_dynarray_init(&queue->deleted_csos, NULL);
    p_atomic_set(&queue->count, 0);
    mtx_init(&queue->m, mtx_plain);
+   cnd_init(&queue->new_work);
    queue->exec_thread = u_thread_create(queue_thread, queue);
 
    vk_object_base_init(&device->vk, &queue->base, VK_OBJECT_TYPE_QUEUE);
@@ -1169,17 +1290,31 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue)
 static void
 lvp_queue_finish(struct lvp_queue *queue)
 {
+   struct lvp_device *device = queue->device;
+
    mtx_lock(&queue->m);
    queue->shutdown = true;
    cnd_broadcast(&queue->new_work);
    mtx_unlock(&queue->m);
 
+   /* wake the thread up if it is blocked on a semaphore */
+   mtx_lock(&device->semaphore_lock);
+   u_cnd_monotonic_broadcast(&device->semaphore_cond);
+   mtx_unlock(&device->semaphore_lock);
+
    thrd_join(queue->exec_thread, NULL);
 
+   list_for_each_entry_safe(struct lvp_queue_work, task, &queue->workqueue, list)
+      free(task);
+
+   queue_delete_csos(queue);
+   util_dynarray_fini(&queue->deleted_csos);
+
    cnd_destroy(&queue->new_work);
    mtx_destroy(&queue->m);
    cso_destroy_context(queue->cso);
    queue->ctx->destroy(queue->ctx);
+   vk_object_base_finish(&queue->base);
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
@@ -1231,9 +1366,48 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
    device->physical_device = physical_device;
 
    mtx_init(&device->fence_lock, mtx_plain);
+   u_cnd_monotonic_init(&device->fence_cond);
+   mtx_init(&device->semaphore_lock, mtx_plain);
+   u_cnd_monotonic_init(&device->semaphore_cond);
    device->pscreen = physical_device->pscreen;
 
-   lvp_queue_init(device, &device->queue);
+   /* The first queue of family 0 is always created, its context owns the
+    * pipeline CSOs.  Every other queue gets its own context and thread.
+    */
+   result = lvp_queue_init(device, &device->queues[0], NULL, 0);
+   if (result == VK_SUCCESS)
+      device->num_queues = 1;
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount && result == VK_SUCCESS; i++) {
+      const VkDeviceQueueCreateInfo *queue_create = &pCreateInfo->pQueueCreateInfos[i];
+
+      for (uint32_t q = 0; q < queue_create->queueCount; q++) {
+         if (queue_create->queueFamilyIndex == 0 && q == 0) {
+            device->queues[0].flags = queue_create->flags;
+            continue;
+         }
+         result = lvp_queue_init(device, &device->queues[device->num_queues],
+                                 queue_create, q);
+         if (result != VK_SUCCESS)
+            break;
+         device->num_queues++;
+      }
+   }
+
+   if (result != VK_SUCCESS) {
+      for (unsigned i = 0; i < device->num_queues; i++)
+         lvp_queue_finish(&device->queues[i]);
+      vk_device_finish(&device->vk);
+      vk_free(&device->vk.alloc, device);
+      return vk_error(instance, result);
+   }
+
+   /* If this fails, pipelines are simply compiled on the calling thread. */
+   unsigned num_cpus = util_get_cpu_caps()->nr_cpus;
+   if (num_cpus > 1)
+      util_queue_init(&device->compile_queue, "lvp_compile", 32, num_cpus,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                      UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY |
+                      UTIL_QUEUE_INIT_SCALE_THREADS, NULL);
 
    *pDevice = lvp_device_to_handle(device);
 
@@ -1247,7 +1421,14 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
 
-   lvp_queue_finish(&device->queue);
+   if (util_queue_is_initialized(&device->compile_queue))
+      util_queue_destroy(&device->compile_queue);
+   for (unsigned i = 0; i < device->num_queues; i++)
+      lvp_queue_finish(&device->queues[i]);
+   u_cnd_monotonic_destroy(&device->semaphore_cond);
+   mtx_destroy(&device->semaphore_lock);
+   u_cnd_monotonic_destroy(&device->fence_cond);
+   mtx_destroy(&device->fence_lock);
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
 }
@@ -1297,10 +1478,17 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetDeviceQueue2(
    VkQueue*                                    pQueue)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   struct lvp_queue *queue;
+   struct lvp_queue *queue = NULL;
+
+   for (unsigned i = 0; i < device->num_queues; i++) {
+      if (device->queues[i].family_index == pQueueInfo->queueFamilyIndex &&
+          device->queues[i].queue_index == pQueueInfo->queueIndex) {
+         queue = &device->queues[i];
+         break;
+      }
+   }
 
-   queue = &device->queue;
-   if (pQueueInfo->flags != queue->flags) {
+   if (!queue || pQueueInfo->flags != queue->flags) {
       /* From the Vulkan 1.1.70 spec:
        *
        * "The queue returned by vkGetDeviceQueue2 must have the same
@@ -1333,6 +1521,34 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetDeviceQueue(
 }
 
 
+/* Resolve the payload a semaphore operation waits for or signals.  Binary
+ * semaphores are numbered in submission order so the n-th wait pairs up
+ * with the n-th signal, whichever queue (or the host) performs it.
+ */
+static void
+fill_semaphore_ops(struct lvp_device *device,
+                   struct lvp_semaphore_op *ops,
+                   uint32_t count,
+                   const VkSemaphore *semaphores,
+                   const uint64_t *values,
+                   uint32_t value_count,
+                   bool signal)
+{
+   mtx_lock(&device->semaphore_lock);
+   for (uint32_t i = 0; i < count; i++) {
+      struct lvp_semaphore *sema = lvp_semaphore_from_handle(semaphores[i]);
+
+      ops[i].semaphore = sema;
+      if (sema->timeline)
+         ops[i].value = i < value_count ? values[i] : 0;
+      else if (signal)
+         ops[i].value = ++sema->pending_signals;
+      else
+         ops[i].value = ++sema->pending_waits;
+   }
+   mtx_unlock(&device->semaphore_lock);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_QueueSubmit(
    VkQueue                                     _queue,
    uint32_t                                    submitCount,
@@ -1341,20 +1557,63 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_QueueSubmit(
 {
    LVP_FROM_HANDLE(lvp_queue, queue, _queue);
    LVP_FROM_HANDLE(lvp_fence, fence, _fence);
+   struct lvp_device *device = queue->device;
 
-   if (submitCount == 0)
-      goto just_signal_fence;
-   for (uint32_t i = 0; i < submitCount; i++) {
-      uint32_t task_size = sizeof(struct lvp_queue_work) + pSubmits[i].commandBufferCount * sizeof(struct lvp_cmd_buffer *);
-      struct lvp_queue_work *task = malloc(task_size);
+   if (submitCount == 0) {
+      struct lvp_queue_work *task;
+
+      if (!fence)
+         return VK_SUCCESS;
 
-      task->cmd_buffer_count = pSubmits[i].commandBufferCount;
+      /* Signal the fence in order with the batches queued before. */
+      task = calloc(1, sizeof(*task));
+      if (!task)
+         return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
       task->fence = fence;
-      task->cmd_buffers = (struct lvp_cmd_buffer **)(task + 1);
-      for (uint32_t j = 0; j < pSubmits[i].commandBufferCount; j++) {
-         task->cmd_buffers[j] = lvp_cmd_buffer_from_handle(pSubmits[i].pCommandBuffers[j]);
+
+      mtx_lock(&queue->m);
+      p_atomic_inc(&queue->count);
+      list_addtail(&task->list, &queue->workqueue);
+      cnd_signal(&queue->new_work);
+      mtx_unlock(&queue->m);
+      return VK_SUCCESS;
+   }
+
+   for (uint32_t i = 0; i < submitCount; i++) {
+      const VkSubmitInfo *submit = &pSubmits[i];
+      const VkTimelineSemaphoreSubmitInfo *timeline_info =
+         vk_find_struct_const(submit->pNext, TIMELINE_SEMAPHORE_SUBMIT_INFO);
+      uint32_t task_size = sizeof(struct lvp_queue_work) +
+                           submit->commandBufferCount * sizeof(struct lvp_cmd_buffer *) +
+                           (submit->waitSemaphoreCount + submit->signalSemaphoreCount) *
+                           sizeof(struct lvp_semaphore_op);
+      struct lvp_queue_work *task = malloc(task_size);
+      if (!task)
+         return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+
+      task->cmd_buffer_count = submit->commandBufferCount;
+      task->wait_count = submit->waitSemaphoreCount;
+      task->signal_count = submit->signalSemaphoreCount;
+      /* only the last batch signals the fence */
+      task->fence = i == submitCount - 1 ? fence : NULL;
+      task->waits = (struct lvp_semaphore_op *)(task + 1);
+      task->signals = task->waits + task->wait_count;
+      task->cmd_buffers = (struct lvp_cmd_buffer **)(task->signals + task->signal_count);
+      for (uint32_t j = 0; j < submit->commandBufferCount; j++) {
+         task->cmd_buffers[j] = lvp_cmd_buffer_from_handle(submit->pCommandBuffers[j]);
       }
 
+      fill_semaphore_ops(device, task->waits, task->wait_count,
+                         submit->pWaitSemaphores,
+                         timeline_info ? timeline_info->pWaitSemaphoreValues : NULL,
+                         timeline_info ? timeline_info->waitSemaphoreValueCount : 0,
+                         false);
+      fill_semaphore_ops(device, task->signals, task->signal_count,
+                         submit->pSignalSemaphores,
+                         timeline_info ? timeline_info->pSignalSemaphoreValues : NULL,
+                         timeline_info ? timeline_info->signalSemaphoreValueCount : 0,
+                         true);
+
       mtx_lock(&queue->m);
       p_atomic_inc(&queue->count);
       list_addtail(&task->list, &queue->workqueue);
@@ -1362,9 +1621,6 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_QueueSubmit(
       mtx_unlock(&queue->m);
    }
    return VK_SUCCESS;
- just_signal_fence:
-   fence->signaled = true;
-   return VK_SUCCESS;
 }
 
 static VkResult queue_wait_idle(struct lvp_queue *queue, uint64_t timeout)
@@ -1395,7 +1651,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_DeviceWaitIdle(
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
 
-   return queue_wait_idle(&device->queue, UINT64_MAX);
+   for (unsigned i = 0; i < device->num_queues; i++)
+      queue_wait_idle(&device->queues[i], UINT64_MAX);
+   return VK_SUCCESS;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_AllocateMemory(
@@ -1831,6 +2089,38 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyFramebuffer(
    vk_free2(&device->vk.alloc, pAllocator, fb);
 }
 
+/* Wait on one of the device condition variables until abs_timeout, which
+ * is in os_time_get_nano() units.  Returns false once the timeout expired.
+ */
+static bool
+device_cond_wait(struct u_cnd_monotonic *cond, mtx_t *mtx, int64_t abs_timeout)
+{
+   if (abs_timeout == OS_TIMEOUT_INFINITE) {
+      u_cnd_monotonic_wait(cond, mtx);
+      return true;
+   }
+
+   if (os_time_get_nano() >= abs_timeout)
+      return false;
+
+   struct timespec abstime;
+   timespec_from_nsec(&abstime, abs_timeout);
+   u_cnd_monotonic_timedwait(cond, mtx, &abstime);
+   return true;
+}
+
+/* Must be called with the fence lock held. */
+static bool
+fence_check(struct lvp_device *device, struct lvp_fence *fence, uint64_t timeout)
+{
+   if (fence->signaled)
+      return true;
+   if (!fence->handle)
+      return false;
+   return device->pscreen->fence_finish(device->pscreen, NULL,
+                                        fence->handle, timeout);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_WaitForFences(
    VkDevice                                    _device,
    uint32_t                                    fenceCount,
@@ -1839,33 +2129,49 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_WaitForFences(
    uint64_t                                    timeout)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-
-   VkResult qret = queue_wait_idle(&device->queue, timeout);
+   int64_t abs_timeout = os_time_get_absolute_timeout(timeout);
    bool timeout_status = false;
-   if (qret == VK_TIMEOUT)
-      return VK_TIMEOUT;
 
+   /* Fences are handed their pipe fence by whichever queue thread runs the
+    * last batch of the submission, wait for that to happen first.
+    */
    mtx_lock(&device->fence_lock);
-   for (unsigned i = 0; i < fenceCount; i++) {
-      struct lvp_fence *fence = lvp_fence_from_handle(pFences[i]);
+   if (waitAll || fenceCount == 1) {
+      for (unsigned i = 0; i < fenceCount && !timeout_status; i++) {
+         struct lvp_fence *fence = lvp_fence_from_handle(pFences[i]);
 
-      if (fence->signaled)
-         continue;
-      if (!fence->handle) {
-         timeout_status |= true;
-         continue;
-      }
-      bool ret = device->pscreen->fence_finish(device->pscreen,
-                                               NULL,
-                                               fence->handle,
-                                               timeout);
-      if (ret && !waitAll) {
-         timeout_status = false;
-         break;
+         while (!fence->signaled && !fence->handle) {
+            if (!device_cond_wait(&device->fence_cond, &device->fence_lock, abs_timeout))
+               break;
+         }
+
+         uint64_t remaining = abs_timeout == OS_TIMEOUT_INFINITE ? OS_TIMEOUT_INFINITE :
+                              MAX2(abs_timeout - os_time_get_nano(), 0);
+         if (!fence_check(device, fence, remaining))
+            timeout_status = true;
       }
+   } else {
+      while (true) {
+         unsigned i;
+         for (i = 0; i < fenceCount; i++) {
+            if (fence_check(device, lvp_fence_from_handle(pFences[i]), 0))
+               break;
+         }
+         if (i < fenceCount)
+            break;
 
-      if (!ret)
-         timeout_status |= true;
+         /* rasterization completing doesn't broadcast the condition, so
+          * don't block on it for long.
+          */
+         int64_t poll_timeout = os_time_get_absolute_timeout(1000000);
+         if (abs_timeout != OS_TIMEOUT_INFINITE)
+            poll_timeout = MIN2(poll_timeout, abs_timeout);
+         if (!device_cond_wait(&device->fence_cond, &device->fence_lock, poll_timeout) &&
+             poll_timeout == abs_timeout) {
+            timeout_status = true;
+            break;
+         }
+      }
    }
    mtx_unlock(&device->fence_lock);
    return timeout_status ? VK_TIMEOUT : VK_SUCCESS;
@@ -1878,6 +2184,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateSemaphore(
    VkSemaphore*                                pSemaphore)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
+   const VkSemaphoreTypeCreateInfo *type_info =
+      vk_find_struct_const(pCreateInfo->pNext, SEMAPHORE_TYPE_CREATE_INFO);
 
    struct lvp_semaphore *sema = vk_alloc2(&device->vk.alloc, pAllocator,
                                           sizeof(*sema), 8,
@@ -1887,6 +2195,11 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateSemaphore(
       return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
    vk_object_base_init(&device->vk, &sema->base,
                        VK_OBJECT_TYPE_SEMAPHORE);
+
+   sema->timeline = type_info && type_info->semaphoreType == VK_SEMAPHORE_TYPE_TIMELINE;
+   sema->value = sema->timeline ? type_info->initialValue : 0;
+   sema->pending_signals = 0;
+   sema->pending_waits = 0;
    *pSemaphore = lvp_semaphore_to_handle(sema);
 
    return VK_SUCCESS;
@@ -1906,6 +2219,64 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroySemaphore(
    vk_free2(&device->vk.alloc, pAllocator, semaphore);
 }
 
+VKAPI_ATTR VkResult VKAPI_CALL lvp_GetSemaphoreCounterValue(
+   VkDevice                                    _device,
+   VkSemaphore                                 _semaphore,
+   uint64_t*                                   pValue)
+{
+   LVP_FROM_HANDLE(lvp_device, device, _device);
+   LVP_FROM_HANDLE(lvp_semaphore, semaphore, _semaphore);
+
+   mtx_lock(&device->semaphore_lock);
+   *pValue = semaphore->value;
+   mtx_unlock(&device->semaphore_lock);
+   return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL lvp_WaitSemaphores(
+   VkDevice                                    _device,
+   const VkSemaphoreWaitInfo*                  pWaitInfo,
+   uint64_t                                    timeout)
+{
+   LVP_FROM_HANDLE(lvp_device, device, _device);
+   bool wait_any = pWaitInfo->flags & VK_SEMAPHORE_WAIT_ANY_BIT;
+   int64_t abs_timeout = os_time_get_absolute_timeout(timeout);
+   VkResult result = VK_SUCCESS;
+
+   mtx_lock(&device->semaphore_lock);
+   while (true) {
+      unsigned done = 0;
+      for (uint32_t i = 0; i < pWaitInfo->semaphoreCount; i++) {
+         LVP_FROM_HANDLE(lvp_semaphore, semaphore, pWaitInfo->pSemaphores[i]);
+         if (semaphore->value >= pWaitInfo->pValues[i])
+            done++;
+      }
+      if (done == pWaitInfo->semaphoreCount || (wait_any && done))
+         break;
+
+      if (!device_cond_wait(&device->semaphore_cond, &device->semaphore_lock, abs_timeout)) {
+         result = VK_TIMEOUT;
+         break;
+      }
+   }
+   mtx_unlock(&device->semaphore_lock);
+   return result;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL lvp_SignalSemaphore(
+   VkDevice                                    _device,
+   const VkSemaphoreSignalInfo*                pSignalInfo)
+{
+   LVP_FROM_HANDLE(lvp_device, device, _device);
+   LVP_FROM_HANDLE(lvp_semaphore, semaphore, pSignalInfo->semaphore);
+
+   mtx_lock(&device->semaphore_lock);
+   semaphore->value = MAX2(semaphore->value, pSignalInfo->value);
+   u_cnd_monotonic_broadcast(&device->semaphore_cond);
+   mtx_unlock(&device->semaphore_lock);
+   return VK_SUCCESS;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateEvent(
    VkDevice                                    _device,
    const VkEventCreateInfo*                    pCreateInfo,
@@ -53,6 +53,7 @@ enum gs_output {
 };
 
 struct rendering_state {
+   struct lvp_queue *queue;
    struct pipe_context *pctx;
    struct cso_context *cso;
 
@@ -342,7 +343,7 @@ static void handle_compute_pipeline(struct lvp_cmd_buffer_entry *cmd,
    state->dispatch_info.block[0] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.workgroup_size[0];
    state->dispatch_info.block[1] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.workgroup_size[1];
    state->dispatch_info.block[2] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.workgroup_size[2];
-   state->pctx->bind_compute_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_COMPUTE]);
+   state->pctx->bind_compute_state(state->pctx, lvp_pipeline_shader_cso(pipeline, state->queue, PIPE_SHADER_COMPUTE));
 }
 
 static void
@@ -455,24 +456,24 @@ static void handle_graphics_pipeline(struct lvp_cmd_buffer_entry *cmd,
          const VkPipelineShaderStageCreateInfo *sh = &pipeline->graphics_create_info.pStages[i];
          switch (sh->stage) {
          case VK_SHADER_STAGE_FRAGMENT_BIT:
-            state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
+            state->pctx->bind_fs_state(state->pctx, lvp_pipeline_shader_cso(pipeline, state->queue, PIPE_SHADER_FRAGMENT));
             has_stage[PIPE_SHADER_FRAGMENT] = true;
             break;
          case VK_SHADER_STAGE_VERTEX_BIT:
-            state->pctx->bind_vs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_VERTEX]);
+            state->pctx->bind_vs_state(state->pctx, lvp_pipeline_shader_cso(pipeline, state->queue, PIPE_SHADER_VERTEX));
             has_stage[PIPE_SHADER_VERTEX] = true;
             break;
          case VK_SHADER_STAGE_GEOMETRY_BIT:
-            state->pctx->bind_gs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_GEOMETRY]);
+            state->pctx->bind_gs_state(state->pctx, lvp_pipeline_shader_cso(pipeline, state->queue, PIPE_SHADER_GEOMETRY));
             state->gs_output_lines = pipeline->gs_output_lines ? GS_OUTPUT_LINES : GS_OUTPUT_NOT_LINES;
             has_stage[PIPE_SHADER_GEOMETRY] = true;
             break;
          case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
-            state->pctx->bind_tcs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_TESS_CTRL]);
+            state->pctx->bind_tcs_state(state->pctx, lvp_pipeline_shader_cso(pipeline, state->queue, PIPE_SHADER_TESS_CTRL));
             has_stage[PIPE_SHADER_TESS_CTRL] = true;
             break;
          case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
-            state->pctx->bind_tes_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_TESS_EVAL]);
+            state->pctx->bind_tes_state(state->pctx, lvp_pipeline_shader_cso(pipeline, state->queue, PIPE_SHADER_TESS_EVAL));
             has_stage[PIPE_SHADER_TESS_EVAL] = true;
             break;
          default:
@@ -484,7 +485,7 @@ static void handle_graphics_pipeline(struct lvp_cmd_buffer_entry *cmd,
 
    /* there should always be a dummy fs. */
    if (!has_stage[PIPE_SHADER_FRAGMENT])
-      state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
+      state->pctx->bind_fs_state(state->pctx, lvp_pipeline_shader_cso(pipeline, state->queue, PIPE_SHADER_FRAGMENT));
    if (state->pctx->bind_gs_state && !has_stage[PIPE_SHADER_GEOMETRY])
       state->pctx->bind_gs_state(state->pctx, NULL);
    if (state->pctx->bind_tcs_state && !has_stage[PIPE_SHADER_TESS_CTRL])
@@ -2381,6 +2382,7 @@ static void handle_begin_query(struct lvp_cmd_buffer_entry *cmd,
          qtype = PIPE_QUERY_OCCLUSION_PREDICATE;
       pool->queries[qcmd->query] = state->pctx->create_query(state->pctx,
                                                              qtype, qcmd->index);
+      pool->query_ctx[qcmd->query] = state->pctx;
    }
 
    state->pctx->begin_query(state->pctx, pool->queries[qcmd->query]);
@@ -2403,7 +2405,7 @@ static void handle_reset_query_pool(struct lvp_cmd_buffer_entry *cmd,
    struct lvp_query_pool *pool = qcmd->pool;
    for (unsigned i = qcmd->query; i < qcmd->query + qcmd->index; i++) {
       if (pool->queries[i]) {
-         state->pctx->destroy_query(state->pctx, pool->queries[i]);
+         pool->query_ctx[i]->destroy_query(pool->query_ctx[i], pool->queries[i]);
          pool->queries[i] = NULL;
       }
    }
@@ -2417,6 +2419,7 @@ static void handle_write_timestamp(struct lvp_cmd_buffer_entry *cmd,
    if (!pool->queries[qcmd->query]) {
       pool->queries[qcmd->query] = state->pctx->create_query(state->pctx,
                                                              PIPE_QUERY_TIMESTAMP, 0);
+      pool->query_ctx[qcmd->query] = state->pctx;
    }
 
    if (qcmd->flush)
@@ -3301,6 +3304,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
 {
    struct rendering_state state;
    memset(&state, 0, sizeof(state));
+   state.queue = queue;
    state.pctx = queue->ctx;
    state.cso = queue->cso;
    state.blend_dirty = true;
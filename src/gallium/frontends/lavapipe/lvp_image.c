@@ -77,6 +77,10 @@ lvp_image_create(VkDevice _device,
       if (pCreateInfo->usage & VK_IMAGE_USAGE_STORAGE_BIT)
          template.bind |= PIPE_BIND_SHADER_IMAGE;
 
+      /* host visible texel layout must stay linear */
+      if (pCreateInfo->tiling == VK_IMAGE_TILING_LINEAR)
+         template.bind |= PIPE_BIND_LINEAR;
+
       template.format = vk_format_to_pipe(pCreateInfo->format);
       template.width0 = pCreateInfo->extent.width;
       template.height0 = pCreateInfo->extent.height;
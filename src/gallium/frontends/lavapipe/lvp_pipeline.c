@@ -30,6 +30,8 @@
 #include "pipe/p_state.h"
 #include "pipe/p_context.h"
 #include "nir/nir_xfb_info.h"
+#include "tgsi/tgsi_from_mesa.h"
+#include "util/mesa-sha1.h"
 
 #define SPIR_V_MAGIC_NUMBER 0x07230203
 
@@ -51,24 +53,61 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipeline(
    if (!_pipeline)
       return;
 
-   if (pipeline->shader_cso[PIPE_SHADER_VERTEX])
-      device->queue.ctx->delete_vs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_VERTEX]);
-   if (pipeline->shader_cso[PIPE_SHADER_FRAGMENT])
-      device->queue.ctx->delete_fs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
-   if (pipeline->shader_cso[PIPE_SHADER_GEOMETRY])
-      device->queue.ctx->delete_gs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_GEOMETRY]);
-   if (pipeline->shader_cso[PIPE_SHADER_TESS_CTRL])
-      device->queue.ctx->delete_tcs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_TESS_CTRL]);
-   if (pipeline->shader_cso[PIPE_SHADER_TESS_EVAL])
-      device->queue.ctx->delete_tes_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_TESS_EVAL]);
-   if (pipeline->shader_cso[PIPE_SHADER_COMPUTE])
-      device->queue.ctx->delete_compute_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_COMPUTE]);
+   for (unsigned i = 0; i < PIPE_SHADER_TYPES; i++) {
+      if (pipeline->shader_cso[i])
+         lvp_delete_shader_cso(device->queues[0].ctx, i, pipeline->shader_cso[i]);
+   }
+
+   /* The other queues' CSOs are deleted on their own threads */
+   for (unsigned q = 1; q < device->num_queues; q++) {
+      struct lvp_queue *queue = &device->queues[q];
+      void **cso = pipeline->queue_shader_cso[q - 1];
+
+      mtx_lock(&queue->m);
+      for (unsigned i = 0; i < PIPE_SHADER_TYPES; i++) {
+         if (cso[i]) {
+            struct lvp_deleted_cso deleted = { i, cso[i] };
+            util_dynarray_append(&queue->deleted_csos, struct lvp_deleted_cso,
+                                 deleted);
+         }
+      }
+      mtx_unlock(&queue->m);
+   }
 
    ralloc_free(pipeline->mem_ctx);
    vk_object_base_finish(&pipeline->base);
    vk_free2(&device->vk.alloc, pAllocator, pipeline);
 }
 
+void
+lvp_delete_shader_cso(struct pipe_context *ctx,
+                      enum pipe_shader_type stage,
+                      void *cso)
+{
+   switch (stage) {
+   case PIPE_SHADER_VERTEX:
+      ctx->delete_vs_state(ctx, cso);
+      break;
+   case PIPE_SHADER_FRAGMENT:
+      ctx->delete_fs_state(ctx, cso);
+      break;
+   case PIPE_SHADER_GEOMETRY:
+      ctx->delete_gs_state(ctx, cso);
+      break;
+   case PIPE_SHADER_TESS_CTRL:
+      ctx->delete_tcs_state(ctx, cso);
+      break;
+   case PIPE_SHADER_TESS_EVAL:
+      ctx->delete_tes_state(ctx, cso);
+      break;
+   case PIPE_SHADER_COMPUTE:
+      ctx->delete_compute_state(ctx, cso);
+      break;
+   default:
+      unreachable("illegal shader");
+   }
+}
+
 static VkResult
 deep_copy_shader_stage(void *mem_ctx,
                        struct VkPipelineShaderStageCreateInfo *dst,
@@ -426,20 +465,90 @@ shared_var_info(const struct glsl_type *type, unsigned *size, unsigned *align)
       *align = comp_size;
 }
 
+static void
+lvp_hash_pipeline_layout(struct mesa_sha1 *ctx,
+                         const struct lvp_pipeline_layout *layout,
+                         gl_shader_stage stage)
+{
+   _mesa_sha1_update(ctx, &layout->num_sets, sizeof(layout->num_sets));
+   _mesa_sha1_update(ctx, &layout->push_constant_size,
+                     sizeof(layout->push_constant_size));
+   for (unsigned s = 0; s < layout->num_sets; s++) {
+      const struct lvp_descriptor_set_layout *set_layout = layout->set[s].layout;
+
+      /* descriptor indices are offset by the counts of the previous sets */
+      _mesa_sha1_update(ctx, &set_layout->stage[stage],
+                        sizeof(set_layout->stage[stage]));
+      _mesa_sha1_update(ctx, &set_layout->binding_count,
+                        sizeof(set_layout->binding_count));
+      for (unsigned b = 0; b < set_layout->binding_count; b++) {
+         const struct lvp_descriptor_set_binding_layout *binding =
+            &set_layout->binding[b];
+
+         _mesa_sha1_update(ctx, &binding->type, sizeof(binding->type));
+         _mesa_sha1_update(ctx, &binding->array_size,
+                           sizeof(binding->array_size));
+         _mesa_sha1_update(ctx, &binding->valid, sizeof(binding->valid));
+         _mesa_sha1_update(ctx, &binding->stage[stage],
+                           sizeof(binding->stage[stage]));
+      }
+   }
+}
+
+/**
+ * Compute the pipeline cache key for a shader stage: everything that
+ * lvp_shader_compile_to_ir() depends on.
+ */
+static void
+lvp_hash_shader(const struct lvp_pipeline *pipeline,
+                const struct vk_shader_module *module,
+                const char *entrypoint_name,
+                gl_shader_stage stage,
+                const VkSpecializationInfo *spec_info,
+                unsigned char *sha1)
+{
+   struct mesa_sha1 ctx;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, "lvp-nir", 7);
+   _mesa_sha1_update(&ctx, module->sha1, sizeof(module->sha1));
+   _mesa_sha1_update(&ctx, entrypoint_name, strlen(entrypoint_name));
+   _mesa_sha1_update(&ctx, &stage, sizeof(stage));
+   if (spec_info && spec_info->mapEntryCount) {
+      _mesa_sha1_update(&ctx, spec_info->pMapEntries,
+                        spec_info->mapEntryCount * sizeof(*spec_info->pMapEntries));
+      _mesa_sha1_update(&ctx, spec_info->pData, spec_info->dataSize);
+   }
+   if (pipeline->layout)
+      lvp_hash_pipeline_layout(&ctx, pipeline->layout, stage);
+   _mesa_sha1_final(&ctx, sha1);
+}
+
 static void
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
+                         struct lvp_pipeline_cache *cache,
                          struct vk_shader_module *module,
                          const char *entrypoint_name,
                          gl_shader_stage stage,
-                         const VkSpecializationInfo *spec_info)
+                         const VkSpecializationInfo *spec_info,
+                         bool cache_only)
 {
    nir_shader *nir;
    const nir_shader_compiler_options *drv_options = pipeline->device->pscreen->get_compiler_options(pipeline->device->pscreen, PIPE_SHADER_IR_NIR, st_shader_stage_to_ptarget(stage));
    bool progress;
    uint32_t *spirv = (uint32_t *) module->data;
+   unsigned char sha1[20];
    assert(spirv[0] == SPIR_V_MAGIC_NUMBER);
    assert(module->size % 4 == 0);
 
+   lvp_hash_shader(pipeline, module, entrypoint_name, stage, spec_info, sha1);
+   nir = lvp_pipeline_cache_search_nir(pipeline->device, cache, sha1,
+                                       drv_options);
+   if (nir || cache_only) {
+      pipeline->pipeline_nir[stage] = nir;
+      return;
+   }
+
    uint32_t num_spec_entries = 0;
    struct nir_spirv_specialization *spec_entries = NULL;
    if (spec_info && spec_info->mapEntryCount > 0) {
@@ -639,13 +748,9 @@ lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
    }
    nir_assign_io_var_locations(nir, nir_var_shader_out, &nir->num_outputs,
                                nir->info.stage);
-   pipeline->pipeline_nir[stage] = nir;
-}
 
-static void fill_shader_prog(struct pipe_shader_state *state, gl_shader_stage stage, struct lvp_pipeline *pipeline)
-{
-   state->type = PIPE_SHADER_IR_NIR;
-   state->ir.nir = pipeline->pipeline_nir[stage];
+   lvp_pipeline_cache_upload_nir(pipeline->device, cache, sha1, nir);
+   pipeline->pipeline_nir[stage] = nir;
 }
 
 static void
@@ -709,31 +814,36 @@ lvp_shader_stage(VkShaderStageFlagBits stage)
    }
 }
 
-static VkResult
-lvp_pipeline_compile(struct lvp_pipeline *pipeline,
-                     gl_shader_stage stage)
+/**
+ * Create the gallium CSO for a shader stage on the given context.
+ * The context takes ownership of the NIR.
+ */
+static void *
+lvp_pipeline_create_shader_cso(struct lvp_pipeline *pipeline,
+                               struct pipe_context *ctx,
+                               gl_shader_stage stage,
+                               nir_shader *nir)
 {
-   struct lvp_device *device = pipeline->device;
-   device->physical_device->pscreen->finalize_nir(device->physical_device->pscreen, pipeline->pipeline_nir[stage], true);
    if (stage == MESA_SHADER_COMPUTE) {
       struct pipe_compute_state shstate = {0};
-      shstate.prog = (void *)pipeline->pipeline_nir[MESA_SHADER_COMPUTE];
+      shstate.prog = (void *)nir;
       shstate.ir_type = PIPE_SHADER_IR_NIR;
-      shstate.req_local_mem = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.shared_size;
-      pipeline->shader_cso[PIPE_SHADER_COMPUTE] = device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
+      shstate.req_local_mem = nir->info.shared_size;
+      return ctx->create_compute_state(ctx, &shstate);
    } else {
       struct pipe_shader_state shstate = {0};
-      fill_shader_prog(&shstate, stage, pipeline);
+      shstate.type = PIPE_SHADER_IR_NIR;
+      shstate.ir.nir = nir;
 
       if (stage == MESA_SHADER_VERTEX ||
           stage == MESA_SHADER_GEOMETRY ||
           stage == MESA_SHADER_TESS_EVAL) {
-         nir_xfb_info *xfb_info = nir_gather_xfb_info(pipeline->pipeline_nir[stage], NULL);
+         nir_xfb_info *xfb_info = nir_gather_xfb_info(nir, NULL);
          if (xfb_info) {
             uint8_t output_mapping[VARYING_SLOT_TESS_MAX];
             memset(output_mapping, 0, sizeof(output_mapping));
 
-            nir_foreach_shader_out_variable(var, pipeline->pipeline_nir[stage]) {
+            nir_foreach_shader_out_variable(var, nir) {
                unsigned slots = var->data.compact ? DIV_ROUND_UP(glsl_get_length(var->type), 4)
                                                   : glsl_count_attribute_slots(var->type, false);
                for (unsigned i = 0; i < slots; i++)
@@ -761,28 +871,66 @@ lvp_pipeline_compile(struct lvp_pipeline *pipeline,
 
       switch (stage) {
       case MESA_SHADER_FRAGMENT:
-         pipeline->shader_cso[PIPE_SHADER_FRAGMENT] = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_fs_state(ctx, &shstate);
       case MESA_SHADER_VERTEX:
-         pipeline->shader_cso[PIPE_SHADER_VERTEX] = device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_vs_state(ctx, &shstate);
       case MESA_SHADER_GEOMETRY:
-         pipeline->shader_cso[PIPE_SHADER_GEOMETRY] = device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_gs_state(ctx, &shstate);
       case MESA_SHADER_TESS_CTRL:
-         pipeline->shader_cso[PIPE_SHADER_TESS_CTRL] = device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_tcs_state(ctx, &shstate);
       case MESA_SHADER_TESS_EVAL:
-         pipeline->shader_cso[PIPE_SHADER_TESS_EVAL] = device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_tes_state(ctx, &shstate);
       default:
          unreachable("illegal shader");
          break;
       }
    }
+   return NULL;
+}
+
+static VkResult
+lvp_pipeline_compile(struct lvp_pipeline *pipeline,
+                     gl_shader_stage stage)
+{
+   struct lvp_device *device = pipeline->device;
+   device->physical_device->pscreen->finalize_nir(device->physical_device->pscreen, pipeline->pipeline_nir[stage], true);
+   /* queues[0] compiles its NIR lazily and modifies it while doing so */
+   if (device->num_queues > 1)
+      pipeline->queue_nir[stage] = nir_shader_clone(pipeline->mem_ctx,
+                                                    pipeline->pipeline_nir[stage]);
+   pipeline->shader_cso[st_shader_stage_to_ptarget(stage)] =
+      lvp_pipeline_create_shader_cso(pipeline, device->queues[0].ctx, stage,
+                                     pipeline->pipeline_nir[stage]);
    return VK_SUCCESS;
 }
 
+/**
+ * Get the CSO of a pipeline stage for the given queue.
+ *
+ * The pipeline CSOs belong to the context of the first queue.  Gallium
+ * contexts can't share CSOs, so the other queues lazily create their own
+ * from a copy of the NIR, on their execution thread.  The copy is made
+ * from queue_nir, which unlike pipeline_nir no context ever modifies.
+ */
+void *
+lvp_pipeline_shader_cso(struct lvp_pipeline *pipeline,
+                        struct lvp_queue *queue,
+                        enum pipe_shader_type stage)
+{
+   if (queue->index == 0 || !pipeline->shader_cso[stage])
+      return pipeline->shader_cso[stage];
+
+   void **cso = &pipeline->queue_shader_cso[queue->index - 1][stage];
+   if (!*cso) {
+      gl_shader_stage mesa_stage = tgsi_processor_to_shader_stage(stage);
+      nir_shader *nir = nir_shader_clone(NULL, pipeline->queue_nir[mesa_stage]);
+
+      *cso = lvp_pipeline_create_shader_cso(pipeline, queue->ctx,
+                                            mesa_stage, nir);
+   }
+   return *cso;
+}
+
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
@@ -820,17 +968,39 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
       }
    }
 
+   return VK_SUCCESS;
+}
+
+/**
+ * Free the NIR of stages which were never handed over to a CSO.
+ */
+static void
+lvp_pipeline_free_nir(struct lvp_pipeline *pipeline)
+{
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      ralloc_free(pipeline->pipeline_nir[i]);
+      pipeline->pipeline_nir[i] = NULL;
+   }
+}
+
+/**
+ * Create the shader CSOs of a graphics pipeline, once all of its stages
+ * have been compiled to NIR.
+ */
+static VkResult
+lvp_graphics_pipeline_init_shaders(struct lvp_pipeline *pipeline,
+                                   const VkGraphicsPipelineCreateInfo *pCreateInfo)
+{
+   struct lvp_device *device = pipeline->device;
 
    for (uint32_t i = 0; i < pCreateInfo->stageCount; i++) {
-      VK_FROM_HANDLE(vk_shader_module, module,
-                      pCreateInfo->pStages[i].module);
       gl_shader_stage stage = lvp_shader_stage(pCreateInfo->pStages[i].stage);
-      lvp_shader_compile_to_ir(pipeline, module,
-                               pCreateInfo->pStages[i].pName,
-                               stage,
-                               pCreateInfo->pStages[i].pSpecializationInfo);
-      if (!pipeline->pipeline_nir[stage])
+      if (!pipeline->pipeline_nir[stage]) {
+         lvp_pipeline_free_nir(pipeline);
+         if (pCreateInfo->flags & VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_EXT)
+            return VK_PIPELINE_COMPILE_REQUIRED_EXT;
          return VK_ERROR_FEATURE_NOT_PRESENT;
+      }
    }
 
    if (pipeline->pipeline_nir[MESA_SHADER_FRAGMENT]) {
@@ -867,14 +1037,86 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                                                      "dummy_frag");
 
       pipeline->pipeline_nir[MESA_SHADER_FRAGMENT] = b.shader;
-      struct pipe_shader_state shstate = {0};
-      shstate.type = PIPE_SHADER_IR_NIR;
-      shstate.ir.nir = pipeline->pipeline_nir[MESA_SHADER_FRAGMENT];
-      pipeline->shader_cso[PIPE_SHADER_FRAGMENT] = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+      if (device->num_queues > 1)
+         pipeline->queue_nir[MESA_SHADER_FRAGMENT] =
+            nir_shader_clone(pipeline->mem_ctx, b.shader);
+      pipeline->shader_cso[PIPE_SHADER_FRAGMENT] =
+         lvp_pipeline_create_shader_cso(pipeline, device->queues[0].ctx,
+                                        MESA_SHADER_FRAGMENT, b.shader);
    }
    return VK_SUCCESS;
 }
 
+/**
+ * A shader stage to compile to NIR, possibly on a compile queue thread.
+ */
+struct lvp_pipeline_stage_job {
+   struct util_queue_fence fence;
+   struct lvp_pipeline *pipeline;
+   struct lvp_pipeline_cache *cache;
+   const VkPipelineShaderStageCreateInfo *info;
+   bool cache_only;
+};
+
+static void
+lvp_pipeline_stage_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lvp_pipeline_stage_job *job = data;
+   VK_FROM_HANDLE(vk_shader_module, module, job->info->module);
+
+   lvp_shader_compile_to_ir(job->pipeline, job->cache, module,
+                            job->info->pName,
+                            lvp_shader_stage(job->info->stage),
+                            job->info->pSpecializationInfo,
+                            job->cache_only);
+}
+
+static void
+lvp_pipeline_stage_job_init(struct lvp_pipeline_stage_job *job,
+                            struct lvp_pipeline *pipeline,
+                            struct lvp_pipeline_cache *cache,
+                            const VkPipelineShaderStageCreateInfo *info,
+                            VkPipelineCreateFlags flags)
+{
+   job->pipeline = pipeline;
+   job->cache = cache;
+   job->info = info;
+   job->cache_only =
+      (flags & VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_EXT) != 0;
+}
+
+/**
+ * Compile all the given stages to NIR and wait for them.
+ * Stages are independent of each other, so they are spread over the device
+ * compile queue, with the calling thread taking the first one.
+ */
+static void
+lvp_pipeline_compile_stages(struct lvp_device *device,
+                            struct lvp_pipeline_stage_job *jobs,
+                            unsigned num_jobs)
+{
+   unsigned i;
+
+   if (num_jobs < 2 || !util_queue_is_initialized(&device->compile_queue)) {
+      for (i = 0; i < num_jobs; i++)
+         lvp_pipeline_stage_job_execute(&jobs[i], NULL, 0);
+      return;
+   }
+
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&device->compile_queue, &jobs[i], &jobs[i].fence,
+                         lvp_pipeline_stage_job_execute, NULL, 0);
+   }
+
+   lvp_pipeline_stage_job_execute(&jobs[0], NULL, 0);
+
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
+
 static VkResult
 lvp_graphics_pipeline_create(
    VkDevice _device,
@@ -917,10 +1159,27 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
+   LVP_FROM_HANDLE(lvp_device, device, _device);
+   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, pipelineCache);
+   struct lvp_pipeline_stage_job *jobs;
+   unsigned num_jobs = 0, num_stages = 0;
    VkResult result = VK_SUCCESS;
-   unsigned i = 0;
+   bool early_return = false;
+   unsigned i;
 
-   for (; i < count; i++) {
+   for (i = 0; i < count; i++) {
+      pPipelines[i] = VK_NULL_HANDLE;
+      num_stages += pCreateInfos[i].stageCount;
+   }
+
+   jobs = calloc(num_stages, sizeof(*jobs));
+   if (num_stages && !jobs)
+      return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+
+   /* Set up all the pipelines first so that their stages, which don't
+    * depend on each other, can be compiled concurrently.
+    */
+   for (i = 0; i < count; i++) {
       VkResult r;
       r = lvp_graphics_pipeline_create(_device,
                                        pipelineCache,
@@ -929,6 +1188,43 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
       if (r != VK_SUCCESS) {
          result = r;
          pPipelines[i] = VK_NULL_HANDLE;
+         if (pCreateInfos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT_EXT)
+            break;
+         continue;
+      }
+
+      for (uint32_t s = 0; s < pCreateInfos[i].stageCount; s++)
+         lvp_pipeline_stage_job_init(&jobs[num_jobs++],
+                                     lvp_pipeline_from_handle(pPipelines[i]),
+                                     cache, &pCreateInfos[i].pStages[s],
+                                     pCreateInfos[i].flags);
+   }
+
+   lvp_pipeline_compile_stages(device, jobs, num_jobs);
+   free(jobs);
+
+   /* The CSOs are created on the queue context, which is not thread safe. */
+   for (i = 0; i < count; i++) {
+      VkResult r;
+
+      if (!pPipelines[i])
+         continue;
+
+      if (early_return) {
+         lvp_pipeline_free_nir(lvp_pipeline_from_handle(pPipelines[i]));
+         lvp_DestroyPipeline(_device, pPipelines[i], pAllocator);
+         pPipelines[i] = VK_NULL_HANDLE;
+         continue;
+      }
+
+      r = lvp_graphics_pipeline_init_shaders(lvp_pipeline_from_handle(pPipelines[i]),
+                                             &pCreateInfos[i]);
+      if (r != VK_SUCCESS) {
+         result = r;
+         lvp_DestroyPipeline(_device, pPipelines[i], pAllocator);
+         pPipelines[i] = VK_NULL_HANDLE;
+         if (pCreateInfos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT_EXT)
+            early_return = true;
       }
    }
 
@@ -942,8 +1238,6 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           const VkComputePipelineCreateInfo *pCreateInfo,
                           const VkAllocationCallbacks *alloc)
 {
-   VK_FROM_HANDLE(vk_shader_module, module,
-                   pCreateInfo->stage.module);
    if (alloc == NULL)
       alloc = &device->vk.alloc;
    pipeline->device = device;
@@ -955,12 +1249,22 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                                  &pipeline->compute_create_info, pCreateInfo);
    pipeline->is_compute_pipeline = true;
 
-   lvp_shader_compile_to_ir(pipeline, module,
-                            pCreateInfo->stage.pName,
-                            MESA_SHADER_COMPUTE,
-                            pCreateInfo->stage.pSpecializationInfo);
-   if (!pipeline->pipeline_nir[MESA_SHADER_COMPUTE])
+   return VK_SUCCESS;
+}
+
+/**
+ * Create the shader CSO of a compute pipeline once it has been compiled
+ * to NIR.
+ */
+static VkResult
+lvp_compute_pipeline_init_shaders(struct lvp_pipeline *pipeline,
+                                  const VkComputePipelineCreateInfo *pCreateInfo)
+{
+   if (!pipeline->pipeline_nir[MESA_SHADER_COMPUTE]) {
+      if (pCreateInfo->flags & VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_EXT)
+         return VK_PIPELINE_COMPILE_REQUIRED_EXT;
       return VK_ERROR_FEATURE_NOT_PRESENT;
+   }
    lvp_pipeline_compile(pipeline, MESA_SHADER_COMPUTE);
    return VK_SUCCESS;
 }
@@ -1007,10 +1311,22 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateComputePipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
+   LVP_FROM_HANDLE(lvp_device, device, _device);
+   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, pipelineCache);
+   struct lvp_pipeline_stage_job *jobs;
+   unsigned num_jobs = 0;
    VkResult result = VK_SUCCESS;
-   unsigned i = 0;
+   bool early_return = false;
+   unsigned i;
 
-   for (; i < count; i++) {
+   for (i = 0; i < count; i++)
+      pPipelines[i] = VK_NULL_HANDLE;
+
+   jobs = calloc(count, sizeof(*jobs));
+   if (count && !jobs)
+      return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+
+   for (i = 0; i < count; i++) {
       VkResult r;
       r = lvp_compute_pipeline_create(_device,
                                       pipelineCache,
@@ -1019,6 +1335,41 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateComputePipelines(
       if (r != VK_SUCCESS) {
          result = r;
          pPipelines[i] = VK_NULL_HANDLE;
+         if (pCreateInfos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT_EXT)
+            break;
+         continue;
+      }
+
+      lvp_pipeline_stage_job_init(&jobs[num_jobs++],
+                                  lvp_pipeline_from_handle(pPipelines[i]),
+                                  cache, &pCreateInfos[i].stage,
+                                  pCreateInfos[i].flags);
+   }
+
+   lvp_pipeline_compile_stages(device, jobs, num_jobs);
+   free(jobs);
+
+   for (i = 0; i < count; i++) {
+      VkResult r;
+
+      if (!pPipelines[i])
+         continue;
+
+      if (early_return) {
+         lvp_pipeline_free_nir(lvp_pipeline_from_handle(pPipelines[i]));
+         lvp_DestroyPipeline(_device, pPipelines[i], pAllocator);
+         pPipelines[i] = VK_NULL_HANDLE;
+         continue;
+      }
+
+      r = lvp_compute_pipeline_init_shaders(lvp_pipeline_from_handle(pPipelines[i]),
+                                            &pCreateInfos[i]);
+      if (r != VK_SUCCESS) {
+         result = r;
+         lvp_DestroyPipeline(_device, pPipelines[i], pAllocator);
+         pPipelines[i] = VK_NULL_HANDLE;
+         if (pCreateInfos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT_EXT)
+            early_return = true;
       }
    }
 
@@ -22,6 +22,213 @@
  */
 
 #include "lvp_private.h"
+#include "util/blob.h"
+#include "util/disk_cache.h"
+#include "util/hash_table.h"
+#include "nir_serialize.h"
+
+/*
+ * The pipeline cache stores the lowered NIR of each shader stage, keyed by
+ * everything that goes into lvp_shader_compile_to_ir().  The JIT code
+ * generated from it is cached by llvmpipe itself, keyed by the NIR, so
+ * with both caches warm pipeline creation skips shader compilation.
+ *
+ * Entries are also written to the screen's disk cache so that they
+ * survive across processes even when the application doesn't provide a
+ * VkPipelineCache.
+ */
+
+struct lvp_pipeline_cache_entry {
+   unsigned char sha1[20];
+   uint32_t size;
+   uint8_t data[0];
+};
+
+static uint32_t
+sha1_hash(const void *key)
+{
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+sha1_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, 20) == 0;
+}
+
+static void
+lvp_pipeline_cache_init(struct lvp_pipeline_cache *cache,
+                        struct lvp_device *device)
+{
+   cache->device = device;
+   mtx_init(&cache->mutex, mtx_plain);
+   cache->entries = _mesa_hash_table_create(NULL, sha1_hash, sha1_equal);
+   cache->total_size = 0;
+}
+
+static void
+lvp_pipeline_cache_finish(struct lvp_pipeline_cache *cache)
+{
+   hash_table_foreach(cache->entries, he)
+      vk_free(&cache->alloc, he->data);
+   _mesa_hash_table_destroy(cache->entries, NULL);
+   mtx_destroy(&cache->mutex);
+}
+
+/* Must be called with the cache mutex held. */
+static void
+lvp_pipeline_cache_add_entry(struct lvp_pipeline_cache *cache,
+                             const unsigned char *sha1,
+                             const void *data, uint32_t size)
+{
+   struct lvp_pipeline_cache_entry *entry;
+
+   if (_mesa_hash_table_search(cache->entries, sha1))
+      return;
+
+   entry = vk_alloc(&cache->alloc, sizeof(*entry) + size, 8,
+                    VK_SYSTEM_ALLOCATION_SCOPE_CACHE);
+   if (!entry)
+      return;
+
+   memcpy(entry->sha1, sha1, sizeof(entry->sha1));
+   entry->size = size;
+   memcpy(entry->data, data, size);
+
+   _mesa_hash_table_insert(cache->entries, entry->sha1, entry);
+   /* entries are padded to 8 bytes in the serialized data */
+   cache->total_size += sizeof(*entry) + align(size, 8);
+}
+
+static void
+lvp_pipeline_cache_load(struct lvp_pipeline_cache *cache,
+                        const void *data, size_t size)
+{
+   struct vk_pipeline_cache_header header;
+   uint8_t uuid[VK_UUID_SIZE];
+
+   if (size < sizeof(header))
+      return;
+   memcpy(&header, data, sizeof(header));
+   if (header.header_size < sizeof(header) || header.header_size > size)
+      return;
+   if (header.header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+      return;
+   if (header.vendor_id != VK_VENDOR_ID_MESA || header.device_id != 0)
+      return;
+   lvp_device_get_cache_uuid(uuid);
+   if (memcmp(header.uuid, uuid, VK_UUID_SIZE) != 0)
+      return;
+
+   const uint8_t *end = (const uint8_t *)data + size;
+   const uint8_t *p = (const uint8_t *)data + header.header_size;
+
+   /* p never goes past end, so the remaining size can't be negative */
+   while ((size_t)(end - p) >= sizeof(struct lvp_pipeline_cache_entry)) {
+      struct lvp_pipeline_cache_entry entry;
+      memcpy(&entry, p, sizeof(entry));
+      p += sizeof(entry);
+      if ((size_t)(end - p) < entry.size)
+         break;
+
+      lvp_pipeline_cache_add_entry(cache, entry.sha1, p, entry.size);
+      if ((size_t)(end - p) < align(entry.size, 8))
+         break;
+      p += align(entry.size, 8);
+   }
+}
+
+/**
+ * Look up the NIR for the given key, first in the pipeline cache, then in
+ * the disk cache.  Returns NULL on a miss.
+ */
+nir_shader *
+lvp_pipeline_cache_search_nir(struct lvp_device *device,
+                              struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const nir_shader_compiler_options *options)
+{
+   struct disk_cache *disk_cache =
+      device->pscreen->get_disk_shader_cache(device->pscreen);
+   nir_shader *nir = NULL;
+   struct blob_reader reader;
+
+   if (cache) {
+      mtx_lock(&cache->mutex);
+      struct hash_entry *he = _mesa_hash_table_search(cache->entries, sha1);
+      if (he) {
+         const struct lvp_pipeline_cache_entry *entry = he->data;
+         blob_reader_init(&reader, entry->data, entry->size);
+         nir = nir_deserialize(NULL, options, &reader);
+      }
+      mtx_unlock(&cache->mutex);
+      if (nir)
+         return nir;
+   }
+
+   if (disk_cache) {
+      cache_key key;
+      size_t size;
+      void *data;
+
+      disk_cache_compute_key(disk_cache, sha1, 20, key);
+      data = disk_cache_get(disk_cache, key, &size);
+      if (data) {
+         blob_reader_init(&reader, data, size);
+         nir = nir_deserialize(NULL, options, &reader);
+
+         /* Promote to the pipeline cache so it shows up in the app's data */
+         if (nir && cache) {
+            mtx_lock(&cache->mutex);
+            lvp_pipeline_cache_add_entry(cache, sha1, data, size);
+            mtx_unlock(&cache->mutex);
+         }
+         free(data);
+      }
+   }
+
+   return nir;
+}
+
+/**
+ * Store the NIR for the given key in the pipeline cache and the disk cache.
+ */
+void
+lvp_pipeline_cache_upload_nir(struct lvp_device *device,
+                              struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const nir_shader *nir)
+{
+   struct disk_cache *disk_cache =
+      device->pscreen->get_disk_shader_cache(device->pscreen);
+   struct blob blob;
+
+   if (!cache && !disk_cache)
+      return;
+
+   blob_init(&blob);
+   nir_serialize(&blob, nir, false);
+   if (blob.out_of_memory) {
+      blob_finish(&blob);
+      return;
+   }
+
+   if (cache) {
+      mtx_lock(&cache->mutex);
+      lvp_pipeline_cache_add_entry(cache, sha1, blob.data, blob.size);
+      mtx_unlock(&cache->mutex);
+   }
+
+   if (disk_cache) {
+      cache_key key;
+      disk_cache_compute_key(disk_cache, sha1, 20, key);
+      disk_cache_put(disk_cache, key, blob.data, blob.size, NULL);
+   }
+
+   blob_finish(&blob);
+}
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
     VkDevice                                    _device,
@@ -48,7 +255,17 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
    else
      cache->alloc = device->vk.alloc;
 
-   cache->device = device;
+   lvp_pipeline_cache_init(cache, device);
+   if (!cache->entries) {
+      vk_object_base_finish(&cache->base);
+      vk_free2(&device->vk.alloc, pAllocator, cache);
+      return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
+   if (pCreateInfo->initialDataSize > 0)
+      lvp_pipeline_cache_load(cache, pCreateInfo->pInitialData,
+                              pCreateInfo->initialDataSize);
+
    *pPipelineCache = lvp_pipeline_cache_to_handle(cache);
 
    return VK_SUCCESS;
@@ -64,7 +281,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipelineCache(
 
    if (!_cache)
       return;
-//   lvp_pipeline_cache_finish(cache);
+   lvp_pipeline_cache_finish(cache);
    vk_object_base_finish(&cache->base);
    vk_free2(&device->vk.alloc, pAllocator, cache);
 }
@@ -75,21 +292,49 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetPipelineCacheData(
         size_t*                                     pDataSize,
         void*                                       pData)
 {
+   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   struct vk_pipeline_cache_header *header;
    VkResult result = VK_SUCCESS;
-   if (pData) {
-      if (*pDataSize < 32) {
-         *pDataSize = 0;
+
+   mtx_lock(&cache->mutex);
+
+   if (pData == NULL) {
+      *pDataSize = sizeof(*header) + cache->total_size;
+      mtx_unlock(&cache->mutex);
+      return VK_SUCCESS;
+   }
+   if (*pDataSize < sizeof(*header)) {
+      mtx_unlock(&cache->mutex);
+      *pDataSize = 0;
+      return VK_INCOMPLETE;
+   }
+
+   uint8_t *p = pData, *end = (uint8_t *)pData + *pDataSize;
+   header = pData;
+   header->header_size = sizeof(*header);
+   header->header_version = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+   header->vendor_id = VK_VENDOR_ID_MESA;
+   header->device_id = 0;
+   lvp_device_get_cache_uuid(header->uuid);
+   p += header->header_size;
+
+   hash_table_foreach(cache->entries, he) {
+      const struct lvp_pipeline_cache_entry *entry = he->data;
+      const size_t entry_size = sizeof(*entry) + align(entry->size, 8);
+
+      if (end - p < entry_size) {
          result = VK_INCOMPLETE;
-      } else {
-         uint32_t *hdr = (uint32_t *)pData;
-         hdr[0] = 32;
-         hdr[1] = 1;
-         hdr[2] = VK_VENDOR_ID_MESA;
-         hdr[3] = 0;
-         lvp_device_get_cache_uuid(&hdr[4]);
+         break;
       }
-   } else
-      *pDataSize = 32;
+
+      memcpy(p, entry, sizeof(*entry) + entry->size);
+      memset(p + sizeof(*entry) + entry->size, 0,
+             entry_size - sizeof(*entry) - entry->size);
+      p += entry_size;
+   }
+   *pDataSize = p - (uint8_t *)pData;
+
+   mtx_unlock(&cache->mutex);
    return result;
 }
 
@@ -99,5 +344,21 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_MergePipelineCaches(
         uint32_t                                    srcCacheCount,
         const VkPipelineCache*                      pSrcCaches)
 {
+   LVP_FROM_HANDLE(lvp_pipeline_cache, dst, destCache);
+
+   mtx_lock(&dst->mutex);
+   for (uint32_t i = 0; i < srcCacheCount; i++) {
+      LVP_FROM_HANDLE(lvp_pipeline_cache, src, pSrcCaches[i]);
+
+      mtx_lock(&src->mutex);
+      hash_table_foreach(src->entries, he) {
+         const struct lvp_pipeline_cache_entry *entry = he->data;
+         lvp_pipeline_cache_add_entry(dst, entry->sha1, entry->data,
+                                      entry->size);
+      }
+      mtx_unlock(&src->mutex);
+   }
+   mtx_unlock(&dst->mutex);
+
    return VK_SUCCESS;
 }
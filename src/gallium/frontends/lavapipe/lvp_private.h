@@ -30,7 +30,10 @@
 #include <stdint.h>
 
 #include "util/macros.h"
+#include "util/cnd_monotonic.h"
 #include "util/list.h"
+#include "util/u_dynarray.h"
+#include "util/u_queue.h"
 
 #include "compiler/shader_enums.h"
 #include "pipe/p_screen.h"
@@ -67,6 +70,13 @@ extern "C" {
 #define MAX_PUSH_CONSTANTS_SIZE 128
 #define MAX_PUSH_DESCRIPTORS 32
 
+/* Queue family 0 supports everything, family 1 is compute and transfer
+ * only.  Each queue gets its own gallium context and execution thread.
+ */
+#define LVP_QUEUE_FAMILY_COUNT 2
+#define LVP_MAX_QUEUES_PER_FAMILY 4
+#define LVP_MAX_QUEUES (LVP_QUEUE_FAMILY_COUNT * LVP_MAX_QUEUES_PER_FAMILY)
+
 #ifdef _WIN32
 #define lvp_printflike(a, b)
 #else
@@ -161,6 +171,10 @@ bool lvp_physical_device_extension_supported(struct lvp_physical_device *dev,
 struct lvp_queue {
    struct vk_object_base base;
    VkDeviceQueueCreateFlags flags;
+   uint32_t family_index;
+   uint32_t queue_index;
+   /* index in lvp_device::queues */
+   unsigned index;
    struct lvp_device *                         device;
    struct pipe_context *ctx;
    struct cso_context *cso;
@@ -170,12 +184,28 @@ struct lvp_queue {
    cnd_t new_work;
    struct list_head workqueue;
    volatile int count;
+   /* CSOs of destroyed pipelines, deleted on the queue thread, under m */
+   struct util_dynarray deleted_csos;
+};
+
+struct lvp_deleted_cso {
+   enum pipe_shader_type stage;
+   void *cso;
+};
+
+struct lvp_semaphore_op {
+   struct lvp_semaphore *semaphore;
+   uint64_t value;
 };
 
 struct lvp_queue_work {
    struct list_head list;
    uint32_t cmd_buffer_count;
+   uint32_t wait_count;
+   uint32_t signal_count;
    struct lvp_cmd_buffer **cmd_buffers;
+   struct lvp_semaphore_op *waits;
+   struct lvp_semaphore_op *signals;
    struct lvp_fence *fence;
 };
 
@@ -183,17 +213,48 @@ struct lvp_pipeline_cache {
    struct vk_object_base                        base;
    struct lvp_device *                          device;
    VkAllocationCallbacks                        alloc;
+
+   mtx_t                                        mutex;
+   /* sha1 -> struct lvp_pipeline_cache_entry */
+   struct hash_table *                          entries;
+   size_t                                       total_size;
 };
 
+nir_shader *
+lvp_pipeline_cache_search_nir(struct lvp_device *device,
+                              struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const nir_shader_compiler_options *options);
+
+void
+lvp_pipeline_cache_upload_nir(struct lvp_device *device,
+                              struct lvp_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const nir_shader *nir);
+
 struct lvp_device {
    struct vk_device vk;
 
-   struct lvp_queue queue;
+   /* queues[0] always exists, it is the first queue of family 0 and its
+    * context also owns the pipeline CSOs.
+    */
+   struct lvp_queue queues[LVP_MAX_QUEUES];
+   unsigned num_queues;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
 
    mtx_t fence_lock;
+   struct u_cnd_monotonic fence_cond;
+
+   /* Semaphore payloads are protected by the lock, waiters are woken up
+    * through the condition variable whenever one of them changes.
+    */
+   mtx_t semaphore_lock;
+   struct u_cnd_monotonic semaphore_cond;
+
+   /* Worker threads compiling pipeline shader stages to NIR */
+   struct util_queue compile_queue;
 };
 
 void lvp_device_get_cache_uuid(void *uuid);
@@ -477,6 +538,12 @@ struct lvp_pipeline {
    bool force_min_sample;
    nir_shader *pipeline_nir[MESA_SHADER_STAGES];
    void *shader_cso[PIPE_SHADER_TYPES];
+   /* Copies of the NIR taken before queues[0] got it, which the other
+    * queues create their CSOs from.
+    */
+   nir_shader *queue_nir[MESA_SHADER_STAGES];
+   /* CSOs for queues other than queues[0], created on first use */
+   void *queue_shader_cso[LVP_MAX_QUEUES - 1][PIPE_SHADER_TYPES];
    VkGraphicsPipelineCreateInfo graphics_create_info;
    VkComputePipelineCreateInfo compute_create_info;
    uint32_t line_stipple_factor;
@@ -501,7 +568,14 @@ struct lvp_fence {
 
 struct lvp_semaphore {
    struct vk_object_base base;
-   bool dummy;
+   bool timeline;
+   /* Value of the last completed signal operation.  Binary semaphores
+    * count their signal and wait operations, the n-th wait waits for the
+    * n-th signal.
+    */
+   uint64_t value;
+   uint64_t pending_signals;
+   uint64_t pending_waits;
 };
 
 struct lvp_buffer {
@@ -532,6 +606,8 @@ struct lvp_query_pool {
    uint32_t count;
    VkQueryPipelineStatisticFlags pipeline_stats;
    enum pipe_query_type base_type;
+   /* context of the queue each query was created on, after queries */
+   struct pipe_context **query_ctx;
    struct pipe_query *queries[0];
 };
 
@@ -543,6 +619,18 @@ struct lvp_cmd_pool {
 };
 
 
+/* Command entries are bump allocated from blocks of at least this size,
+ * which are kept across command buffer resets.
+ */
+#define LVP_CMD_BLOCK_SIZE (64 * 1024)
+
+struct lvp_cmd_block {
+   struct list_head link;
+   uint32_t size;
+   uint32_t used;
+   uint8_t data[0];
+};
+
 enum lvp_cmd_buffer_status {
    LVP_CMD_BUFFER_STATUS_INVALID,
    LVP_CMD_BUFFER_STATUS_INITIAL,
@@ -564,6 +652,10 @@ struct lvp_cmd_buffer {
    struct list_head                             cmds;
    struct list_head                            *last_emit;
 
+   /* Arena the command entries are allocated from */
+   struct list_head                             cmd_blocks;
+   struct lvp_cmd_block                        *cur_block;
+
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
 };
 
@@ -1160,6 +1252,16 @@ struct lvp_cmd_buffer_entry {
    } u;
 };
 
+void
+lvp_delete_shader_cso(struct pipe_context *ctx,
+                      enum pipe_shader_type stage,
+                      void *cso);
+
+void *
+lvp_pipeline_shader_cso(struct lvp_pipeline *pipeline,
+                        struct lvp_queue *queue,
+                        enum pipe_shader_type stage);
+
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
                           struct lvp_cmd_buffer *cmd_buffer);
@@ -50,7 +50,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateQueryPool(
       return VK_ERROR_FEATURE_NOT_PRESENT;
    }
    struct lvp_query_pool *pool;
-   uint32_t pool_size = sizeof(*pool) + pCreateInfo->queryCount * sizeof(struct pipe_query *);
+   uint32_t pool_size = sizeof(*pool) + pCreateInfo->queryCount *
+                        (sizeof(struct pipe_query *) + sizeof(struct pipe_context *));
 
    pool = vk_zalloc2(&device->vk.alloc, pAllocator,
                     pool_size, 8,
@@ -64,6 +65,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateQueryPool(
    pool->count = pCreateInfo->queryCount;
    pool->base_type = pipeq;
    pool->pipeline_stats = pCreateInfo->pipelineStatistics;
+   pool->query_ctx = (struct pipe_context **)&pool->queries[pool->count];
 
    *pQueryPool = lvp_query_pool_to_handle(pool);
    return VK_SUCCESS;
@@ -82,7 +84,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyQueryPool(
 
    for (unsigned i = 0; i < pool->count; i++)
       if (pool->queries[i])
-         device->queue.ctx->destroy_query(device->queue.ctx, pool->queries[i]);
+         pool->query_ctx[i]->destroy_query(pool->query_ctx[i], pool->queries[i]);
    vk_object_base_finish(&pool->base);
    vk_free2(&device->vk.alloc, pAllocator, pool);
 }
@@ -97,7 +99,6 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetQueryPoolResults(
    VkDeviceSize                                stride,
    VkQueryResultFlags                          flags)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
    LVP_FROM_HANDLE(lvp_query_pool, pool, queryPool);
    VkResult vk_result = VK_SUCCESS;
 
@@ -108,10 +109,10 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetQueryPoolResults(
       union pipe_query_result result;
       bool ready = false;
       if (pool->queries[i]) {
-        ready = device->queue.ctx->get_query_result(device->queue.ctx,
-                                                    pool->queries[i],
-                                                    (flags & VK_QUERY_RESULT_WAIT_BIT),
-                                                    &result);
+        ready = pool->query_ctx[i]->get_query_result(pool->query_ctx[i],
+                                                     pool->queries[i],
+                                                     (flags & VK_QUERY_RESULT_WAIT_BIT),
+                                                     &result);
       } else {
         result.u64 = 0;
       }
@@ -200,14 +201,13 @@ VKAPI_ATTR void VKAPI_CALL lvp_ResetQueryPool(
    uint32_t                                    firstQuery,
    uint32_t                                    queryCount)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
    LVP_FROM_HANDLE(lvp_query_pool, pool, queryPool);
 
    for (uint32_t i = 0; i < queryCount; i++) {
       uint32_t idx = i + firstQuery;
 
       if (pool->queries[idx]) {
-         device->queue.ctx->destroy_query(device->queue.ctx, pool->queries[idx]);
+         pool->query_ctx[idx]->destroy_query(pool->query_ctx[idx], pool->queries[idx]);
          pool->queries[idx] = NULL;
       }
    }
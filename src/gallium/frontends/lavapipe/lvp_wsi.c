@@ -238,9 +238,20 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_AcquireNextImage2KHR(
                                                     pImageIndex);
 
    LVP_FROM_HANDLE(lvp_fence, fence, pAcquireInfo->fence);
+   LVP_FROM_HANDLE(lvp_semaphore, semaphore, pAcquireInfo->semaphore);
 
    if (fence && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
+      mtx_lock(&device->fence_lock);
       fence->signaled = true;
+      u_cnd_monotonic_broadcast(&device->fence_cond);
+      mtx_unlock(&device->fence_lock);
+   }
+   /* the image is ready right away, signal the semaphore from here */
+   if (semaphore && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
+      mtx_lock(&device->semaphore_lock);
+      semaphore->value = ++semaphore->pending_signals;
+      u_cnd_monotonic_broadcast(&device->semaphore_cond);
+      mtx_unlock(&device->semaphore_lock);
    }
    return result;
 }
@@ -252,7 +263,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_QueuePresentKHR(
    LVP_FROM_HANDLE(lvp_queue, queue, _queue);
    return wsi_common_queue_present(&queue->device->physical_device->wsi_device,
                                    lvp_device_to_handle(queue->device),
-                                   _queue, 0,
+                                   _queue, queue->family_index,
                                    pPresentInfo);
 }
 
@@ -1304,6 +1304,8 @@ _mesa_free_context_data(struct gl_context *ctx, bool destroy_debug_output)
 
    ralloc_free(ctx->SoftFP64);
 
+   util_dynarray_fini(&ctx->ProgramCacheKeys);
+
    /* unbind the context if it's currently bound */
    if (ctx == _mesa_get_current_context()) {
       _mesa_make_current(NULL, NULL, NULL);
@@ -5571,6 +5571,13 @@ struct gl_context
 
    struct disk_cache *Cache;
 
+   /**
+    * Keys of the programs this context found in or added to Cache, saved
+    * when the context is destroyed so the next run can prefetch them.
+    */
+   struct util_dynarray ProgramCacheKeys;
+   unsigned NumPrefetchedProgramCacheKeys;
+
    /**
     * \name GL_ARB_bindless_texture
     */
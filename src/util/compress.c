@@ -24,6 +24,7 @@
 #ifdef HAVE_COMPRESSION
 
 #include <assert.h>
+#include <stdlib.h>
 
 /* Ensure that zlib uses 'const' in 'z_const' declarations. */
 #ifndef ZLIB_CONST
@@ -36,6 +37,7 @@
 
 #ifdef HAVE_ZSTD
 #include "zstd.h"
+#include "c11/threads.h"
 #endif
 
 #include "util/compress.h"
@@ -44,6 +46,134 @@
 /* 3 is the recomended level, with 22 as the absolute maximum */
 #define ZSTD_COMPRESSION_LEVEL 3
 
+#ifdef HAVE_ZSTD
+struct util_compress_dict {
+   ZSTD_CDict *cdict;
+   ZSTD_DDict *ddict;
+};
+
+/* zstd contexts are expensive to set up and not thread safe, so each thread
+ * keeps its own for the lifetime of the thread.
+ */
+struct util_compress_thread_ctx {
+   ZSTD_CCtx *cctx;
+   ZSTD_DCtx *dctx;
+};
+
+static once_flag thread_ctx_once = ONCE_FLAG_INIT;
+static tss_t thread_ctx_key;
+static bool thread_ctx_key_valid;
+
+static void
+thread_ctx_destroy(void *data)
+{
+   struct util_compress_thread_ctx *ctx = data;
+
+   ZSTD_freeCCtx(ctx->cctx);
+   ZSTD_freeDCtx(ctx->dctx);
+   free(ctx);
+}
+
+static void
+thread_ctx_key_create(void)
+{
+   thread_ctx_key_valid =
+      tss_create(&thread_ctx_key, thread_ctx_destroy) == thrd_success;
+}
+
+static struct util_compress_thread_ctx *
+get_thread_ctx(void)
+{
+   call_once(&thread_ctx_once, thread_ctx_key_create);
+   if (!thread_ctx_key_valid)
+      return NULL;
+
+   struct util_compress_thread_ctx *ctx = tss_get(thread_ctx_key);
+   if (ctx)
+      return ctx;
+
+   ctx = calloc(1, sizeof(*ctx));
+   if (!ctx)
+      return NULL;
+
+   if (tss_set(thread_ctx_key, ctx) != thrd_success) {
+      free(ctx);
+      return NULL;
+   }
+
+   return ctx;
+}
+
+static ZSTD_CCtx *
+get_thread_cctx(void)
+{
+   struct util_compress_thread_ctx *ctx = get_thread_ctx();
+   if (!ctx)
+      return NULL;
+
+   if (!ctx->cctx)
+      ctx->cctx = ZSTD_createCCtx();
+
+   return ctx->cctx;
+}
+
+static ZSTD_DCtx *
+get_thread_dctx(void)
+{
+   struct util_compress_thread_ctx *ctx = get_thread_ctx();
+   if (!ctx)
+      return NULL;
+
+   if (!ctx->dctx)
+      ctx->dctx = ZSTD_createDCtx();
+
+   return ctx->dctx;
+}
+#endif
+
+/**
+ * Create a dictionary from data produced by the zstd dictionary trainer.
+ * Returns NULL if dictionaries aren't supported or the data is invalid.
+ */
+struct util_compress_dict *
+util_compress_dict_create(const void *dict_data, size_t dict_size)
+{
+#ifdef HAVE_ZSTD
+   /* Reject raw content, a dictionary without ID can't be told apart */
+   if (ZSTD_getDictID_fromDict(dict_data, dict_size) == 0)
+      return NULL;
+
+   struct util_compress_dict *dict = calloc(1, sizeof(*dict));
+   if (!dict)
+      return NULL;
+
+   dict->cdict = ZSTD_createCDict(dict_data, dict_size,
+                                  ZSTD_COMPRESSION_LEVEL);
+   dict->ddict = ZSTD_createDDict(dict_data, dict_size);
+   if (!dict->cdict || !dict->ddict) {
+      util_compress_dict_destroy(dict);
+      return NULL;
+   }
+
+   return dict;
+#else
+   return NULL;
+#endif
+}
+
+void
+util_compress_dict_destroy(struct util_compress_dict *dict)
+{
+#ifdef HAVE_ZSTD
+   if (!dict)
+      return;
+
+   ZSTD_freeCDict(dict->cdict);
+   ZSTD_freeDDict(dict->ddict);
+   free(dict);
+#endif
+}
+
 size_t
 util_compress_max_compressed_len(size_t in_data_size)
 {
@@ -72,11 +202,22 @@ util_compress_max_compressed_len(size_t in_data_size)
 /* Compress data and return the size of the compressed data */
 size_t
 util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
-                      uint8_t *out_data, size_t out_buff_size)
+                      uint8_t *out_data, size_t out_buff_size,
+                      const struct util_compress_dict *dict)
 {
 #ifdef HAVE_ZSTD
-   size_t ret = ZSTD_compress(out_data, out_buff_size, in_data, in_data_size,
-                              ZSTD_COMPRESSION_LEVEL);
+   ZSTD_CCtx *cctx = get_thread_cctx();
+   if (!cctx)
+      return 0;
+
+   size_t ret;
+   if (dict) {
+      ret = ZSTD_compress_usingCDict(cctx, out_data, out_buff_size,
+                                     in_data, in_data_size, dict->cdict);
+   } else {
+      ret = ZSTD_compressCCtx(cctx, out_data, out_buff_size,
+                              in_data, in_data_size, ZSTD_COMPRESSION_LEVEL);
+   }
    if (ZSTD_isError(ret))
       return 0;
 
@@ -119,13 +260,28 @@ util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
 
 /**
  * Decompresses data, returns true if successful.
+ *
+ * Data compressed without a dictionary can be decompressed with or without
+ * one, data compressed with a dictionary only with that same dictionary.
  */
 bool
 util_compress_inflate(const uint8_t *in_data, size_t in_data_size,
-                      uint8_t *out_data, size_t out_data_size)
+                      uint8_t *out_data, size_t out_data_size,
+                      const struct util_compress_dict *dict)
 {
 #ifdef HAVE_ZSTD
-   size_t ret = ZSTD_decompress(out_data, out_data_size, in_data, in_data_size);
+   ZSTD_DCtx *dctx = get_thread_dctx();
+   if (!dctx)
+      return false;
+
+   size_t ret;
+   if (dict) {
+      ret = ZSTD_decompress_usingDDict(dctx, out_data, out_data_size,
+                                       in_data, in_data_size, dict->ddict);
+   } else {
+      ret = ZSTD_decompressDCtx(dctx, out_data, out_data_size,
+                                in_data, in_data_size);
+   }
    return !ZSTD_isError(ret);
 #elif defined(HAVE_ZLIB)
    z_stream strm;
@@ -26,15 +26,26 @@
 #include <stdbool.h>
 #include <inttypes.h>
 
+/* A trained compression dictionary, only supported with zstd. */
+struct util_compress_dict;
+
+struct util_compress_dict *
+util_compress_dict_create(const void *dict_data, size_t dict_size);
+
+void
+util_compress_dict_destroy(struct util_compress_dict *dict);
+
 size_t
 util_compress_max_compressed_len(size_t in_data_size);
 
 bool
 util_compress_inflate(const uint8_t *in_data, size_t in_data_size,
-                      uint8_t *out_data, size_t out_data_size);
+                      uint8_t *out_data, size_t out_data_size,
+                      const struct util_compress_dict *dict);
 
 size_t
 util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
-                      uint8_t *out_data, size_t out_buff_size);
+                      uint8_t *out_data, size_t out_buff_size,
+                      const struct util_compress_dict *dict);
 
 #endif
@@ -44,6 +44,7 @@
 #include "util/mesa-sha1.h"
 #include "util/ralloc.h"
 #include "util/compiler.h"
+#include "util/compress.h"
 
 #include "disk_cache.h"
 #include "disk_cache_os.h"
@@ -161,6 +162,9 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
 
    cache->max_size = max_size;
 
+   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false))
+      cache->foz_db.max_size = max_size;
+
    /* 4 threads were chosen below because just about all modern CPUs currently
     * available that run Mesa have *at least* 4 cores. For these CPUs allowing
     * more threads can result in the queue being processed faster, thus
@@ -212,6 +216,14 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    DRV_KEY_CPY(drv_key_blob, &ptr_size, ptr_size_size)
    DRV_KEY_CPY(drv_key_blob, &driver_flags, driver_flags_size)
 
+   /* Single file entries are never rewritten, so ones compressed with an
+    * older dictionary would stay unreadable for good. Only use dictionaries
+    * with the multi file cache, where eviction replaces such entries.
+    */
+   if (!cache->path_init_failed &&
+       !env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false))
+      disk_cache_load_compress_dict(cache);
+
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
@@ -238,6 +250,7 @@ disk_cache_destroy(struct disk_cache *cache)
          foz_destroy(&cache->foz_db);
 
       disk_cache_destroy_mmap(cache);
+      util_compress_dict_destroy(cache->compress_dict);
    }
 
    ralloc_free(cache);
@@ -438,6 +451,9 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false)) {
       return disk_cache_load_item_foz(cache, key, size);
    } else {
+      if (!disk_cache_item_index_may_contain(cache, key))
+         return NULL;
+
       char *filename = disk_cache_get_cache_filename(cache, key);
       if (filename == NULL)
          return NULL;
@@ -446,6 +462,69 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    }
 }
 
+struct disk_cache_get_job {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   cache_key key;
+
+   disk_cache_get_batch_cb cb;
+   void *data;
+};
+
+static void
+cache_get_batch(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_get_job *dc_job = (struct disk_cache_get_job *) job;
+   size_t size;
+   void *blob = disk_cache_get(dc_job->cache, dc_job->key, &size);
+
+   dc_job->cb(dc_job->data, dc_job->key, blob, size);
+}
+
+static void
+destroy_get_job(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_get_job *dc_job = (struct disk_cache_get_job *) job;
+
+   util_queue_fence_destroy(&dc_job->fence);
+   free(job);
+}
+
+void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, disk_cache_get_batch_cb cb,
+                     void *data)
+{
+   for (unsigned i = 0; i < num_keys; i++) {
+      struct disk_cache_get_job *dc_job = NULL;
+
+      /* The blob callbacks belong to the application, don't call them from
+       * our threads.
+       */
+      if (!cache->blob_get_cb && !cache->path_init_failed)
+         dc_job = malloc(sizeof(struct disk_cache_get_job));
+
+      if (!dc_job) {
+         size_t size;
+         void *blob = disk_cache_get(cache, keys[i], &size);
+
+         cb(data, keys[i], blob, size);
+         continue;
+      }
+
+      dc_job->cache = cache;
+      memcpy(dc_job->key, keys[i], sizeof(cache_key));
+      dc_job->cb = cb;
+      dc_job->data = data;
+
+      util_queue_fence_init(&dc_job->fence);
+      util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
+                         cache_get_batch, destroy_get_job, 0);
+   }
+}
+
 void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -62,6 +62,10 @@ typedef signed long
 (*disk_cache_get_cb) (const void *key, signed long keySize,
                       void *value, signed long valueSize);
 
+typedef void
+(*disk_cache_get_batch_cb) (void *data, const cache_key key,
+                            void *blob, size_t size);
+
 struct cache_item_metadata {
    /**
     * The cache item type. This could be used to identify a GLSL cache item,
@@ -181,8 +185,8 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
 void
 disk_cache_destroy(struct disk_cache *cache);
 
-/* Wait for all previous disk_cache_put() calls to be processed (used for unit
- * testing).
+/* Wait for all previous disk_cache_put() and disk_cache_get_batch() calls to
+ * be processed (used for unit testing).
  */
 void
 disk_cache_wait_for_idle(struct disk_cache *cache);
@@ -239,6 +243,21 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Retrieve the items stored under the \num_keys names in \keys in the
+ * background, e.g. to warm up the cache before the items are needed.
+ *
+ * The lookups are spread over the cache threads and \cb is called once per
+ * key, from one of those threads, with \data, the key and the object as
+ * disk_cache_get() would return it (NULL on a miss).  The callback takes
+ * ownership of \blob.  The keys are copied so \keys can be freed as soon as
+ * this returns.
+ */
+void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, disk_cache_get_batch_cb cb,
+                     void *data);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -317,6 +336,14 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, disk_cache_get_batch_cb cb,
+                     void *data)
+{
+   return;
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -36,11 +36,6 @@
 #include "util/compress.h"
 #include "util/crc32.h"
 
-struct cache_entry_file_data {
-   uint32_t crc32;
-   uint32_t uncompressed_size;
-};
-
 #if DETECT_OS_WINDOWS
 /* TODO: implement disk cache support on windows */
 
@@ -48,6 +43,7 @@ struct cache_entry_file_data {
 
 #include <dirent.h>
 #include <errno.h>
+#include <ctype.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <string.h>
@@ -62,6 +58,7 @@ struct cache_entry_file_data {
 #include "util/debug.h"
 #include "util/disk_cache.h"
 #include "util/disk_cache_os.h"
+#include "util/os_file.h"
 #include "util/ralloc.h"
 #include "util/rand_xor.h"
 
@@ -277,9 +274,121 @@ is_regular_non_tmp_file(const char *path, const struct stat *sb,
    return true;
 }
 
+/* The item index fingerprint of a key, never 0 as that marks free slots. */
+static uint64_t
+item_index_fingerprint(const cache_key key)
+{
+   uint64_t fingerprint;
+   memcpy(&fingerprint, key, sizeof(fingerprint));
+   return fingerprint ? fingerprint : 1;
+}
+
+static struct cache_item_index_bucket *
+item_index_bucket(struct disk_cache *cache, const cache_key key)
+{
+   uint32_t bucket;
+   memcpy(&bucket, key + sizeof(uint64_t), sizeof(bucket));
+   return &cache->item_index->buckets[bucket % CACHE_ITEM_INDEX_BUCKETS];
+}
+
+static void
+item_index_add(struct disk_cache *cache, const cache_key key)
+{
+   if (!cache->item_index)
+      return;
+
+   struct cache_item_index_bucket *bucket = item_index_bucket(cache, key);
+   uint64_t fingerprint = item_index_fingerprint(key);
+
+   for (unsigned i = 0; i < CACHE_ITEM_INDEX_WAYS; i++) {
+      if (p_atomic_read(&bucket->fingerprints[i]) == fingerprint)
+         return;
+   }
+
+   for (unsigned i = 0; i < CACHE_ITEM_INDEX_WAYS; i++) {
+      if (p_atomic_cmpxchg(&bucket->fingerprints[i], 0, fingerprint) == 0)
+         return;
+   }
+
+   p_atomic_set(&bucket->overflow, 1);
+}
+
+static void
+item_index_remove(struct disk_cache *cache, const cache_key key)
+{
+   if (!cache->item_index)
+      return;
+
+   struct cache_item_index_bucket *bucket = item_index_bucket(cache, key);
+   uint64_t fingerprint = item_index_fingerprint(key);
+
+   /* Racing adds may have stored the key twice */
+   for (unsigned i = 0; i < CACHE_ITEM_INDEX_WAYS; i++)
+      p_atomic_cmpxchg(&bucket->fingerprints[i], fingerprint, 0);
+}
+
+/* Whether the item for key may be on disk. This only returns false when the
+ * item is definitely missing, so that misses don't need to touch the file
+ * system.
+ */
+bool
+disk_cache_item_index_may_contain(struct disk_cache *cache,
+                                  const cache_key key)
+{
+   if (!cache->item_index || !p_atomic_read(&cache->item_index->ready))
+      return true;
+
+   struct cache_item_index_bucket *bucket = item_index_bucket(cache, key);
+   uint64_t fingerprint = item_index_fingerprint(key);
+
+   if (p_atomic_read(&bucket->overflow))
+      return true;
+
+   for (unsigned i = 0; i < CACHE_ITEM_INDEX_WAYS; i++) {
+      if (p_atomic_read(&bucket->fingerprints[i]) == fingerprint)
+         return true;
+   }
+
+   return false;
+}
+
+/* Recover the key of a cache item from its path, see
+ * disk_cache_get_cache_filename().
+ */
+static bool
+cache_key_from_filename(const char *filename, cache_key key)
+{
+   size_t len = strlen(filename);
+   char buf[41];
+
+   if (len < 41 || filename[len - 39] != '/')
+      return false;
+
+   buf[0] = filename[len - 41];
+   buf[1] = filename[len - 40];
+   memcpy(buf + 2, filename + len - 38, 39);
+
+   for (unsigned i = 0; i < 40; i++) {
+      if (!isxdigit(buf[i]))
+         return false;
+   }
+
+   _mesa_sha1_hex_to_sha1(key, buf);
+   return true;
+}
+
+static void
+item_index_remove_filename(struct disk_cache *cache, const char *filename)
+{
+   cache_key key;
+
+   if (cache->item_index && cache_key_from_filename(filename, key))
+      item_index_remove(cache, key);
+}
+
 /* Returns the size of the deleted file, (or 0 on any error). */
 static size_t
-unlink_lru_file_from_directory(const char *path)
+unlink_lru_file_from_directory(struct disk_cache *cache, const char *path)
 {
    struct list_head *lru_file_list =
       choose_lru_file_matching(path, is_regular_non_tmp_file);
@@ -291,8 +400,10 @@ unlink_lru_file_from_directory(const char *path)
    size_t total_unlinked_size = 0;
    struct lru_file *e;
    LIST_FOR_EACH_ENTRY(e, lru_file_list, node) {
-      if (unlink(e->lru_name) == 0)
+      if (unlink(e->lru_name) == 0) {
+         item_index_remove_filename(cache, e->lru_name);
          total_unlinked_size += e->lru_file_size;
+      }
    }
    free_lru_file_list(lru_file_list);
 
@@ -403,7 +514,7 @@ disk_cache_evict_lru_item(struct disk_cache *cache)
    if (asprintf(&dir_path, "%s/%02" PRIx64 , cache->path, rand64 & 0xff) < 0)
       return;
 
-   size_t size = unlink_lru_file_from_directory(dir_path);
+   size_t size = unlink_lru_file_from_directory(cache, dir_path);
 
    free(dir_path);
 
@@ -430,7 +541,7 @@ disk_cache_evict_lru_item(struct disk_cache *cache)
    struct lru_file *lru_file_dir =
       list_first_entry(lru_file_list, struct lru_file, node);
 
-   size = unlink_lru_file_from_directory(lru_file_dir->lru_name);
+   size = unlink_lru_file_from_directory(cache, lru_file_dir->lru_name);
 
    free_lru_file_list(lru_file_list);
 
@@ -448,6 +559,7 @@ disk_cache_evict_item(struct disk_cache *cache, char *filename)
    }
 
    unlink(filename);
+   item_index_remove_filename(cache, filename);
    free(filename);
 
    if (sb.st_blocks)
@@ -512,7 +624,8 @@ parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
    /* Uncompress the cache data */
    uncompressed_data = malloc(cf_data->uncompressed_size);
    if (!util_compress_inflate(data, cache_data_size, uncompressed_data,
-                              cf_data->uncompressed_size))
+                              cf_data->uncompressed_size,
+                              cache->compress_dict))
       goto fail;
 
    if (size)
@@ -551,8 +664,15 @@ disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size)
 
     uint8_t *uncompressed_data =
        parse_and_validate_cache_item(cache, data, sb.st_size, size);
-   if (!uncompressed_data)
+   if (!uncompressed_data) {
+      /* Remove items which can't be read, e.g. because they were compressed
+       * with a dictionary which has been replaced since, so that they can be
+       * written again.
+       */
+      disk_cache_evict_item(cache, filename);
+      filename = NULL;
       goto fail;
+   }
 
    free(data);
    free(filename);
@@ -605,7 +725,8 @@ create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
 
    size_t compressed_size =
       util_compress_deflate(dc_job->data, dc_job->size,
-                            compressed_data, max_buf);
+                            compressed_data, max_buf,
+                            dc_job->cache->compress_dict);
    if (compressed_size == 0)
       goto fail;
 
@@ -714,6 +835,8 @@ disk_cache_write_item_to_disk(struct disk_cache_put_job *dc_job,
     */
    fd_final = open(filename, O_RDONLY | O_CLOEXEC);
    if (fd_final != -1) {
+      /* In case a racing eviction dropped it from the index */
+      item_index_add(dc_job->cache, dc_job->key);
       unlink(filename_tmp);
       goto done;
    }
@@ -751,6 +874,7 @@ disk_cache_write_item_to_disk(struct disk_cache_put_job *dc_job,
    }
 
    p_atomic_add(dc_job->cache->size, sb.st_blocks * 512);
+   item_index_add(dc_job->cache, dc_job->key);
 
  done:
    if (fd_final != -1)
@@ -907,6 +1031,87 @@ disk_cache_load_cache_index(void *mem_ctx, struct disk_cache *cache)
    return foz_prepare(&cache->foz_db, cache->path);
 }
 
+/* Add all items already in the cache directory to a new item index. */
+static void
+item_index_scan(struct disk_cache *cache)
+{
+   for (unsigned i = 0; i < 256; i++) {
+      char *dir_path;
+      if (asprintf(&dir_path, "%s/%02x", cache->path, i) == -1)
+         return;
+
+      DIR *dir = opendir(dir_path);
+      if (dir) {
+         struct dirent *dir_ent;
+         while ((dir_ent = readdir(dir)) != NULL) {
+            char *filename;
+            cache_key key;
+
+            if (strlen(dir_ent->d_name) != 38 ||
+                asprintf(&filename, "%s/%s", dir_path, dir_ent->d_name) == -1)
+               continue;
+
+            if (cache_key_from_filename(filename, key))
+               item_index_add(cache, key);
+            free(filename);
+         }
+         closedir(dir);
+      }
+      free(dir_path);
+   }
+}
+
+/* Map the item index, which records which items exist in the cache
+ * directory so that disk_cache_get() can answer misses without trying to
+ * open their files. It lives in its own file, as older versions of the
+ * cache resize the index file to what they expect.
+ *
+ * The index may keep keys of items gone missing when processes race on the
+ * same item, which only costs a lookup of the missing file. It may also lose
+ * keys, and then disk_cache_get() returns NULL without touching the file
+ * system: the item is a false miss until it is put again.
+ */
+static void
+disk_cache_mmap_item_index(void *mem_ctx, struct disk_cache *cache)
+{
+   const size_t size = sizeof(struct cache_item_index);
+   bool created = true;
+
+   char *path = ralloc_asprintf(mem_ctx, "%s/item_index", cache->path);
+   if (path == NULL)
+      return;
+
+   int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+   if (fd == -1 && errno == EEXIST) {
+      fd = open(path, O_RDWR | O_CLOEXEC);
+      created = false;
+   }
+   if (fd == -1)
+      return;
+
+   struct stat sb;
+   if (fstat(fd, &sb) == -1 ||
+       (sb.st_size != size && ftruncate(fd, size) == -1)) {
+      close(fd);
+      return;
+   }
+
+   void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+      return;
+
+   cache->item_index = map;
+
+   /* Until the items which were there before are in, the index can't be
+    * trusted to rule anything out.
+    */
+   if (created) {
+      item_index_scan(cache);
+      p_atomic_set(&cache->item_index->ready, 1);
+   }
+}
+
 bool
 disk_cache_mmap_cache_index(void *mem_ctx, struct disk_cache *cache,
                             char *path)
@@ -958,6 +1163,9 @@ disk_cache_mmap_cache_index(void *mem_ctx, struct disk_cache *cache,
    cache->stored_keys = cache->index_mmap + sizeof(uint64_t);
    mapped = true;
 
+   if (!env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false))
+      disk_cache_mmap_item_index(mem_ctx, cache);
+
 path_fail:
    if (fd != -1)
       close(fd);
@@ -969,6 +1177,45 @@ void
 disk_cache_destroy_mmap(struct disk_cache *cache)
 {
    munmap(cache->index_mmap, cache->index_mmap_size);
+   if (cache->item_index)
+      munmap(cache->item_index, sizeof(struct cache_item_index));
+}
+
+/* Return the name of the compression dictionary for the cache items written
+ * with the given driver keys, see disk_cache_train_dict.c.
+ */
+char *
+disk_cache_get_dict_filename(void *mem_ctx, const char *path,
+                             const uint8_t *driver_keys_blob,
+                             size_t driver_keys_blob_size)
+{
+   unsigned char sha1[20];
+   char buf[41];
+
+   _mesa_sha1_compute(driver_keys_blob, driver_keys_blob_size, sha1);
+   _mesa_sha1_format(buf, sha1);
+
+   return ralloc_asprintf(mem_ctx, "%s/zstd_dict_%s", path, buf);
+}
+
+void
+disk_cache_load_compress_dict(struct disk_cache *cache)
+{
+   char *filename =
+      disk_cache_get_dict_filename(NULL, cache->path,
+                                   cache->driver_keys_blob,
+                                   cache->driver_keys_blob_size);
+   if (!filename)
+      return;
+
+   size_t size;
+   char *data = os_read_file(filename, &size);
+   ralloc_free(filename);
+   if (!data)
+      return;
+
+   cache->compress_dict = util_compress_dict_create(data, size);
+   free(data);
 }
 #endif
 
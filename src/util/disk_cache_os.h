@@ -43,6 +43,29 @@
 /* The number of keys that can be stored in the index. */
 #define CACHE_INDEX_MAX_KEYS (1 << CACHE_INDEX_KEY_BITS)
 
+/* Number of buckets and slots per bucket of the item index. */
+#define CACHE_ITEM_INDEX_BUCKETS (1 << 15)
+#define CACHE_ITEM_INDEX_WAYS 7
+
+/* A cache line worth of key fingerprints of the cache items on disk. */
+struct cache_item_index_bucket {
+   /* Set for good once an item didn't fit, the bucket can't rule out
+    * anything from then on.
+    */
+   uint64_t overflow;
+   uint64_t fingerprints[CACHE_ITEM_INDEX_WAYS];
+};
+
+/* Layout of the item index file, which is shared between processes, see
+ * disk_cache_mmap_item_index().
+ */
+struct cache_item_index {
+   /* Set once the index covers all items in the cache directory */
+   uint64_t ready;
+   uint64_t pad[7];
+   struct cache_item_index_bucket buckets[CACHE_ITEM_INDEX_BUCKETS];
+};
+
 struct disk_cache {
    /* The path to the cache directory. */
    char *path;
@@ -66,6 +89,9 @@ struct disk_cache {
    /* Pointer to stored keys, (within index_mmap). */
    uint8_t *stored_keys;
 
+   /* The mmapped item index within the cache directory, or NULL. */
+   struct cache_item_index *item_index;
+
    /* Maximum size of all cached objects (in bytes). */
    uint64_t max_size;
 
@@ -73,10 +99,19 @@ struct disk_cache {
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
 
+   /* Dictionary the cache items are compressed with, or NULL. */
+   struct util_compress_dict *compress_dict;
+
    disk_cache_put_cb blob_put_cb;
    disk_cache_get_cb blob_get_cb;
 };
 
+/* Stored right before the compressed data of a cache item */
+struct cache_entry_file_data {
+   uint32_t crc32;
+   uint32_t uncompressed_size;
+};
+
 struct disk_cache_put_job {
    struct util_queue_fence fence;
 
@@ -103,6 +138,10 @@ disk_cache_evict_lru_item(struct disk_cache *cache);
 void
 disk_cache_evict_item(struct disk_cache *cache, char *filename);
 
+bool
+disk_cache_item_index_may_contain(struct disk_cache *cache,
+                                  const cache_key key);
+
 void *
 disk_cache_load_item_foz(struct disk_cache *cache, const cache_key key,
                          size_t *size);
@@ -133,6 +172,14 @@ disk_cache_mmap_cache_index(void *mem_ctx, struct disk_cache *cache,
 void
 disk_cache_destroy_mmap(struct disk_cache *cache);
 
+char *
+disk_cache_get_dict_filename(void *mem_ctx, const char *path,
+                             const uint8_t *driver_keys_blob,
+                             size_t driver_keys_blob_size);
+
+void
+disk_cache_load_compress_dict(struct disk_cache *cache);
+
 #endif
 
 #endif /* DISK_CACHE_OS_H */
@@ -0,0 +1,469 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * Train zstd dictionaries for the items of a (multiple file) shader cache
+ * directory.
+ *
+ * Cache items are small and very similar to each other, which compresses
+ * poorly one at a time.  This groups the items by the driver which wrote
+ * them, trains one dictionary per driver and stores it in the cache
+ * directory, named after the driver keys so that it goes out of use along
+ * with the items when the driver changes.  The items are then recompressed
+ * with the new dictionary, which new cache instances pick up.
+ *
+ * Nothing else should be using the cache while this runs.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zdict.h>
+
+#include "util/blob.h"
+#include "util/compress.h"
+#include "util/crc32.h"
+#include "util/disk_cache.h"
+#include "util/disk_cache_os.h"
+#include "util/os_file.h"
+#include "util/ralloc.h"
+#include "util/u_dynarray.h"
+
+/* zstd recommends about 100KB for dictionaries, and a hundred times that
+ * in samples.
+ */
+#define DEFAULT_DICT_SIZE (112 * 1024)
+#define MAX_SAMPLES_SIZE (128 * 1024 * 1024)
+#define MIN_SAMPLES 16
+
+/* The items written by one driver */
+struct item_group {
+   uint8_t *driver_keys_blob;
+   size_t driver_keys_blob_size;
+
+   /* Dictionary the items are currently compressed with, if any */
+   struct util_compress_dict *dict;
+
+   struct util_dynarray filenames;
+   struct util_dynarray samples;
+   struct util_dynarray sample_sizes;
+};
+
+/* A cache item split into everything before the compressed data, which is
+ * kept as is, and the uncompressed data.
+ */
+struct cache_item {
+   uint8_t *file_data;
+   size_t header_size;
+   struct cache_entry_file_data *cf_data;
+   uint8_t *data;
+};
+
+static const char *cache_path;
+
+/**
+ * Find the size of the driver keys at the start of a cache item, see
+ * disk_cache_create().
+ */
+static size_t
+driver_keys_blob_size(const uint8_t *data, size_t size)
+{
+   const uint8_t *end = data + size;
+   const uint8_t *p = data + 1;
+
+   /* driver id and gpu name */
+   for (unsigned i = 0; i < 2; i++) {
+      p = p < end ? memchr(p, '\0', end - p) : NULL;
+      if (!p)
+         return 0;
+      p++;
+   }
+
+   /* pointer size and driver flags */
+   p += 1 + sizeof(uint64_t);
+
+   return p <= end ? p - data : 0;
+}
+
+static bool
+read_item(const char *filename, struct item_group *group,
+          struct cache_item *item)
+{
+   struct blob_reader reader;
+   size_t size;
+
+   item->data = NULL;
+   item->file_data = (uint8_t *) os_read_file(filename, &size);
+   if (!item->file_data)
+      return false;
+
+   blob_reader_init(&reader, item->file_data, size);
+   blob_skip_bytes(&reader, group->driver_keys_blob_size);
+
+   if (blob_read_uint32(&reader) == CACHE_ITEM_TYPE_GLSL) {
+      uint32_t num_keys = blob_read_uint32(&reader);
+      blob_skip_bytes(&reader, num_keys * sizeof(cache_key));
+   }
+
+   item->cf_data = (struct cache_entry_file_data *)
+      blob_read_bytes(&reader, sizeof(struct cache_entry_file_data));
+   if (reader.overrun)
+      goto fail;
+
+   item->header_size = reader.current - reader.data;
+
+   const uint8_t *compressed = reader.current;
+   size_t compressed_size = reader.end - reader.current;
+   if (item->cf_data->crc32 != util_hash_crc32(compressed, compressed_size))
+      goto fail;
+
+   item->data = malloc(item->cf_data->uncompressed_size);
+   if (!item->data ||
+       !util_compress_inflate(compressed, compressed_size, item->data,
+                              item->cf_data->uncompressed_size, group->dict))
+      goto fail;
+
+   return true;
+
+fail:
+   free(item->data);
+   free(item->file_data);
+   return false;
+}
+
+static struct item_group *
+find_group(struct util_dynarray *groups, const uint8_t *data, size_t size)
+{
+   size_t keys_size = driver_keys_blob_size(data, size);
+   if (!keys_size)
+      return NULL;
+
+   util_dynarray_foreach(groups, struct item_group, group) {
+      if (group->driver_keys_blob_size == keys_size &&
+          memcmp(group->driver_keys_blob, data, keys_size) == 0)
+         return group;
+   }
+
+   struct item_group *group =
+      util_dynarray_grow(groups, struct item_group, 1);
+   if (!group)
+      return NULL;
+
+   memset(group, 0, sizeof(*group));
+   group->driver_keys_blob = malloc(keys_size);
+   if (!group->driver_keys_blob) {
+      groups->size -= sizeof(struct item_group);
+      return NULL;
+   }
+   memcpy(group->driver_keys_blob, data, keys_size);
+   group->driver_keys_blob_size = keys_size;
+   util_dynarray_init(&group->filenames, NULL);
+   util_dynarray_init(&group->samples, NULL);
+   util_dynarray_init(&group->sample_sizes, NULL);
+
+   char *dict_filename =
+      disk_cache_get_dict_filename(NULL, cache_path, data, keys_size);
+   size_t dict_size;
+   char *dict_data = os_read_file(dict_filename, &dict_size);
+   if (dict_data)
+      group->dict = util_compress_dict_create(dict_data, dict_size);
+   free(dict_data);
+   ralloc_free(dict_filename);
+
+   return group;
+}
+
+static void
+add_item(struct util_dynarray *groups, const char *filename)
+{
+   uint8_t head[512];
+   FILE *f = fopen(filename, "rb");
+   if (!f)
+      return;
+
+   size_t size = fread(head, 1, sizeof(head), f);
+   fclose(f);
+
+   struct item_group *group = find_group(groups, head, size);
+   if (!group)
+      return;
+
+   char *name = ralloc_strdup(NULL, filename);
+   util_dynarray_append(&group->filenames, char *, name);
+
+   if (group->samples.size >= MAX_SAMPLES_SIZE)
+      return;
+
+   struct cache_item item;
+   if (!read_item(filename, group, &item))
+      return;
+
+   size_t data_size = item.cf_data->uncompressed_size;
+   void *sample = util_dynarray_grow_bytes(&group->samples, 1, data_size);
+   if (sample) {
+      memcpy(sample, item.data, data_size);
+      util_dynarray_append(&group->sample_sizes, size_t, data_size);
+   }
+
+   free(item.data);
+   free(item.file_data);
+}
+
+static void
+scan_cache_dir(struct util_dynarray *groups)
+{
+   DIR *dir = opendir(cache_path);
+   if (!dir)
+      return;
+
+   struct dirent *entry;
+   while ((entry = readdir(dir)) != NULL) {
+      /* items live in the two character subdirectories */
+      if (strlen(entry->d_name) != 2 || entry->d_name[0] == '.')
+         continue;
+
+      char *subdir_path = ralloc_asprintf(NULL, "%s/%s", cache_path,
+                                          entry->d_name);
+      DIR *subdir = opendir(subdir_path);
+      if (!subdir) {
+         ralloc_free(subdir_path);
+         continue;
+      }
+
+      struct dirent *item_entry;
+      while ((item_entry = readdir(subdir)) != NULL) {
+         size_t len = strlen(item_entry->d_name);
+         if (item_entry->d_name[0] == '.' ||
+             (len > 4 && !strcmp(item_entry->d_name + len - 4, ".tmp")))
+            continue;
+
+         char *filename = ralloc_asprintf(NULL, "%s/%s", subdir_path,
+                                          item_entry->d_name);
+         add_item(groups, filename);
+         ralloc_free(filename);
+      }
+
+      closedir(subdir);
+      ralloc_free(subdir_path);
+   }
+
+   closedir(dir);
+}
+
+static bool
+write_file(const char *filename, const void *data, size_t size)
+{
+   char *tmp = ralloc_asprintf(NULL, "%s.tmp", filename);
+   FILE *f = fopen(tmp, "wb");
+   bool ok = f != NULL;
+
+   if (f) {
+      ok = fwrite(data, 1, size, f) == size;
+      ok = fclose(f) == 0 && ok;
+   }
+
+   /* rename so that readers never see partial files */
+   if (ok)
+      ok = rename(tmp, filename) == 0;
+   if (!ok)
+      unlink(tmp);
+
+   ralloc_free(tmp);
+   return ok;
+}
+
+/**
+ * Recompress an item with a new dictionary, returns the change in size.
+ */
+static ssize_t
+recompress_item(const char *filename, struct item_group *group,
+                const struct util_compress_dict *dict)
+{
+   struct cache_item item;
+   if (!read_item(filename, group, &item))
+      return 0;
+
+   size_t data_size = item.cf_data->uncompressed_size;
+   size_t old_size = item.header_size;
+   struct blob blob;
+   ssize_t saved = 0;
+
+   size_t max_size = util_compress_max_compressed_len(data_size);
+   uint8_t *compressed = malloc(max_size);
+   size_t compressed_size = compressed ?
+      util_compress_deflate(item.data, data_size, compressed, max_size, dict) :
+      0;
+
+   if (compressed_size) {
+      blob_init(&blob);
+      item.cf_data->crc32 = util_hash_crc32(compressed, compressed_size);
+      blob_write_bytes(&blob, item.file_data, item.header_size);
+      blob_write_bytes(&blob, compressed, compressed_size);
+
+      if (!blob.out_of_memory) {
+         struct stat sb;
+         if (stat(filename, &sb) == 0)
+            old_size = sb.st_size;
+         if (write_file(filename, blob.data, blob.size))
+            saved = old_size - blob.size;
+      }
+      blob_finish(&blob);
+   }
+
+   free(compressed);
+   free(item.data);
+   free(item.file_data);
+   return saved;
+}
+
+static void
+train_group(struct item_group *group, size_t dict_capacity)
+{
+   unsigned num_samples =
+      util_dynarray_num_elements(&group->sample_sizes, size_t);
+
+   /* the second string is the gpu name */
+   const char *driver_id = (const char *) group->driver_keys_blob + 1;
+   const char *gpu_name = driver_id + strlen(driver_id) + 1;
+
+   if (num_samples < MIN_SAMPLES) {
+      fprintf(stderr, "%s: only %u items, skipping\n", gpu_name, num_samples);
+      return;
+   }
+
+   void *dict_data = malloc(dict_capacity);
+   if (!dict_data)
+      return;
+
+   size_t dict_size =
+      ZDICT_trainFromBuffer(dict_data, dict_capacity,
+                            group->samples.data,
+                            util_dynarray_begin(&group->sample_sizes),
+                            num_samples);
+   if (ZDICT_isError(dict_size)) {
+      fprintf(stderr, "%s: training failed: %s\n", gpu_name,
+              ZDICT_getErrorName(dict_size));
+      free(dict_data);
+      return;
+   }
+
+   struct util_compress_dict *dict =
+      util_compress_dict_create(dict_data, dict_size);
+   char *dict_filename =
+      disk_cache_get_dict_filename(NULL, cache_path, group->driver_keys_blob,
+                                   group->driver_keys_blob_size);
+
+   if (!dict || !write_file(dict_filename, dict_data, dict_size)) {
+      fprintf(stderr, "%s: failed to write %s\n", gpu_name, dict_filename);
+      goto done;
+   }
+
+   /* The items compressed with the previous dictionary can't be read with
+    * the new one.
+    */
+   ssize_t saved = 0;
+   util_dynarray_foreach(&group->filenames, char *, filename)
+      saved += recompress_item(*filename, group, dict);
+
+   printf("%s: %u items, %zu byte dictionary, %zd bytes saved\n",
+          gpu_name,
+          (unsigned) util_dynarray_num_elements(&group->filenames, char *),
+          dict_size, saved - (ssize_t) dict_size);
+
+done:
+   ralloc_free(dict_filename);
+   util_compress_dict_destroy(dict);
+   free(dict_data);
+}
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr,
+           "Usage: %s [-s dict-size] [cache-dir]\n"
+           "\n"
+           "Train compression dictionaries for the items in a shader cache\n"
+           "and recompress them.  The cache directory defaults to the one\n"
+           "used by Mesa, MESA_DISK_CACHE_SINGLE_FILE caches aren't\n"
+           "supported.  Don't run applications using the cache meanwhile.\n",
+           name);
+}
+
+int
+main(int argc, char **argv)
+{
+   size_t dict_capacity = DEFAULT_DICT_SIZE;
+   int c;
+
+   while ((c = getopt(argc, argv, "s:h")) != -1) {
+      switch (c) {
+      case 's':
+         dict_capacity = strtoul(optarg, NULL, 0);
+         break;
+      default:
+         usage(argv[0]);
+         return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+   }
+
+   if (optind < argc) {
+      cache_path = argv[optind];
+   } else {
+      cache_path = disk_cache_generate_cache_dir(NULL, "", "");
+      if (!cache_path) {
+         fprintf(stderr, "can't find the cache directory\n");
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (dict_capacity < 1024) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   struct util_dynarray groups;
+   util_dynarray_init(&groups, NULL);
+
+   scan_cache_dir(&groups);
+
+   util_dynarray_foreach(&groups, struct item_group, group) {
+      train_group(group, dict_capacity);
+
+      util_dynarray_foreach(&group->filenames, char *, filename)
+         ralloc_free(*filename);
+      util_dynarray_fini(&group->filenames);
+      util_dynarray_fini(&group->samples);
+      util_dynarray_fini(&group->sample_sizes);
+      util_compress_dict_destroy(group->dict);
+      free(group->driver_keys_blob);
+   }
+   util_dynarray_fini(&groups);
+
+   return EXIT_SUCCESS;
+}
@@ -37,16 +37,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "crc32.h"
 #include "hash_table.h"
 #include "mesa-sha1.h"
+#include "os_time.h"
 #include "ralloc.h"
 
 #define FOZ_REF_MAGIC_SIZE 16
 
+/* Number of times to follow the writable db to new files before giving up */
+#define FOZ_MAX_REOPEN_TRIES 4
+
+/* How often a read miss looks for a db replaced by another process */
+#define FOZ_REPLACED_CHECK_INTERVAL_NS 1000000000ll
+
 static const uint8_t stream_reference_magic_and_version[FOZ_REF_MAGIC_SIZE] = {
    0x81, 'F', 'O', 'S',
    'S', 'I', 'L', 'I',
@@ -104,6 +112,22 @@ create_foz_db_filenames(char *cache_path, char *name, char **filename,
    return true;
 }
 
+static bool
+check_foz_magic(FILE *db_idx)
+{
+   uint8_t magic[FOZ_REF_MAGIC_SIZE];
+   if (fread(magic, 1, FOZ_REF_MAGIC_SIZE, db_idx) != FOZ_REF_MAGIC_SIZE)
+      return false;
+
+   if (memcmp(magic, stream_reference_magic_and_version,
+              FOZ_REF_MAGIC_SIZE - 1))
+      return false;
+
+   int version = magic[FOZ_REF_MAGIC_SIZE - 1];
+   return version <= FOSSILIZE_FORMAT_VERSION &&
+          version >= FOSSILIZE_FORMAT_MIN_COMPAT_VERSION;
+}
+
 
 /* This looks at stuff that was added to the index since the last time we looked at it. This is safe
  * to do without locking the file as we assume the file is append only */
@@ -149,8 +173,8 @@ update_foz_index(struct foz_db *foz_db, FILE *db_idx, unsigned file_idx)
       char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1] = {0};
       memcpy(hash_str, bytes_to_read, FOSSILIZE_BLOB_HASH_LENGTH);
 
-      struct foz_db_entry *entry = ralloc(foz_db->mem_ctx,
-                                          struct foz_db_entry);
+      struct foz_db_entry *entry = rzalloc(foz_db->mem_ctx,
+                                           struct foz_db_entry);
       entry->header = *header;
       entry->file_idx = file_idx;
       _mesa_sha1_hex_to_sha1(entry->key, hash_str);
@@ -169,6 +193,8 @@ update_foz_index(struct foz_db *foz_db, FILE *db_idx, unsigned file_idx)
       hash_str[16] = '\0';
       uint64_t key = strtoull(hash_str, NULL, 16);
       _mesa_hash_table_u64_insert(foz_db->index_db, key, entry);
+      if (file_idx == 0)
+         util_dynarray_append(&foz_db->entries, struct foz_db_entry *, entry);
 
       offset += header->payload_size;
    }
@@ -218,17 +244,7 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
    }
 
    if (len != 0) {
-      uint8_t magic[FOZ_REF_MAGIC_SIZE];
-      if (fread(magic, 1, FOZ_REF_MAGIC_SIZE, db_idx) != FOZ_REF_MAGIC_SIZE)
-         goto fail;
-
-      if (memcmp(magic, stream_reference_magic_and_version,
-                 FOZ_REF_MAGIC_SIZE - 1))
-         goto fail;
-
-      int version = magic[FOZ_REF_MAGIC_SIZE - 1];
-      if (version > FOSSILIZE_FORMAT_VERSION ||
-          version < FOSSILIZE_FORMAT_MIN_COMPAT_VERSION)
+      if (!check_foz_magic(db_idx))
          goto fail;
 
    } else {
@@ -257,6 +273,151 @@ fail:
    return false;
 }
 
+/* Whether the writable foz db files were replaced behind our back, which
+ * happens when another process compacts them.
+ */
+static bool
+foz_db_replaced(struct foz_db *foz_db)
+{
+   struct stat path_stat, file_stat;
+
+   if (stat(foz_db->filename, &path_stat) == -1 ||
+       fstat(fileno(foz_db->file[0]), &file_stat) == -1)
+      return false;
+   if (path_stat.st_dev != file_stat.st_dev ||
+       path_stat.st_ino != file_stat.st_ino)
+      return true;
+
+   if (stat(foz_db->idx_filename, &path_stat) == -1 ||
+       fstat(fileno(foz_db->db_idx), &file_stat) == -1)
+      return false;
+   return path_stat.st_dev != file_stat.st_dev ||
+          path_stat.st_ino != file_stat.st_ino;
+}
+
+/* foz_db_replaced() for the read path, where misses are common and
+ * compaction by another process is rare, so only check once in a while.
+ * The write path checks every time it takes the file lock, so a replaced
+ * db is never written to. Called with the mutex held.
+ */
+static bool
+foz_db_replaced_on_read(struct foz_db *foz_db)
+{
+   int64_t now = os_time_get_nano();
+
+   if (now - foz_db->replaced_check_time < FOZ_REPLACED_CHECK_INTERVAL_NS)
+      return false;
+
+   foz_db->replaced_check_time = now;
+   return foz_db_replaced(foz_db);
+}
+
+/* Start using new writable foz db files. The old ones stay open until
+ * foz_destroy() as other threads might still be waiting on their lock.
+ * Called with the mutex held.
+ */
+static void
+retire_foz_db_files(struct foz_db *foz_db, FILE *file, FILE *db_idx)
+{
+   util_dynarray_append(&foz_db->retired_files, FILE *, foz_db->file[0]);
+   util_dynarray_append(&foz_db->retired_files, FILE *, foz_db->db_idx);
+   foz_db->file[0] = file;
+   foz_db->db_idx = db_idx;
+}
+
+/* Forget about all entries of the writable foz db. Called with the mutex
+ * held.
+ */
+static void
+drop_foz_entries(struct foz_db *foz_db)
+{
+   util_dynarray_foreach(&foz_db->entries, struct foz_db_entry *, e) {
+      uint64_t hash = truncate_hash_to_64bits((*e)->key);
+      if (_mesa_hash_table_u64_search(foz_db->index_db, hash) == *e)
+         _mesa_hash_table_u64_remove(foz_db->index_db, hash);
+      ralloc_free(*e);
+   }
+   util_dynarray_clear(&foz_db->entries);
+}
+
+/* Reload the writable foz db after another process replaced it. Called with
+ * the mutex held.
+ */
+static bool
+reopen_foz_db(struct foz_db *foz_db)
+{
+   FILE *file = fopen(foz_db->filename, "a+b");
+   FILE *db_idx = fopen(foz_db->idx_filename, "a+b");
+
+   if (!check_files_opened_successfully(file, db_idx) ||
+       !check_foz_magic(db_idx)) {
+      if (file) {
+         fclose(file);
+         fclose(db_idx);
+      }
+      foz_db->alive = false;
+      return false;
+   }
+
+   drop_foz_entries(foz_db);
+   retire_foz_db_files(foz_db, file, db_idx);
+   update_foz_index(foz_db, foz_db->db_idx, 0);
+
+   return true;
+}
+
+/* Take the file lock of the writable foz db and the mutex, following the db
+ * to its new files if it was replaced in the meantime.
+ *
+ * The file lock belongs to the open file, so it doesn't exclude other threads
+ * of this process. flock_mtx does that, and is held until unlock_foz_db().
+ */
+static bool
+lock_foz_db(struct foz_db *foz_db)
+{
+   simple_mtx_lock(&foz_db->flock_mtx);
+
+   for (unsigned i = 0; i < FOZ_MAX_REOPEN_TRIES; i++) {
+      simple_mtx_lock(&foz_db->mtx);
+      FILE *file = foz_db->file[0];
+      simple_mtx_unlock(&foz_db->mtx);
+
+      /* Wait for 1 second. This is done outside of the mutex as I believe
+       * there is more potential for file contention than mtx contention of
+       * significant length.
+       */
+      if (lock_file_with_timeout(file, 1000000000) == -1)
+         break;
+
+      simple_mtx_lock(&foz_db->mtx);
+
+      /* Someone else might have switched to new files already */
+      if (file == foz_db->file[0]) {
+         if (!foz_db_replaced(foz_db))
+            return true;
+         reopen_foz_db(foz_db);
+      }
+
+      bool alive = foz_db->alive;
+      simple_mtx_unlock(&foz_db->mtx);
+      flock(fileno(file), LOCK_UN);
+
+      if (!alive)
+         break;
+   }
+
+   simple_mtx_unlock(&foz_db->flock_mtx);
+   return false;
+}
+
+/* Release the file lock taken by lock_foz_db(), after the mutex. */
+static void
+unlock_foz_db(struct foz_db *foz_db, FILE *file)
+{
+   flock(fileno(file), LOCK_UN);
+   simple_mtx_unlock(&foz_db->flock_mtx);
+}
+
 /* Here we open mesa cache foz dbs files. If the files exist we load the index
  * db into a hash table. The index db contains the offsets needed to later
  * read cache entries from the foz db containing the actual cache entries.
@@ -275,15 +436,19 @@ foz_prepare(struct foz_db *foz_db, char *cache_path)
    foz_db->file[0] = fopen(filename, "a+b");
    foz_db->db_idx = fopen(idx_filename, "a+b");
 
-   free(filename);
-   free(idx_filename);
+   /* Kept around to notice and to do compaction */
+   foz_db->filename = filename;
+   foz_db->idx_filename = idx_filename;
 
    if (!check_files_opened_successfully(foz_db->file[0], foz_db->db_idx))
       return false;
 
    simple_mtx_init(&foz_db->mtx, mtx_plain);
+   simple_mtx_init(&foz_db->flock_mtx, mtx_plain);
    foz_db->mem_ctx = ralloc_context(NULL);
    foz_db->index_db = _mesa_hash_table_u64_create(NULL);
+   util_dynarray_init(&foz_db->entries, foz_db->mem_ctx);
+   util_dynarray_init(&foz_db->retired_files, foz_db->mem_ctx);
 
    if (!load_foz_dbs(foz_db, foz_db->db_idx, 0, false))
       return false;
@@ -340,9 +505,16 @@ foz_destroy(struct foz_db *foz_db)
          fclose(foz_db->file[i]);
    }
 
+   free(foz_db->filename);
+   free(foz_db->idx_filename);
+   foz_db->filename = foz_db->idx_filename = NULL;
+
    if (foz_db->mem_ctx) {
+      util_dynarray_foreach(&foz_db->retired_files, FILE *, f)
+         fclose(*f);
       _mesa_hash_table_u64_destroy(foz_db->index_db);
       ralloc_free(foz_db->mem_ctx);
+      simple_mtx_destroy(&foz_db->flock_mtx);
       simple_mtx_destroy(&foz_db->mtx);
    }
 }
@@ -366,7 +538,8 @@ foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    struct foz_db_entry *entry =
       _mesa_hash_table_u64_search(foz_db->index_db, hash);
    if (!entry) {
-      update_foz_index(foz_db, foz_db->db_idx, 0);
+      if (!foz_db_replaced_on_read(foz_db) || !reopen_foz_db(foz_db))
+         update_foz_index(foz_db, foz_db->db_idx, 0);
       entry = _mesa_hash_table_u64_search(foz_db->index_db, hash);
    }
    if (!entry) {
@@ -402,6 +575,8 @@ foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
          goto fail;
    }
 
+   entry->last_access = ++foz_db->access_count;
+
    simple_mtx_unlock(&foz_db->mtx);
 
    if (size)
@@ -418,6 +593,64 @@ fail:
    return NULL;
 }
 
+/* Append an entry to a foz db and its index db, returning the entry's offset
+ * in the foz db.
+ */
+static bool
+append_foz_entry(FILE *file, FILE *db_idx, const uint8_t *cache_key_160bit,
+                 const struct foz_payload_header *blob_header,
+                 const void *blob, uint64_t *entry_offset)
+{
+   fseek(file, 0, SEEK_END);
+
+   /* Write hash header to db */
+   char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1]; /* 40 digits + null */
+   _mesa_sha1_format(hash_str, cache_key_160bit);
+   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, file) !=
+       FOSSILIZE_BLOB_HASH_LENGTH)
+      return false;
+
+   uint64_t offset = ftell(file);
+
+   /* Write db entry header */
+   if (fwrite(blob_header, 1, sizeof(*blob_header), file) !=
+       sizeof(*blob_header))
+      return false;
+
+   /* Now write the db entry blob */
+   if (fwrite(blob, 1, blob_header->payload_size, file) !=
+       blob_header->payload_size)
+      return false;
+
+   /* Flush everything to file to reduce chance of cache corruption */
+   fflush(file);
+
+   /* Write hash header to index db */
+   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, db_idx) !=
+       FOSSILIZE_BLOB_HASH_LENGTH)
+      return false;
+
+   struct foz_payload_header header;
+   header.uncompressed_size = sizeof(uint64_t);
+   header.format = FOSSILIZE_COMPRESSION_NONE;
+   header.payload_size = sizeof(uint64_t);
+   header.crc = 0;
+
+   if (fwrite(&header, 1, sizeof(header), db_idx) !=
+       sizeof(header))
+      return false;
+
+   if (fwrite(&offset, 1, sizeof(uint64_t), db_idx) !=
+       sizeof(uint64_t))
+      return false;
+
+   /* Flush everything to file to reduce chance of cache corruption */
+   fflush(db_idx);
+
+   *entry_offset = offset;
+   return true;
+}
+
 /* Here we write the cache entry to disk and store its offset in the index db.
  */
 bool
@@ -429,13 +662,10 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    if (!foz_db->alive)
       return false;
 
-   /* Wait for 1 second. This is done outside of the mutex as I believe there is more potential
-    * for file contention than mtx contention of significant length. */
-   int err = lock_file_with_timeout(foz_db->file[0], 1000000000);
-   if (err == -1)
-      goto fail_file;
+   if (!lock_foz_db(foz_db))
+      return false;
 
-   simple_mtx_lock(&foz_db->mtx);
+   FILE *file = foz_db->file[0];
 
    update_foz_index(foz_db, foz_db->db_idx, 0);
 
@@ -443,7 +673,8 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
       _mesa_hash_table_u64_search(foz_db->index_db, hash);
    if (entry) {
       simple_mtx_unlock(&foz_db->mtx);
-      return NULL;
+      unlock_foz_db(foz_db, file);
+      return false;
    }
 
    /* Prepare db entry header and blob ready for writing */
@@ -453,66 +684,273 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    header.payload_size = blob_size;
    header.crc = util_hash_crc32(blob, blob_size);
 
-   fseek(foz_db->file[0], 0, SEEK_END);
-
-   /* Write hash header to db */
-   char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1]; /* 40 digits + null */
-   _mesa_sha1_format(hash_str, cache_key_160bit);
-   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, foz_db->file[0]) !=
-       FOSSILIZE_BLOB_HASH_LENGTH)
+   uint64_t offset;
+   if (!append_foz_entry(file, foz_db->db_idx, cache_key_160bit, &header,
+                         blob, &offset))
       goto fail;
 
-   off_t offset = ftell(foz_db->file[0]);
+   entry = rzalloc(foz_db->mem_ctx, struct foz_db_entry);
+   entry->header = header;
+   entry->offset = offset;
+   entry->file_idx = 0;
+   entry->last_access = ++foz_db->access_count;
+   memcpy(entry->key, cache_key_160bit, sizeof(entry->key));
+   _mesa_hash_table_u64_insert(foz_db->index_db, hash, entry);
+   util_dynarray_append(&foz_db->entries, struct foz_db_entry *, entry);
 
-   /* Write db entry header */
-   if (fwrite(&header, 1, sizeof(header), foz_db->file[0]) != sizeof(header))
-      goto fail;
+   /* Compact down to half the limit, so that the cost of rewriting the db
+    * is spread over at least as much data written in the meantime.
+    */
+   bool compact = foz_db->max_size &&
+                  offset + sizeof(header) + blob_size > foz_db->max_size;
 
-   /* Now write the db entry blob */
-   if (fwrite(blob, 1, blob_size, foz_db->file[0]) != blob_size)
-      goto fail;
+   simple_mtx_unlock(&foz_db->mtx);
+   unlock_foz_db(foz_db, file);
 
-   /* Flush everything to file to reduce chance of cache corruption */
-   fflush(foz_db->file[0]);
+   if (compact)
+      foz_compact(foz_db, foz_db->max_size / 2);
 
-   /* Write hash header to index db */
-   if (fwrite(hash_str, 1, FOSSILIZE_BLOB_HASH_LENGTH, foz_db->db_idx) !=
-       FOSSILIZE_BLOB_HASH_LENGTH)
+   return true;
+
+fail:
+   simple_mtx_unlock(&foz_db->mtx);
+   unlock_foz_db(foz_db, file);
+   return false;
+}
+
+/* Most recently used entries first. Entries this process didn't use are
+ * ordered by their offset, which reflects the order they were written in or
+ * their rank at the last compaction.
+ */
+static int
+compare_foz_entry_recency(const void *a, const void *b)
+{
+   const struct foz_db_entry *ea = *(const struct foz_db_entry **)a;
+   const struct foz_db_entry *eb = *(const struct foz_db_entry **)b;
+
+   if (ea->last_access != eb->last_access)
+      return ea->last_access > eb->last_access ? -1 : 1;
+   if (ea->offset != eb->offset)
+      return ea->offset > eb->offset ? -1 : 1;
+   return 0;
+}
+
+/* Free the entries of the writable foz db which are no longer in the index,
+ * because they were superseded by a later copy or evicted. Called with the
+ * mutex held.
+ */
+static void
+prune_foz_entries(struct foz_db *foz_db)
+{
+   struct foz_db_entry **entries = util_dynarray_begin(&foz_db->entries);
+   unsigned num_entries = 0;
+
+   util_dynarray_foreach(&foz_db->entries, struct foz_db_entry *, e) {
+      uint64_t hash = truncate_hash_to_64bits((*e)->key);
+      if (_mesa_hash_table_u64_search(foz_db->index_db, hash) == *e)
+         entries[num_entries++] = *e;
+      else
+         ralloc_free(*e);
+   }
+
+   /* Only shrinks, so there is nothing to reallocate */
+   foz_db->entries.size = num_entries * sizeof(*entries);
+}
+
+/* Rewrite the writable foz db keeping only the most recently used entries
+ * which fit in target_size bytes, then atomically replace the db files with
+ * the result. Other processes using the db switch to the new files the next
+ * time they write to it or miss in it.
+ *
+ * The entries are copied without holding the mutex, so reads aren't held up.
+ * Writers are, by the file lock.
+ *
+ * This may be called from a background thread, or offline on a db which is
+ * not in use.
+ */
+bool
+foz_compact(struct foz_db *foz_db, uint64_t target_size)
+{
+   struct foz_db_entry **entries = NULL;
+   struct foz_db_entry *kept = NULL;
+   char *tmp_filename = NULL;
+   char *tmp_idx_filename = NULL;
+   FILE *src = NULL;
+   FILE *tmp_file = NULL;
+   FILE *tmp_idx = NULL;
+   void *blob = NULL;
+   bool ret = false;
+
+   if (!foz_db->alive)
+      return false;
+
+   if (!lock_foz_db(foz_db))
+      return false;
+
+   FILE *file = foz_db->file[0];
+
+   update_foz_index(foz_db, foz_db->db_idx, 0);
+
+   /* Someone else might have beaten us to it */
+   fseek(file, 0, SEEK_END);
+   if ((uint64_t)ftell(file) <= target_size) {
+      simple_mtx_unlock(&foz_db->mtx);
+      unlock_foz_db(foz_db, file);
+      return true;
+   }
+
+   prune_foz_entries(foz_db);
+
+   /* Sort a copy, the entries array grows when entries are read back from
+    * the index.
+    */
+   unsigned num_entries =
+      util_dynarray_num_elements(&foz_db->entries, struct foz_db_entry *);
+   entries = malloc(MAX2(num_entries, 1) * sizeof(*entries));
+   kept = malloc(MAX2(num_entries, 1) * sizeof(*kept));
+   if (!entries || !kept) {
+      simple_mtx_unlock(&foz_db->mtx);
+      goto out;
+   }
+   memcpy(entries, util_dynarray_begin(&foz_db->entries),
+          num_entries * sizeof(*entries));
+
+   qsort(entries, num_entries, sizeof(*entries), compare_foz_entry_recency);
+
+   /* Move the entries to keep to the front, reading their headers on the
+    * way. The front stays sorted by rank. Keep a copy of them to work on
+    * once the mutex is dropped, reads update the originals.
+    */
+   unsigned num_kept = 0;
+   uint64_t size = FOZ_REF_MAGIC_SIZE;
+   for (unsigned i = 0; i < num_entries; i++) {
+      struct foz_db_entry *entry = entries[i];
+
+      if (fseek(file, entry->offset, SEEK_SET) < 0 ||
+          fread(&entry->header, 1, sizeof(entry->header), file) !=
+          sizeof(entry->header))
+         continue;
+
+      uint64_t entry_size = FOSSILIZE_BLOB_HASH_LENGTH +
+                            sizeof(entry->header) +
+                            entry->header.payload_size;
+      if (size + entry_size > target_size)
+         continue;
+
+      size += entry_size;
+      entries[i] = entries[num_kept];
+      kept[num_kept] = *entry;
+      entries[num_kept++] = entry;
+   }
+
+   simple_mtx_unlock(&foz_db->mtx);
+
+   /* Reads share the position of foz_db->file[0], use a file of our own.
+    * Nobody can replace the db while we hold its lock.
+    */
+   src = fopen(foz_db->filename, "rb");
+   if (!src)
+      goto out;
+
+   /* Start from scratch in case an earlier compaction got interrupted */
+   if (asprintf(&tmp_filename, "%s.tmp", foz_db->filename) == -1) {
+      tmp_filename = NULL;
+      goto out;
+   }
+   if (asprintf(&tmp_idx_filename, "%s.tmp", foz_db->idx_filename) == -1) {
+      tmp_idx_filename = NULL;
+      goto out;
+   }
+   unlink(tmp_filename);
+   unlink(tmp_idx_filename);
+
+   tmp_file = fopen(tmp_filename, "a+b");
+   tmp_idx = fopen(tmp_idx_filename, "a+b");
+   if (!check_files_opened_successfully(tmp_file, tmp_idx)) {
+      tmp_file = tmp_idx = NULL;
       goto fail;
+   }
 
-   header.uncompressed_size = sizeof(uint64_t);
-   header.format = FOSSILIZE_COMPRESSION_NONE;
-   header.payload_size = sizeof(uint64_t);
-   header.crc = 0;
+   /* Hold the new db's lock until we are done, so that processes which
+    * switch to it in the meantime don't start writing to it early.
+    */
+   if (flock(fileno(tmp_file), LOCK_EX | LOCK_NB) == -1)
+      goto fail;
 
-   if (fwrite(&header, 1, sizeof(header), foz_db->db_idx) !=
-       sizeof(header))
+   if (fwrite(stream_reference_magic_and_version, 1, FOZ_REF_MAGIC_SIZE,
+              tmp_file) != FOZ_REF_MAGIC_SIZE ||
+       fwrite(stream_reference_magic_and_version, 1, FOZ_REF_MAGIC_SIZE,
+              tmp_idx) != FOZ_REF_MAGIC_SIZE)
       goto fail;
+   fflush(tmp_file);
+   fflush(tmp_idx);
 
-   if (fwrite(&offset, 1, sizeof(uint64_t), foz_db->db_idx) !=
-       sizeof(uint64_t))
+   /* Least recently used first, so that offsets keep reflecting the rank.
+    * The copies get the new offsets.
+    */
+   for (unsigned i = num_kept; i-- > 0;) {
+      struct foz_db_entry *entry = &kept[i];
+      uint32_t data_sz = entry->header.payload_size;
+
+      free(blob);
+      blob = malloc(MAX2(data_sz, 1));
+      if (!blob ||
+          fseek(src, entry->offset + sizeof(entry->header), SEEK_SET) < 0 ||
+          fread(blob, 1, data_sz, src) != data_sz)
+         goto fail;
+
+      if (!append_foz_entry(tmp_file, tmp_idx, entry->key, &entry->header,
+                            blob, &entry->offset))
+         goto fail;
+   }
+
+   simple_mtx_lock(&foz_db->mtx);
+
+   if (rename(tmp_filename, foz_db->filename) == -1) {
+      simple_mtx_unlock(&foz_db->mtx);
       goto fail;
+   }
+   if (rename(tmp_idx_filename, foz_db->idx_filename) == -1) {
+      /* The db and its index don't match anymore, give up on it */
+      foz_db->alive = false;
+      simple_mtx_unlock(&foz_db->mtx);
+      goto fail;
+   }
 
-   /* Flush everything to file to reduce chance of cache corruption */
-   fflush(foz_db->db_idx);
+   for (unsigned i = 0; i < num_kept; i++)
+      entries[i]->offset = kept[i].offset;
 
-   entry = ralloc(foz_db->mem_ctx, struct foz_db_entry);
-   entry->header = header;
-   entry->offset = offset;
-   entry->file_idx = 0;
-   _mesa_sha1_hex_to_sha1(entry->key, hash_str);
-   _mesa_hash_table_u64_insert(foz_db->index_db, hash, entry);
+   for (unsigned i = num_kept; i < num_entries; i++) {
+      _mesa_hash_table_u64_remove(foz_db->index_db,
+                                  truncate_hash_to_64bits(entries[i]->key));
+   }
+   prune_foz_entries(foz_db);
 
+   retire_foz_db_files(foz_db, tmp_file, tmp_idx);
    simple_mtx_unlock(&foz_db->mtx);
-   flock(fileno(foz_db->file[0]), LOCK_UN);
 
-   return true;
+   flock(fileno(tmp_file), LOCK_UN);
+   tmp_file = tmp_idx = NULL;
+   ret = true;
 
 fail:
-   simple_mtx_unlock(&foz_db->mtx);
-fail_file:
-   flock(fileno(foz_db->file[0]), LOCK_UN);
-   return false;
+   if (tmp_file) {
+      fclose(tmp_file);
+      fclose(tmp_idx);
+      unlink(tmp_filename);
+      unlink(tmp_idx_filename);
+   }
+out:
+   unlock_foz_db(foz_db, file);
+
+   if (src)
+      fclose(src);
+   free(blob);
+   free(kept);
+   free(entries);
+   free(tmp_filename);
+   free(tmp_idx_filename);
+   return ret;
 }
 #else
 
@@ -544,4 +982,10 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    return false;
 }
 
+bool
+foz_compact(struct foz_db *foz_db, uint64_t target_size)
+{
+   return false;
+}
+
 #endif
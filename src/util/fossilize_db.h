@@ -42,6 +42,7 @@
 #include <stdio.h>
 
 #include "simple_mtx.h"
+#include "u_dynarray.h"
 
 /* Max number of DBs our implementation can read from at once */
 #define FOZ_MAX_DBS 9 /* Default DB + 8 Read only DBs */
@@ -69,15 +70,24 @@ struct foz_db_entry {
    uint8_t file_idx;
    uint8_t key[20];
    uint64_t offset;
+   uint64_t last_access;             /* Access stamp, for foz_compact() */
    struct foz_payload_header header;
 };
 
 struct foz_db {
    FILE *file[FOZ_MAX_DBS];          /* An array of all foz dbs */
    FILE *db_idx;                     /* The default writable foz db idx */
+   char *filename;                   /* Path of the default writable foz db */
+   char *idx_filename;               /* Path of the default writable foz db idx */
    simple_mtx_t mtx;                 /* Mutex for file/hash table read/writes */
+   simple_mtx_t flock_mtx;           /* Serializes file lock holders in-process */
    void *mem_ctx;
    struct hash_table_u64 *index_db;  /* Hash table of all foz db entries */
+   struct util_dynarray entries;     /* Entries of the writable foz db */
+   struct util_dynarray retired_files; /* Replaced writable foz db files */
+   uint64_t access_count;            /* Last access stamp handed out */
+   uint64_t max_size;                /* Compact beyond this size, 0 never */
+   int64_t replaced_check_time;      /* Last read miss check for new files */
    bool alive;
 };
 
@@ -95,4 +105,7 @@ bool
 foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                 const void *blob, size_t size);
 
+bool
+foz_compact(struct foz_db *foz_db, uint64_t target_size);
+
 #endif /* FOSSILIZE_DB_H */
@@ -37,6 +37,13 @@
 
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
+#include "util/disk_cache_os.h"
+#include "util/u_atomic.h"
+#include "util/ralloc.h"
+
+#ifdef HAVE_ZSTD
+#include <zdict.h>
+#endif
 
 bool error = false;
 
@@ -462,6 +469,80 @@ test_put_and_get(void)
    disk_cache_destroy(cache);
 }
 
+#ifdef HAVE_FLOCK
+static void
+test_single_file_eviction(void)
+{
+   struct disk_cache *cache;
+   uint8_t blobs[6][800];
+   uint8_t keys[6][20];
+   void *result;
+   size_t size;
+   unsigned i, j;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "5K", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   /* Random data, so that compression doesn't shrink the items much. */
+   for (i = 0; i < 6; i++) {
+      for (j = 0; j < sizeof(blobs[i]); j++)
+         blobs[i][j] = rand();
+      disk_cache_compute_key(cache, blobs[i], sizeof(blobs[i]), keys[i]);
+   }
+
+   /* Five items fit, wait after each one to keep them in order. */
+   for (i = 0; i < 5; i++) {
+      disk_cache_put(cache, keys[i], blobs[i], sizeof(blobs[i]), NULL);
+      disk_cache_wait_for_idle(cache);
+   }
+
+   for (i = 0; i < 5; i++) {
+      expect_true(does_cache_contain(cache, keys[i]),
+                  "single file cache holds items below MAX_SIZE");
+   }
+
+   /* Use the oldest item again, then overflow the cache. This compacts it
+    * to half of MAX_SIZE, which leaves room for two items.
+    */
+   result = disk_cache_get(cache, keys[0], &size);
+   expect_non_null(result, "disk_cache_get of oldest item (pointer)");
+   expect_equal(size, sizeof(blobs[0]), "disk_cache_get of oldest item (size)");
+   free(result);
+
+   disk_cache_put(cache, keys[5], blobs[5], sizeof(blobs[5]), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   expect_true(does_cache_contain(cache, keys[5]),
+               "single file compaction keeps the newest item");
+   expect_true(does_cache_contain(cache, keys[0]),
+               "single file compaction keeps the recently used item");
+   for (i = 1; i < 5; i++) {
+      expect_false(does_cache_contain(cache, keys[i]),
+                   "single file compaction evicts the least recently used "
+                   "items");
+   }
+
+   /* The compacted cache must be usable by new instances. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   result = disk_cache_get(cache, keys[5], &size);
+   expect_true(result && !memcmp(result, blobs[5], sizeof(blobs[5])),
+               "compacted single file cache contents");
+   free(result);
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_GLSL_CACHE_MAX_SIZE");
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+}
+#endif /* HAVE_FLOCK */
+
 static void
 test_put_key_and_get_key(void)
 {
@@ -517,6 +598,281 @@ test_put_key_and_get_key(void)
 
    disk_cache_destroy(cache);
 }
+struct get_batch_result {
+   uint8_t (*blobs)[256];
+   uint8_t (*keys)[20];
+   unsigned num_blobs;
+   int hits;
+   int misses;
+   int mismatches;
+};
+
+static void
+get_batch_cb(void *data, const cache_key key, void *blob, size_t size)
+{
+   struct get_batch_result *res = data;
+   unsigned i;
+
+   if (!blob) {
+      p_atomic_inc(&res->misses);
+      return;
+   }
+
+   for (i = 0; i < res->num_blobs; i++) {
+      if (!memcmp(res->keys[i], key, sizeof(res->keys[i])))
+         break;
+   }
+
+   if (i < res->num_blobs && size == sizeof(res->blobs[i]) &&
+       !memcmp(res->blobs[i], blob, size))
+      p_atomic_inc(&res->hits);
+   else
+      p_atomic_inc(&res->mismatches);
+
+   free(blob);
+}
+
+static void
+test_get_batch(void)
+{
+   struct disk_cache *cache;
+   struct get_batch_result res;
+   uint8_t blobs[8][256];
+   uint8_t keys[10][20];
+   unsigned i, j;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   cache = disk_cache_create("test", "make_check", 0);
+
+   for (i = 0; i < 8; i++) {
+      for (j = 0; j < sizeof(blobs[i]); j++)
+         blobs[i][j] = rand();
+      disk_cache_compute_key(cache, blobs[i], sizeof(blobs[i]), keys[i]);
+   }
+   disk_cache_compute_key(cache, "missing 1", 9, keys[8]);
+   disk_cache_compute_key(cache, "missing 2", 9, keys[9]);
+
+   /* The last two keys were never stored and must miss. */
+   for (i = 0; i < 8; i++)
+      disk_cache_put(cache, keys[i], blobs[i], sizeof(blobs[i]), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   memset(&res, 0, sizeof(res));
+   res.blobs = blobs;
+   res.keys = keys;
+   res.num_blobs = 8;
+
+   disk_cache_get_batch(cache, (const cache_key *) keys, 10, get_batch_cb,
+                        &res);
+   disk_cache_wait_for_idle(cache);
+
+   expect_equal(res.hits, 8, "disk_cache_get_batch of existing items");
+   expect_equal(res.misses, 2, "disk_cache_get_batch of missing items");
+   expect_equal(res.mismatches, 0, "disk_cache_get_batch contents");
+
+   disk_cache_destroy(cache);
+}
+
+static void
+test_item_index(void)
+{
+   struct disk_cache *cache, *other;
+   char blob[] = "An item the index must keep track of";
+   uint8_t key[20];
+   char *result;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   /* Two instances sharing the cache directory, like two processes. */
+   cache = disk_cache_create("test", "make_check", 0);
+   other = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), key);
+
+   expect_false(disk_cache_item_index_may_contain(other, key),
+                "item index rules out an item never put");
+   expect_false(does_cache_contain(other, key),
+                "disk_cache_get of an item never put");
+
+   /* An item put by one instance must not be ruled out by the other. */
+   disk_cache_put(cache, key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   expect_true(disk_cache_item_index_may_contain(other, key),
+               "item index of a second instance sees the put");
+   result = disk_cache_get(other, key, &size);
+   expect_equal_str(blob, result,
+                    "disk_cache_get from a second instance (pointer)");
+   expect_equal(size, sizeof(blob),
+                "disk_cache_get from a second instance (size)");
+   free(result);
+
+   /* Evicting the item drops it from the index of both instances. */
+   disk_cache_remove(cache, key);
+
+   expect_false(disk_cache_item_index_may_contain(other, key),
+                "item index rules out an evicted item");
+   expect_false(does_cache_contain(other, key),
+                "disk_cache_get of an evicted item");
+
+   /* Putting it again must make it visible again. */
+   disk_cache_put(other, key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(other);
+
+   expect_true(disk_cache_item_index_may_contain(cache, key),
+               "item index sees an item put again");
+   expect_true(does_cache_contain(cache, key),
+               "disk_cache_get of an item put again");
+
+   disk_cache_destroy(other);
+   disk_cache_destroy(cache);
+}
+#ifdef HAVE_ZSTD
+/* Train a zstd dictionary on made up shader-like samples and store it where
+ * disk_cache_create() looks for the dictionary of 'cache'.
+ */
+static bool
+write_compress_dict(struct disk_cache *cache, unsigned seed)
+{
+   static const char *const words[] = {
+      "uniform", "vec4", "mat4", "sampler2D", "texture", "gl_Position",
+      "void main()", "float", "return", "if", "else", "for", "in", "out",
+   };
+   const unsigned num_samples = 256, sample_size = 512;
+   size_t sample_sizes[256];
+   char *samples = malloc(num_samples * sample_size);
+   size_t dict_capacity = 4096;
+   void *dict_data = malloc(dict_capacity);
+   bool ok = false;
+
+   if (!samples || !dict_data)
+      goto out;
+
+   srand(seed);
+   for (unsigned i = 0; i < num_samples; i++) {
+      char *sample = samples + i * sample_size;
+      unsigned len = 0;
+
+      while (len < sample_size - 32) {
+         len += snprintf(sample + len, sample_size - len, "%s %u_%u; ",
+                         words[rand() % ARRAY_SIZE(words)], seed,
+                         rand() % 16);
+      }
+      sample_sizes[i] = len;
+   }
+
+   /* Pack the samples back to back as the trainer expects. */
+   size_t offset = 0;
+   for (unsigned i = 0; i < num_samples; i++) {
+      memmove(samples + offset, samples + i * sample_size, sample_sizes[i]);
+      offset += sample_sizes[i];
+   }
+
+   size_t dict_size = ZDICT_trainFromBuffer(dict_data, dict_capacity, samples,
+                                            sample_sizes, num_samples);
+   if (ZDICT_isError(dict_size))
+      goto out;
+
+   char *filename =
+      disk_cache_get_dict_filename(NULL, cache->path,
+                                   cache->driver_keys_blob,
+                                   cache->driver_keys_blob_size);
+   FILE *f = fopen(filename, "wb");
+   if (f) {
+      ok = fwrite(dict_data, 1, dict_size, f) == dict_size;
+      ok = fclose(f) == 0 && ok;
+   }
+   ralloc_free(filename);
+
+out:
+   free(dict_data);
+   free(samples);
+   return ok;
+}
+
+static void
+test_compress_dict(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "uniform vec4 color; void main() { gl_FragColor = color; }";
+   uint8_t key[20];
+   char *result, *filename;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   cache = disk_cache_create("test", "make_check", 0);
+   expect_true(write_compress_dict(cache, 1), "write compression dictionary");
+   disk_cache_destroy(cache);
+
+   /* The dictionary is picked up when the cache is created. */
+   /* Single file entries are never rewritten, so no dictionary there. */
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+   expect_null(cache->compress_dict,
+               "no compression dictionary with a single file cache");
+   disk_cache_destroy(cache);
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+
+   cache = disk_cache_create("test", "make_check", 0);
+   expect_non_null(cache->compress_dict, "load compression dictionary");
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), key);
+   disk_cache_put(cache, key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   result = disk_cache_get(cache, key, &size);
+   expect_equal_str(blob, result,
+                    "disk_cache_get with a dictionary (pointer)");
+   expect_equal(size, sizeof(blob), "disk_cache_get with a dictionary (size)");
+   free(result);
+
+   /* Items compressed with a replaced dictionary can't be read anymore,
+    * they must be evicted so that they can be written again.
+    */
+   expect_true(write_compress_dict(cache, 2),
+               "replace compression dictionary");
+   disk_cache_destroy(cache);
+
+   cache = disk_cache_create("test", "make_check", 0);
+   expect_non_null(cache->compress_dict, "load replaced dictionary");
+
+   expect_false(does_cache_contain(cache, key),
+                "disk_cache_get of an item using a replaced dictionary");
+
+   filename = disk_cache_get_cache_filename(cache, key);
+   expect_true(filename && access(filename, F_OK) == -1,
+               "item using a replaced dictionary is evicted");
+   free(filename);
+
+   disk_cache_put(cache, key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   result = disk_cache_get(cache, key, &size);
+   expect_equal_str(blob, result,
+                    "disk_cache_get of an item written again (pointer)");
+   expect_equal(size, sizeof(blob),
+                "disk_cache_get of an item written again (size)");
+   free(result);
+
+   /* Don't leave the dictionary to the tests which follow. */
+   filename = disk_cache_get_dict_filename(NULL, cache->path,
+                                           cache->driver_keys_blob,
+                                           cache->driver_keys_blob_size);
+   unlink(filename);
+   ralloc_free(filename);
+
+   disk_cache_destroy(cache);
+}
+#endif /* HAVE_ZSTD */
 #endif /* ENABLE_SHADER_CACHE */
 
 int
@@ -531,6 +887,18 @@ main(void)
 
    test_put_key_and_get_key();
 
+   test_get_batch();
+
+   test_item_index();
+
+#ifdef HAVE_ZSTD
+   test_compress_dict();
+#endif
+
+#ifdef HAVE_FLOCK
+   test_single_file_eviction();
+#endif
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
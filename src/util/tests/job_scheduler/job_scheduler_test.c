@@ -0,0 +1,425 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Run with --bench to compare how util_queue and util_job_scheduler cope
+ * with many tiny jobs added from several threads at once.
+ */
+
+#undef NDEBUG
+
+#include "util/u_job_scheduler.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+
+#define NUM_THREADS 8
+#define NUM_ADDERS 4
+#define NUM_JOBS_PER_ADDER 4096
+#define CHAIN_LENGTH 256
+#define NUM_CHILDREN 16
+
+struct test_job {
+   struct util_job job;
+   int *counter;
+   int seen;
+   struct util_job_scheduler *sched;
+   struct test_job *children;
+};
+
+static void
+inc_execute(void *data, void *gdata, int thread_index)
+{
+   struct test_job *t = data;
+
+   assert(thread_index >= 0 && thread_index < NUM_THREADS);
+   p_atomic_inc(t->counter);
+}
+
+/* Records the value of the shared counter before it. */
+static void
+chain_execute(void *data, void *gdata, int thread_index)
+{
+   struct test_job *t = data;
+
+   t->seen = p_atomic_inc_return(t->counter) - 1;
+}
+
+static void
+add_children_execute(void *data, void *gdata, int thread_index)
+{
+   struct test_job *t = data;
+
+   for (unsigned i = 0; i < NUM_CHILDREN; i++) {
+      t->children[i].counter = t->counter;
+      util_job_scheduler_add_job(t->sched, &t->children[i].job,
+                                 &t->children[i], inc_execute, NULL,
+                                 UTIL_JOB_PRIORITY_LOW, NULL, 0);
+   }
+}
+
+static void
+wait_execute(void *data, void *gdata, int thread_index)
+{
+   util_queue_fence_wait(gdata);
+}
+
+struct adder {
+   struct util_job_scheduler *sched;
+   struct test_job *jobs;
+   int *counter;
+};
+
+static int
+adder_thread(void *data)
+{
+   struct adder *adder = data;
+
+   for (unsigned i = 0; i < NUM_JOBS_PER_ADDER; i++) {
+      adder->jobs[i].counter = adder->counter;
+      util_job_scheduler_add_job(adder->sched, &adder->jobs[i].job,
+                                 &adder->jobs[i], inc_execute, NULL,
+                                 i % 2 ? UTIL_JOB_PRIORITY_LOW :
+                                         UTIL_JOB_PRIORITY_HIGH,
+                                 NULL, 0);
+   }
+   return 0;
+}
+
+static void
+test_many_adders(void)
+{
+   struct util_job_scheduler sched;
+   struct test_job *jobs =
+      calloc(NUM_ADDERS * NUM_JOBS_PER_ADDER, sizeof(*jobs));
+   struct adder adders[NUM_ADDERS];
+   thrd_t threads[NUM_ADDERS];
+   int counter = 0;
+
+   assert(jobs);
+   assert(util_job_scheduler_init(&sched, "test", NUM_THREADS, 0, NULL));
+
+   for (unsigned i = 0; i < NUM_ADDERS * NUM_JOBS_PER_ADDER; i++)
+      util_job_init(&jobs[i].job);
+
+   for (unsigned i = 0; i < NUM_ADDERS; i++) {
+      adders[i].sched = &sched;
+      adders[i].jobs = &jobs[i * NUM_JOBS_PER_ADDER];
+      adders[i].counter = &counter;
+      assert(thrd_create(&threads[i], adder_thread, &adders[i]) ==
+             thrd_success);
+   }
+   for (unsigned i = 0; i < NUM_ADDERS; i++)
+      thrd_join(threads[i], NULL);
+
+   util_job_scheduler_finish(&sched);
+   assert(counter == NUM_ADDERS * NUM_JOBS_PER_ADDER);
+
+   for (unsigned i = 0; i < NUM_ADDERS * NUM_JOBS_PER_ADDER; i++) {
+      assert(util_queue_fence_is_signalled(&jobs[i].job.fence));
+      util_job_destroy(&jobs[i].job);
+   }
+
+   util_job_scheduler_destroy(&sched);
+   free(jobs);
+}
+
+static void
+test_dependencies(void)
+{
+   struct util_job_scheduler sched;
+   struct test_job chain[CHAIN_LENGTH];
+   struct test_job diamond[4];
+   int counter = 0;
+
+   assert(util_job_scheduler_init(&sched, "test", NUM_THREADS, 0, NULL));
+
+   /* Each job depends on the one before, so they must run in order. */
+   for (unsigned i = 0; i < CHAIN_LENGTH; i++) {
+      struct util_job *dep = i ? &chain[i - 1].job : NULL;
+
+      util_job_init(&chain[i].job);
+      chain[i].counter = &counter;
+      util_job_scheduler_add_job(&sched, &chain[i].job, &chain[i],
+                                 chain_execute, NULL, UTIL_JOB_PRIORITY_HIGH,
+                                 &dep, dep ? 1 : 0);
+   }
+   util_job_wait(&chain[CHAIN_LENGTH - 1].job);
+   util_job_scheduler_finish(&sched);
+
+   for (unsigned i = 0; i < CHAIN_LENGTH; i++) {
+      assert(chain[i].seen == i);
+      util_job_destroy(&chain[i].job);
+   }
+
+   /* 0 -> 1, 2 -> 3, many times to shake out races */
+   for (unsigned run = 0; run < 1000; run++) {
+      struct util_job *deps[2];
+
+      counter = 0;
+      for (unsigned i = 0; i < 4; i++) {
+         util_job_init(&diamond[i].job);
+         diamond[i].counter = &counter;
+      }
+
+      deps[0] = &diamond[0].job;
+      util_job_scheduler_add_job(&sched, &diamond[0].job, &diamond[0],
+                                 chain_execute, NULL, UTIL_JOB_PRIORITY_LOW,
+                                 NULL, 0);
+      util_job_scheduler_add_job(&sched, &diamond[1].job, &diamond[1],
+                                 chain_execute, NULL, UTIL_JOB_PRIORITY_LOW,
+                                 deps, 1);
+      util_job_scheduler_add_job(&sched, &diamond[2].job, &diamond[2],
+                                 chain_execute, NULL, UTIL_JOB_PRIORITY_HIGH,
+                                 deps, 1);
+      deps[0] = &diamond[1].job;
+      deps[1] = &diamond[2].job;
+      util_job_scheduler_add_job(&sched, &diamond[3].job, &diamond[3],
+                                 chain_execute, NULL, UTIL_JOB_PRIORITY_HIGH,
+                                 deps, 2);
+      util_job_wait(&diamond[3].job);
+
+      assert(diamond[0].seen == 0);
+      assert(diamond[1].seen >= 1 && diamond[1].seen <= 2);
+      assert(diamond[2].seen >= 1 && diamond[2].seen <= 2);
+      assert(diamond[3].seen == 3);
+
+      util_job_scheduler_finish(&sched);
+      for (unsigned i = 0; i < 4; i++)
+         util_job_destroy(&diamond[i].job);
+   }
+
+   util_job_scheduler_destroy(&sched);
+}
+
+static void
+test_nested(void)
+{
+   struct util_job_scheduler sched;
+   struct test_job parents[NUM_THREADS * 4];
+   struct test_job children[NUM_THREADS * 4][NUM_CHILDREN];
+   int counter = 0;
+
+   assert(util_job_scheduler_init(&sched, "test", NUM_THREADS, 0, NULL));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(parents); i++) {
+      util_job_init(&parents[i].job);
+      for (unsigned j = 0; j < NUM_CHILDREN; j++)
+         util_job_init(&children[i][j].job);
+
+      parents[i].counter = &counter;
+      parents[i].sched = &sched;
+      parents[i].children = children[i];
+      util_job_scheduler_add_job(&sched, &parents[i].job, &parents[i],
+                                 add_children_execute, NULL,
+                                 UTIL_JOB_PRIORITY_HIGH, NULL, 0);
+   }
+
+   /* This must also wait for the jobs added by jobs. */
+   util_job_scheduler_finish(&sched);
+   assert(counter == ARRAY_SIZE(parents) * NUM_CHILDREN);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(parents); i++) {
+      util_job_destroy(&parents[i].job);
+      for (unsigned j = 0; j < NUM_CHILDREN; j++)
+         util_job_destroy(&children[i][j].job);
+   }
+
+   util_job_scheduler_destroy(&sched);
+}
+
+static void
+test_priorities(void)
+{
+   struct util_job_scheduler sched;
+   struct util_queue_fence gate;
+   struct test_job blocker, jobs[8];
+   int counter = 0;
+
+   util_queue_fence_init(&gate);
+   util_queue_fence_reset(&gate);
+   assert(util_job_scheduler_init(&sched, "test", 1, 0, &gate));
+
+   /* Keep the only thread busy while the others are queued. */
+   util_job_init(&blocker.job);
+   util_job_scheduler_add_job(&sched, &blocker.job, &blocker, wait_execute,
+                              NULL, UTIL_JOB_PRIORITY_HIGH, NULL, 0);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      util_job_init(&jobs[i].job);
+      jobs[i].counter = &counter;
+      util_job_scheduler_add_job(&sched, &jobs[i].job, &jobs[i],
+                                 chain_execute, NULL,
+                                 i < ARRAY_SIZE(jobs) / 2 ?
+                                    UTIL_JOB_PRIORITY_LOW :
+                                    UTIL_JOB_PRIORITY_HIGH,
+                                 NULL, 0);
+   }
+
+   util_queue_fence_signal(&gate);
+   util_job_scheduler_finish(&sched);
+
+   /* High priority jobs first, each priority in the order added. */
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      unsigned half = ARRAY_SIZE(jobs) / 2;
+
+      assert(jobs[i].seen == (i < half ? i + half : i - half));
+      util_job_destroy(&jobs[i].job);
+   }
+   util_job_destroy(&blocker.job);
+
+   util_job_scheduler_destroy(&sched);
+   util_queue_fence_destroy(&gate);
+}
+
+/* Contention benchmark */
+
+struct bench_adder {
+   struct util_queue *queue;
+   struct util_job_scheduler *sched;
+   struct util_queue_fence *fences;
+   struct util_job *jobs;
+};
+
+static void
+empty_execute(void *data, void *gdata, int thread_index)
+{
+}
+
+static int
+queue_adder_thread(void *data)
+{
+   struct bench_adder *adder = data;
+
+   for (unsigned i = 0; i < NUM_JOBS_PER_ADDER; i++) {
+      /* util_queue skips NULL jobs */
+      util_queue_add_job(adder->queue, adder, &adder->fences[i],
+                         empty_execute, NULL, 0);
+   }
+   return 0;
+}
+
+static int
+sched_adder_thread(void *data)
+{
+   struct bench_adder *adder = data;
+
+   for (unsigned i = 0; i < NUM_JOBS_PER_ADDER; i++) {
+      util_job_scheduler_add_job(adder->sched, &adder->jobs[i], NULL,
+                                 empty_execute, NULL, UTIL_JOB_PRIORITY_HIGH,
+                                 NULL, 0);
+   }
+   return 0;
+}
+
+static int64_t
+bench_run(thrd_start_t func, struct bench_adder *adders, unsigned num_adders)
+{
+   thrd_t threads[NUM_ADDERS * 4];
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < num_adders; i++)
+      assert(thrd_create(&threads[i], func, &adders[i]) == thrd_success);
+   for (unsigned i = 0; i < num_adders; i++)
+      thrd_join(threads[i], NULL);
+
+   if (adders[0].queue)
+      util_queue_finish(adders[0].queue);
+   else
+      util_job_scheduler_finish(adders[0].sched);
+
+   return os_time_get_nano() - start;
+}
+
+static void
+bench(void)
+{
+   unsigned max_adders = NUM_ADDERS * 4;
+   unsigned num_jobs = max_adders * NUM_JOBS_PER_ADDER;
+   struct util_queue_fence *fences = calloc(num_jobs, sizeof(*fences));
+   struct util_job *jobs = calloc(num_jobs, sizeof(*jobs));
+   struct bench_adder adders[NUM_ADDERS * 4];
+
+   assert(fences && jobs);
+   for (unsigned i = 0; i < num_jobs; i++) {
+      util_queue_fence_init(&fences[i]);
+      util_job_init(&jobs[i]);
+   }
+
+   printf("adders  util_queue (ns/job)  util_job_scheduler (ns/job)\n");
+
+   for (unsigned num_adders = 1; num_adders <= max_adders; num_adders *= 2) {
+      struct util_queue queue;
+      struct util_job_scheduler sched;
+      int64_t queue_time, sched_time;
+
+      assert(util_queue_init(&queue, "bench", 1024, NUM_THREADS, 0, NULL));
+      for (unsigned i = 0; i < num_adders; i++) {
+         adders[i].queue = &queue;
+         adders[i].sched = NULL;
+         adders[i].fences = &fences[i * NUM_JOBS_PER_ADDER];
+      }
+      queue_time = bench_run(queue_adder_thread, adders, num_adders);
+      util_queue_destroy(&queue);
+
+      assert(util_job_scheduler_init(&sched, "bench", NUM_THREADS, 0, NULL));
+      for (unsigned i = 0; i < num_adders; i++) {
+         adders[i].queue = NULL;
+         adders[i].sched = &sched;
+         adders[i].jobs = &jobs[i * NUM_JOBS_PER_ADDER];
+      }
+      sched_time = bench_run(sched_adder_thread, adders, num_adders);
+      util_job_scheduler_destroy(&sched);
+
+      printf("%6u  %19.1f  %27.1f\n", num_adders,
+             (double)queue_time / (num_adders * NUM_JOBS_PER_ADDER),
+             (double)sched_time / (num_adders * NUM_JOBS_PER_ADDER));
+   }
+
+   for (unsigned i = 0; i < num_jobs; i++) {
+      util_queue_fence_destroy(&fences[i]);
+      util_job_destroy(&jobs[i]);
+   }
+   free(fences);
+   free(jobs);
+}
+
+int
+main(int argc, char **argv)
+{
+   if (argc > 1 && !strcmp(argv[1], "--bench")) {
+      bench();
+      return 0;
+   }
+
+   test_many_adders();
+   test_dependencies();
+   test_nested();
+   test_priorities();
+
+   return 0;
+}
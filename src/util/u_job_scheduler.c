@@ -0,0 +1,414 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "u_job_scheduler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "c11/threads.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_process.h"
+#include "util/u_thread.h"
+
+#if defined(__linux__)
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#define QUEUED_ONE (1ull << 32)
+#define SLEEPING_MASK (QUEUED_ONE - 1)
+
+struct util_job_worker {
+   struct util_job_scheduler *sched;
+   int index;
+
+   /* Protects the deques. The owner takes jobs from the front, thieves take
+    * them from the back, where the owner would get to them last.
+    */
+   simple_mtx_t lock;
+   struct list_head deques[UTIL_JOB_NUM_PRIORITIES];
+};
+
+/* The worker running on the current thread, if any */
+static __THREAD_INITIAL_EXEC struct util_job_worker *current_worker;
+
+void
+util_job_init(struct util_job *job)
+{
+   memset(job, 0, sizeof(*job));
+   util_queue_fence_init(&job->fence);
+   simple_mtx_init(&job->lock, mtx_plain);
+   job->completed = true;
+}
+
+void
+util_job_destroy(struct util_job *job)
+{
+   assert(job->completed);
+   util_dynarray_fini(&job->successors);
+   simple_mtx_destroy(&job->lock);
+   util_queue_fence_destroy(&job->fence);
+}
+
+static void
+push_job(struct util_job_scheduler *sched, struct util_job *job)
+{
+   struct util_job_worker *worker = current_worker;
+
+   /* Jobs added from outside are spread over all threads, jobs added from a
+    * job are most likely to use what it just produced.
+    */
+   if (!worker || worker->sched != sched) {
+      unsigned index = p_atomic_inc_return(&sched->next_worker);
+      worker = &sched->workers[index % sched->num_threads];
+   }
+
+   simple_mtx_lock(&worker->lock);
+   list_addtail(&job->link, &worker->deques[job->priority]);
+   simple_mtx_unlock(&worker->lock);
+
+   uint64_t old = p_atomic_add_return(&sched->queued_sleeping, QUEUED_ONE) -
+                  QUEUED_ONE;
+   if (old & SLEEPING_MASK) {
+      mtx_lock(&sched->idle_lock);
+      cnd_signal(&sched->idle_cond);
+      mtx_unlock(&sched->idle_lock);
+   }
+}
+
+static struct util_job *
+pop_job(struct util_job_worker *worker, enum util_job_priority priority,
+        bool steal)
+{
+   struct list_head *deque = &worker->deques[priority];
+   struct util_job *job = NULL;
+
+   /* Don't bother taking the lock of an empty deque. Missing a job being
+    * added here is fine, the queued count keeps us from going to sleep.
+    */
+   if (list_is_empty(deque))
+      return NULL;
+
+   simple_mtx_lock(&worker->lock);
+   if (!list_is_empty(deque)) {
+      job = steal ? list_last_entry(deque, struct util_job, link) :
+                    list_first_entry(deque, struct util_job, link);
+      list_del(&job->link);
+   }
+   simple_mtx_unlock(&worker->lock);
+
+   if (job)
+      p_atomic_add(&worker->sched->queued_sleeping, -QUEUED_ONE);
+
+   return job;
+}
+
+static struct util_job *
+get_job(struct util_job_worker *self)
+{
+   struct util_job_scheduler *sched = self->sched;
+
+   /* Work of a higher priority comes first, wherever it is. */
+   for (unsigned p = 0; p < UTIL_JOB_NUM_PRIORITIES; p++) {
+      struct util_job *job = pop_job(self, p, false);
+      if (job)
+         return job;
+
+      for (unsigned i = 1; i < sched->num_threads; i++) {
+         struct util_job_worker *victim =
+            &sched->workers[(self->index + i) % sched->num_threads];
+
+         job = pop_job(victim, p, true);
+         if (job)
+            return job;
+      }
+   }
+
+   return NULL;
+}
+
+static void
+run_job(struct util_job_scheduler *sched, struct util_job *job,
+        int thread_index)
+{
+   /* The job may be reused or freed as soon as the fence is signaled. */
+   void *data = job->data;
+   util_queue_execute_func cleanup = job->cleanup;
+   struct util_dynarray successors;
+
+   job->execute(data, sched->global_data, thread_index);
+
+   simple_mtx_lock(&job->lock);
+   job->completed = true;
+   successors = job->successors;
+   util_dynarray_init(&job->successors, NULL);
+   simple_mtx_unlock(&job->lock);
+
+   util_dynarray_foreach(&successors, struct util_job *, succ) {
+      if (p_atomic_dec_zero(&(*succ)->num_deps))
+         push_job(sched, *succ);
+   }
+   util_dynarray_fini(&successors);
+
+   util_queue_fence_signal(&job->fence);
+   if (cleanup)
+      cleanup(data, sched->global_data, thread_index);
+
+   if (p_atomic_dec_zero(&sched->num_pending)) {
+      mtx_lock(&sched->finish_lock);
+      cnd_broadcast(&sched->finish_cond);
+      mtx_unlock(&sched->finish_lock);
+   }
+}
+
+static int
+util_job_thread_func(void *input)
+{
+   struct util_job_worker *self = (struct util_job_worker *) input;
+   struct util_job_scheduler *sched = self->sched;
+
+   current_worker = self;
+
+   if (sched->flags & UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY) {
+      /* Don't inherit the thread affinity from the parent thread.
+       * Set the full mask.
+       */
+      uint32_t mask[UTIL_MAX_CPUS / 32];
+
+      memset(mask, 0xff, sizeof(mask));
+
+      util_cpu_detect();
+      util_set_current_thread_affinity(mask, NULL,
+                                       util_get_cpu_caps()->num_cpu_mask_bits);
+   }
+
+#if defined(__linux__)
+   if (sched->flags & UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) {
+      /* The nice() function can only set a maximum of 19. */
+      setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+   }
+#endif
+
+   if (strlen(sched->name) > 0) {
+      char name[16];
+      snprintf(name, sizeof(name), "%s%i", sched->name, self->index);
+      u_thread_setname(name);
+   }
+
+   while (1) {
+      struct util_job *job = get_job(self);
+
+      if (job) {
+         run_job(sched, job, self->index);
+         continue;
+      }
+
+      /* Nothing to steal either, sleep until a job is queued. */
+      mtx_lock(&sched->idle_lock);
+      uint64_t state = p_atomic_inc_return(&sched->queued_sleeping);
+      while (!sched->shutdown && state < QUEUED_ONE) {
+         cnd_wait(&sched->idle_cond, &sched->idle_lock);
+         state = p_atomic_read(&sched->queued_sleeping);
+      }
+      p_atomic_dec(&sched->queued_sleeping);
+
+      bool shutdown = sched->shutdown;
+      mtx_unlock(&sched->idle_lock);
+
+      if (shutdown)
+         break;
+   }
+
+   return 0;
+}
+
+bool
+util_job_scheduler_init(struct util_job_scheduler *sched,
+                        const char *name,
+                        unsigned num_threads,
+                        unsigned flags,
+                        void *global_data)
+{
+   unsigned i;
+
+   memset(sched, 0, sizeof(*sched));
+
+   /* See util_queue_init() for how the name is shortened. */
+   const char *process_name = util_get_process_name();
+   int process_len = process_name ? strlen(process_name) : 0;
+   int name_len = strlen(name);
+   const int max_chars = sizeof(sched->name) - 1;
+
+   name_len = MIN2(name_len, max_chars);
+   process_len = MIN2(process_len, max_chars - name_len - 1);
+
+   if (process_len > 0) {
+      snprintf(sched->name, sizeof(sched->name), "%.*s:%s",
+               process_len, process_name, name);
+   } else {
+      snprintf(sched->name, sizeof(sched->name), "%s", name);
+   }
+
+   sched->flags = flags;
+   sched->num_threads = MAX2(num_threads, 1);
+   sched->global_data = global_data;
+
+   sched->workers = (struct util_job_worker *)
+      calloc(sched->num_threads, sizeof(struct util_job_worker));
+   sched->threads = (thrd_t *) calloc(sched->num_threads, sizeof(thrd_t));
+   if (!sched->workers || !sched->threads)
+      goto fail;
+
+   for (i = 0; i < sched->num_threads; i++) {
+      struct util_job_worker *worker = &sched->workers[i];
+
+      worker->sched = sched;
+      worker->index = i;
+      simple_mtx_init(&worker->lock, mtx_plain);
+      for (unsigned p = 0; p < UTIL_JOB_NUM_PRIORITIES; p++)
+         list_inithead(&worker->deques[p]);
+   }
+
+   (void) mtx_init(&sched->idle_lock, mtx_plain);
+   cnd_init(&sched->idle_cond);
+   (void) mtx_init(&sched->finish_lock, mtx_plain);
+   cnd_init(&sched->finish_cond);
+
+   for (i = 0; i < sched->num_threads; i++) {
+      sched->threads[i] = u_thread_create(util_job_thread_func,
+                                          &sched->workers[i]);
+      if (!sched->threads[i]) {
+         if (i == 0)
+            goto fail_threads;
+
+         /* at least one thread is fine */
+         sched->num_threads = i;
+         break;
+      }
+
+      if (flags & UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) {
+#if defined(__linux__) && defined(SCHED_BATCH)
+         struct sched_param sched_param = {0};
+
+         /* See util_queue_create_thread(). */
+         pthread_setschedparam(sched->threads[i], SCHED_BATCH, &sched_param);
+#endif
+      }
+   }
+
+   return true;
+
+fail_threads:
+   cnd_destroy(&sched->finish_cond);
+   mtx_destroy(&sched->finish_lock);
+   cnd_destroy(&sched->idle_cond);
+   mtx_destroy(&sched->idle_lock);
+fail:
+   free(sched->threads);
+   free(sched->workers);
+   memset(sched, 0, sizeof(*sched));
+   return false;
+}
+
+void
+util_job_scheduler_destroy(struct util_job_scheduler *sched)
+{
+   util_job_scheduler_finish(sched);
+
+   mtx_lock(&sched->idle_lock);
+   sched->shutdown = true;
+   cnd_broadcast(&sched->idle_cond);
+   mtx_unlock(&sched->idle_lock);
+
+   for (unsigned i = 0; i < sched->num_threads; i++) {
+      thrd_join(sched->threads[i], NULL);
+      simple_mtx_destroy(&sched->workers[i].lock);
+   }
+
+   cnd_destroy(&sched->finish_cond);
+   mtx_destroy(&sched->finish_lock);
+   cnd_destroy(&sched->idle_cond);
+   mtx_destroy(&sched->idle_lock);
+   free(sched->threads);
+   free(sched->workers);
+}
+
+void
+util_job_scheduler_add_job(struct util_job_scheduler *sched,
+                           struct util_job *job,
+                           void *data,
+                           util_queue_execute_func execute,
+                           util_queue_execute_func cleanup,
+                           enum util_job_priority priority,
+                           struct util_job **deps,
+                           unsigned num_deps)
+{
+   assert(job->completed);
+   assert(priority < UTIL_JOB_NUM_PRIORITIES);
+
+   util_queue_fence_reset(&job->fence);
+   job->data = data;
+   job->execute = execute;
+   job->cleanup = cleanup;
+   job->priority = priority;
+   job->completed = false;
+   job->num_deps = 1;
+
+   p_atomic_inc(&sched->num_pending);
+
+   for (unsigned i = 0; i < num_deps; i++) {
+      struct util_job *dep = deps[i];
+      bool wait = false;
+
+      simple_mtx_lock(&dep->lock);
+      if (!dep->completed) {
+         struct util_job **succ =
+            util_dynarray_grow(&dep->successors, struct util_job *, 1);
+         if (succ) {
+            *succ = job;
+            p_atomic_inc(&job->num_deps);
+         } else {
+            wait = true;
+         }
+      }
+      simple_mtx_unlock(&dep->lock);
+
+      /* Out of memory, fall back to blocking. */
+      if (wait)
+         util_job_wait(dep);
+   }
+
+   if (p_atomic_dec_zero(&job->num_deps))
+      push_job(sched, job);
+}
+
+void
+util_job_scheduler_finish(struct util_job_scheduler *sched)
+{
+   mtx_lock(&sched->finish_lock);
+   while (p_atomic_read(&sched->num_pending))
+      cnd_wait(&sched->finish_cond, &sched->finish_lock);
+   mtx_unlock(&sched->finish_lock);
+}
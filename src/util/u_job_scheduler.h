@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Job scheduler with a work-stealing deque per thread.
+ *
+ * Unlike util_queue, there is no lock shared by all threads: jobs added from
+ * outside are spread over the threads' deques, jobs added from a job go to
+ * the deque of the thread running it, and idle threads steal from the others.
+ * Jobs run in priority order, and may depend on other jobs, in which case
+ * they are only queued once those have completed.  Jobs which don't depend
+ * on each other run in no particular order.
+ *
+ * The callbacks have the same signature as util_queue's, and completion is
+ * signaled through a util_queue_fence in the job.
+ */
+
+#ifndef U_JOB_SCHEDULER_H
+#define U_JOB_SCHEDULER_H
+
+#include "util/list.h"
+#include "util/simple_mtx.h"
+#include "util/u_dynarray.h"
+#include "util/u_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum util_job_priority {
+   /* e.g. compiles the application is going to wait for */
+   UTIL_JOB_PRIORITY_HIGH,
+   /* e.g. optimized shader variants compiled in the background */
+   UTIL_JOB_PRIORITY_LOW,
+   UTIL_JOB_NUM_PRIORITIES,
+};
+
+/* Put this into your job structure, and initialize it with util_job_init()
+ * once.  It can be added again after it has completed.
+ */
+struct util_job {
+   /* Signaled once the job has executed */
+   struct util_queue_fence fence;
+
+   /* The rest is private to the scheduler */
+   struct list_head link;
+   void *data;
+   util_queue_execute_func execute;
+   util_queue_execute_func cleanup;
+   enum util_job_priority priority;
+
+   /* Dependencies which haven't completed yet, plus one while adding */
+   int num_deps;
+
+   /* Protects completed and successors */
+   simple_mtx_t lock;
+   bool completed;
+   struct util_dynarray successors;
+};
+
+struct util_job_worker;
+
+/* Put this into your context. */
+struct util_job_scheduler {
+   char name[14]; /* 13 characters = the thread name without the index */
+   unsigned flags;
+   unsigned num_threads;
+   thrd_t *threads;
+   struct util_job_worker *workers;
+   void *global_data;
+
+   /* Picks the deque for jobs added from other threads */
+   unsigned next_worker;
+
+   /* Number of queued jobs in the upper 32 bits and of sleeping threads in
+    * the lower ones, in one word so that a thread going to sleep and a job
+    * being added can't miss each other.
+    */
+   uint64_t queued_sleeping;
+   mtx_t idle_lock;
+   cnd_t idle_cond;
+   bool shutdown;
+
+   /* Jobs added which haven't completed yet */
+   int num_pending;
+   mtx_t finish_lock;
+   cnd_t finish_cond;
+};
+
+void util_job_init(struct util_job *job);
+void util_job_destroy(struct util_job *job);
+
+static inline void
+util_job_wait(struct util_job *job)
+{
+   util_queue_fence_wait(&job->fence);
+}
+
+/* \p flags accepts UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY and
+ * UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY.
+ */
+bool util_job_scheduler_init(struct util_job_scheduler *sched,
+                             const char *name,
+                             unsigned num_threads,
+                             unsigned flags,
+                             void *global_data);
+
+/* Waits for all jobs to complete first. */
+void util_job_scheduler_destroy(struct util_job_scheduler *sched);
+
+/* Queue \p job, which executes once the \p num_deps jobs in \p deps have
+ * completed.  The dependencies must have been added before, and must not be
+ * freed or added again before this returns.
+ *
+ * The optional cleanup callback is called after the fence is signaled.
+ */
+void util_job_scheduler_add_job(struct util_job_scheduler *sched,
+                                struct util_job *job,
+                                void *data,
+                                util_queue_execute_func execute,
+                                util_queue_execute_func cleanup,
+                                enum util_job_priority priority,
+                                struct util_job **deps,
+                                unsigned num_deps);
+
+/* Wait for all jobs added so far, and those they add, to complete. */
+void util_job_scheduler_finish(struct util_job_scheduler *sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif